@@ -0,0 +1,78 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+// Compares listing and bidding many items with a command per item and with
+// the bulk commands, every command is a task executed the way the tasks
+// processor does it.
+//
+#include "database.h"
+#include "tasks.h"
+#include <chrono>
+#include <cstdio>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+using namespace auction_house::engine;
+using BenchClock = std::chrono::steady_clock;
+
+constexpr unsigned ITEMS = 500;
+constexpr unsigned ROUNDS = 20;
+constexpr SessionId SELLER = 1;
+constexpr SessionId BUYER = 2;
+
+// Executes the lines of a session as separate tasks
+static void execute(Database &database, const SessionId session_id,
+                    const std::vector<std::string> &lines) {
+  for (auto &line : lines) {
+    create_command_task({{}, session_id, line}, database).get();
+  }
+}
+
+// Prints the average time per item of selling and bidding all the items
+static void run(const char *name, const bool bulk) {
+  std::chrono::duration<double, std::micro> sell{0};
+  std::chrono::duration<double, std::micro> bid{0};
+  for (unsigned round = 0; round < ROUNDS; ++round) {
+    Accounts accounts;
+    AuctionList auctions;
+    SessionManager sessions;
+    Database database{accounts, auctions, sessions};
+    sessions.start_session(SELLER, 1);
+    sessions.start_session(BUYER, 2);
+    execute(database, SELLER, {"LOGIN seller", "DEPOSIT FUNDS 1000000"});
+    execute(database, BUYER, {"LOGIN buyer"});
+
+    std::vector<std::string> sells;
+    std::vector<std::string> bids;
+    std::string items;
+    std::string offers;
+    for (unsigned i = 0; i < ITEMS; ++i) {
+      auto item = "item_" + std::to_string(i);
+      accounts.deposit_item("seller", item);
+      sells.push_back("SELL " + item + " 100 3600");
+      bids.push_back("BID " + std::to_string(i) + " 150");
+      items += " " + item;
+      offers += " " + std::to_string(i) + ":150";
+    }
+    if (bulk) {
+      sells = {"SELL MANY 100 3600" + items};
+      bids = {"BID MANY" + offers};
+    }
+
+    auto start = BenchClock::now();
+    execute(database, SELLER, sells);
+    auto sold = BenchClock::now();
+    execute(database, BUYER, bids);
+    sell += sold - start;
+    bid += BenchClock::now() - sold;
+  }
+  std::printf("%-10s sell %6.3f us/item, bid %6.3f us/item\n", name,
+              sell.count() / (ROUNDS * ITEMS), bid.count() / (ROUNDS * ITEMS));
+}
+
+int main() {
+  spdlog::set_level(spdlog::level::off);
+  run("per item", false);
+  run("bulk", true);
+}
@@ -0,0 +1,68 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+// Compares parsing text commands with every scan kernel the CPU supports. The
+// short lines mostly measure the dispatch, the bulk ones with long lists of
+// items and bids show what the vector kernels gain.
+//
+#include "char_scan.h"
+#include "command.h"
+#include <chrono>
+#include <cstdio>
+#include <spdlog/spdlog.h>
+#include <string>
+
+using namespace auction_house::engine;
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned ROUNDS = 20000;
+
+static const char *kernel_name(const ScanKernel kernel) {
+  switch (kernel) {
+  case ScanKernel::Sse42:
+    return "sse4.2";
+  case ScanKernel::Avx2:
+    return "avx2";
+  default:
+    return "scalar";
+  }
+}
+
+// Prints the average time of parsing the line with every kernel
+static void measure(const std::string &line) {
+  std::printf("%.40s%s (%zu bytes)\n", line.c_str(),
+              line.size() > 40 ? "..." : "", line.size());
+  IngressEvent event{{}, 0, line};
+  for (auto kernel :
+       {ScanKernel::Scalar, ScanKernel::Sse42, ScanKernel::Avx2}) {
+    if (!set_scan_kernel(kernel)) {
+      continue;
+    }
+    // the results are kept so that parsing isn't optimized away
+    volatile std::size_t sink = 0;
+    auto start = Clock::now();
+    for (unsigned i = 0; i < ROUNDS; ++i) {
+      sink = sink + Command::parse(event).get().index();
+    }
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    std::printf("  %-10s %9.1f ns\n", kernel_name(kernel),
+                elapsed.count() / ROUNDS);
+  }
+}
+
+int main() {
+  spdlog::set_level(spdlog::level::off);
+  for (std::string line :
+       {"LOGIN username", "DEPOSIT FUNDS 100", "SELL item 100 60"}) {
+    measure(line);
+  }
+  std::string items;
+  std::string bids;
+  for (unsigned i = 0; i < 200; ++i) {
+    items += " long_item_name_" + std::to_string(i);
+    bids += " " + std::to_string(100000 + i) + ":" + std::to_string(1000 + i);
+  }
+  measure("SELL MANY 100 3600" + items);
+  measure("BID MANY" + bids);
+  measure("DEPOSIT MANY" + items);
+}
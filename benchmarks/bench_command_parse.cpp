@@ -0,0 +1,77 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+// Compares parsing text commands with the tokenizer of Command::parse and with
+// the chain of regular expressions it has replaced. The regular expressions
+// only match the line and copy the arguments, the tokenizer also creates the
+// command, which doesn't allocate.
+//
+#include "command.h"
+#include <chrono>
+#include <cstdio>
+#include <regex>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
+
+using namespace auction_house::engine;
+using Clock = std::chrono::steady_clock;
+
+constexpr unsigned ROUNDS = 20000;
+
+static const std::vector<std::regex> REGEX_CHAIN{
+    std::regex{R"(\s*(HELP)\s*)", std::regex::icase},
+    std::regex{R"(\s*(LOGIN)\s+(\w+)\s*)", std::regex::icase},
+    std::regex{R"(\s*(LOGOUT)\s*)", std::regex::icase},
+    std::regex{R"(\s*(DEPOSIT)\s+(FUNDS)\s+(\d+)\s*)", std::regex::icase},
+    std::regex{R"(\s*(DEPOSIT)\s+(ITEM)\s+(\w+)\s*)", std::regex::icase},
+    std::regex{R"(\s*(WITHDRAW)\s+(FUNDS)\s+(\d+)\s*)", std::regex::icase},
+    std::regex{R"(\s*(WITHDRAW)\s+(ITEM)\s+(\w+)\s*)", std::regex::icase},
+    std::regex{R"(\s*(SELL)\s+(\w+)\s+(\d+)\s*(\d+)?\s*)", std::regex::icase},
+    std::regex{R"(\s*(BID)\s+(\d+)\s+(\d+)\s*)", std::regex::icase},
+    std::regex{R"(\s*(SHOW)\s+(FUNDS)\s*)", std::regex::icase},
+    std::regex{R"(\s*(SHOW)\s+(ITEMS)\s*)", std::regex::icase},
+    std::regex{R"(\s*(SHOW)\s+(SALES)\s*)", std::regex::icase}};
+
+// Matches the line the way the commands used to be matched, returns the
+// number of arguments, none for an unknown command
+static std::size_t match_regex_chain(const std::string &line) {
+  std::smatch matches;
+  for (auto &command : REGEX_CHAIN) {
+    if (std::regex_match(line, matches, command)) {
+      std::vector<std::string> arguments;
+      for (std::size_t i = 2; i < matches.size(); ++i) {
+        arguments.push_back(matches[i].str());
+      }
+      return arguments.size();
+    }
+  }
+  return 0;
+}
+
+// Prints the average time of parsing the line
+template <typename Parse>
+static void measure(const char *name, const std::string &line, Parse parse) {
+  // the results are kept so that parsing isn't optimized away
+  volatile std::size_t sink = 0;
+  auto start = Clock::now();
+  for (unsigned i = 0; i < ROUNDS; ++i) {
+    sink = sink + parse(line);
+  }
+  std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+  std::printf("  %-10s %9.1f ns\n", name, elapsed.count() / ROUNDS);
+}
+
+int main() {
+  spdlog::set_level(spdlog::level::off);
+  for (std::string line : {"HELP", "LOGIN username", "DEPOSIT FUNDS 100",
+                           "SELL item 100 60", "BID 12 150", "SHOW SALES",
+                           "UNKNOWN COMMAND"}) {
+    std::printf("%s\n", line.c_str());
+    measure("regex", line, match_regex_chain);
+    IngressEvent event{{}, 0, line};
+    measure("tokenizer", line, [&event](const std::string &) {
+      return Command::parse(event).get().index();
+    });
+  }
+}
@@ -0,0 +1,139 @@
+//
+// Created by mswiercz on 28.11.2021.
+//
+#pragma once
+#include "database.h"
+#include "network.h"
+#include "session_processor.h"
+#include "tasks.h"
+#include "tasks_executor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace auction_house::benchmarks {
+using Clock = std::chrono::steady_clock;
+using Latencies = std::vector<Clock::duration>;
+
+// Commands sent by every client in turn, the mix of cheap reads and writes
+// of a bidding client
+inline const std::vector<std::string> COMMAND_MIX{
+    "DEPOSIT FUNDS 1\n", "SHOW FUNDS\n", "DEPOSIT ITEM item\n",
+    "SHOW ITEMS\n", "WITHDRAW ITEM item\n", "SHOW SALES\n"};
+
+// Where the benchmarked server listens, everything except the port is
+// optional
+struct Listeners {
+  uint16_t port;
+  std::optional<uint16_t> binary_port;
+  std::optional<std::string> unix_path;
+  std::optional<std::string> shm_path;
+};
+
+// The whole server (ingress, tasks processor) running in background threads,
+// served the same way as by the auction_house binary
+class Server {
+public:
+  Server(const network::Backend backend, const Listeners &listeners)
+      : _database{_accounts, _auctions, _sessions} {
+    spdlog::set_level(spdlog::level::off);
+    std::vector<network::ReactorPtr> reactors;
+    reactors.push_back(network::create_reactor(backend));
+    if (!reactors.back()) {
+      std::fprintf(stderr, "The selected backend isn't supported!\n");
+      std::exit(1);
+    }
+    _session_proc = std::make_unique<engine::SessionProcessor>(
+        _database, _tasks, std::move(reactors));
+    if (listeners.shm_path.has_value()) {
+      _session_proc->add_shm_ingress(
+          network::create_reactor(network::Backend::SharedMemory),
+          listeners.shm_path.value());
+    }
+
+    std::thread{[this] {
+      for (;;) {
+        auto task = _tasks.pop(0);
+        auto event = task.get();
+        if (!event.session_id.has_value()) {
+          continue;
+        }
+        auto connection =
+            _database.sessions.get_connection_id(event.session_id.value());
+        if (connection.has_value()) {
+          _session_proc->send_data(connection.value(), std::move(event.data),
+                                   event.result);
+        }
+      }
+    }}.detach();
+    std::thread{[this, listeners] {
+      _session_proc->serve_ingress(listeners.port, listeners.binary_port,
+                                   listeners.unix_path);
+    }}.detach();
+    // gives the listeners time to start
+    std::this_thread::sleep_for(std::chrono::milliseconds{100});
+  }
+
+private:
+  engine::Accounts _accounts;
+  engine::AuctionList _auctions;
+  engine::SessionManager _sessions;
+  engine::Database _database;
+  engine::TasksExecutor _tasks;
+  std::unique_ptr<engine::SessionProcessor> _session_proc;
+};
+
+// Runs the clients in parallel, each one sends the commands round by round
+// and waits for every reply before sending the next command. The send
+// function returns once the reply has been received.
+inline Latencies
+run_clients(const unsigned clients, const unsigned rounds,
+            const std::vector<std::string> &commands,
+            const std::function<std::function<void(const std::string &)>(
+                unsigned)> &connect) {
+  std::vector<Latencies> latencies(clients);
+  std::vector<std::thread> threads;
+  for (unsigned c = 0; c < clients; ++c) {
+    threads.emplace_back([&, c] {
+      auto send = connect(c);
+      latencies[c].reserve(rounds * commands.size());
+      for (unsigned r = 0; r < rounds; ++r) {
+        for (auto &command : commands) {
+          auto start = Clock::now();
+          send(command);
+          latencies[c].push_back(Clock::now() - start);
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  Latencies all;
+  for (auto &client : latencies) {
+    all.insert(all.end(), client.begin(), client.end());
+  }
+  return all;
+}
+
+// Prints throughput and latency percentiles of a run
+inline void report(const std::string &name, Latencies latencies,
+                   const Clock::duration elapsed) {
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies](const double p) {
+    auto index = static_cast<std::size_t>(p * (latencies.size() - 1));
+    return std::chrono::duration<double, std::micro>(latencies[index]).count();
+  };
+  auto seconds = std::chrono::duration<double>(elapsed).count();
+  std::printf("%-24s %10.0f cmd/s  p50 %7.1f us  p99 %7.1f us  max %8.1f us\n",
+              name.c_str(), latencies.size() / seconds, percentile(0.5),
+              percentile(0.99), percentile(1.0));
+}
+} // namespace auction_house::benchmarks
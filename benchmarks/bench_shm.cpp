@@ -0,0 +1,117 @@
+//
+// Created by mswiercz on 29.11.2021.
+//
+// Compares the shared memory transport with the binary protocol over loopback
+// TCP: the same command mix is sent by the same number of clients to one
+// server.
+//
+#include "bench_server.h"
+#include "binary_protocol.h"
+#include "shm_transport.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace auction_house;
+using namespace auction_house::benchmarks;
+using namespace auction_house::engine;
+
+constexpr uint16_t PORT = 10102;
+constexpr uint16_t BINARY_PORT = 10103;
+constexpr auto SHM_PATH = "/tmp/auction_house_bench_shm.sock";
+constexpr unsigned ROUNDS = 5000;
+
+// The command mix of bench_server.h as binary frames
+static const std::vector<std::string> BINARY_COMMAND_MIX{
+    FrameWriter{Opcode::DepositFunds}.write_u64(1).frame(),
+    FrameWriter{Opcode::ShowFunds}.frame(),
+    FrameWriter{Opcode::DepositItem}.write_string("item").frame(),
+    FrameWriter{Opcode::ShowItems}.frame(),
+    FrameWriter{Opcode::WithdrawItem}.write_string("item").frame(),
+    FrameWriter{Opcode::ShowSales}.frame()};
+
+// Reads exactly size bytes
+static void read_exactly(const int fd, char *buffer, std::size_t size) {
+  while (size > 0) {
+    auto n = recv(fd, buffer, size, 0);
+    if (n <= 0) {
+      std::perror("recv");
+      std::exit(1);
+    }
+    buffer += n;
+    size -= n;
+  }
+}
+
+// Reads a whole binary reply
+static void read_reply(const int fd) {
+  char header[REPLY_HEADER_SIZE];
+  read_exactly(fd, header, sizeof(header));
+  auto length = FrameReader{{header, sizeof(header)}}.read_u32();
+  std::string text(length - 1, '\0');
+  read_exactly(fd, text.data(), text.size());
+}
+
+static std::function<void(const std::string &)>
+connect_tcp_client(const unsigned id) {
+  auto fd = socket(AF_INET, SOCK_STREAM, 0);
+  int opt = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(BINARY_PORT);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address))) {
+    std::perror("connect");
+    std::exit(1);
+  }
+  auto login = FrameWriter{Opcode::Login}
+                   .write_string("tcp" + std::to_string(id))
+                   .frame();
+  send(fd, login.data(), login.size(), MSG_NOSIGNAL);
+  read_reply(fd);
+  return [fd](const std::string &frame) {
+    send(fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+    read_reply(fd);
+  };
+}
+
+static std::function<void(const std::string &)>
+connect_shm_client(const unsigned id) {
+  auto client = std::make_shared<network::ShmClient>(SHM_PATH);
+  client->send(FrameWriter{Opcode::Login}
+                   .write_string("shm" + std::to_string(id))
+                   .frame());
+  client->receive();
+  return [client](const std::string &frame) {
+    client->send(frame);
+    client->receive();
+  };
+}
+
+int main(int argc, char *argv[]) {
+  // the backend of the TCP clients can be given as the only argument, epoll
+  // by default
+  auto backend = network::parse_backend(argc > 1 ? argv[1] : "epoll");
+  if (!backend.has_value()) {
+    std::fprintf(stderr, "Usage: %s [epoll|io_uring]\n", argv[0]);
+    return 1;
+  }
+  Server server{backend.value(), {PORT, BINARY_PORT, {}, SHM_PATH}};
+  for (auto clients : {1u, 4u}) {
+    for (auto shm : {false, true}) {
+      auto start = Clock::now();
+      auto latencies = run_clients(
+          clients, ROUNDS, BINARY_COMMAND_MIX,
+          shm ? connect_shm_client : connect_tcp_client);
+      auto elapsed = Clock::now() - start;
+      report((shm ? "shm x" : "tcp x") + std::to_string(clients),
+             std::move(latencies), elapsed);
+    }
+  }
+  std::fflush(stdout);
+  // the server threads serve forever
+  std::quick_exit(0);
+}
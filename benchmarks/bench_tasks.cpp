@@ -0,0 +1,122 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+// Compares the tasks with the deferred futures they have replaced: the
+// allocations and the time of creating a task and getting its reply. The
+// captures are the sizes of the ones of a command task, a ready reply and an
+// auction task. A command task created from a short line mustn't allocate,
+// it keeps the parsed request inline, the benchmark fails otherwise.
+//
+#include "auctions.h"
+#include "database.h"
+#include "task.h"
+#include "tasks.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <future>
+#include <new>
+#include <spdlog/spdlog.h>
+
+using namespace auction_house::engine;
+using BenchClock = std::chrono::steady_clock;
+
+constexpr unsigned ROUNDS = 200000;
+
+static std::size_t allocations = 0;
+
+void *operator new(std::size_t size) {
+  ++allocations;
+  if (auto memory = std::malloc(size)) {
+    return memory;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+
+// Prints the allocations and the average time of creating and getting a task
+template <typename Create>
+static void measure(const char *name, Create create) {
+  // the replies are kept so that the tasks aren't optimized away
+  volatile std::size_t sink = 0;
+  auto allocated = allocations;
+  auto start = BenchClock::now();
+  for (unsigned i = 0; i < ROUNDS; ++i) {
+    auto task = create(i);
+    sink = sink + task.get().session_id.value_or(0);
+  }
+  std::chrono::duration<double, std::nano> elapsed = BenchClock::now() - start;
+  std::printf("  %-8s %6.2f allocations, %7.1f ns per task\n", name,
+              static_cast<double>(allocations - allocated) / ROUNDS,
+              elapsed.count() / ROUNDS);
+}
+
+// Returns the allocations of creating a command task and moving it, e.g. to
+// a queue
+static std::size_t command_task_allocations(Database &database) {
+  auto allocated = allocations;
+  auto task = create_command_task(IngressEvent{{}, 1, "BID 1 100"}, database);
+  Task moved{std::move(task)};
+  return allocations - allocated;
+}
+
+int main() {
+  // a command task captures the database and the request
+  int database = 0;
+  auto command = [&database](const SessionId session_id) {
+    return [&database, session_id]() {
+      ++database;
+      return EgressEvent{session_id, {}};
+    };
+  };
+  std::printf("command\n");
+  measure("future", [&command](const SessionId session_id) {
+    return std::async(std::launch::deferred, command(session_id));
+  });
+  measure("task", [&command](const SessionId session_id) {
+    return Task{command(session_id)};
+  });
+
+  std::printf("reply\n");
+  measure("future", [](const SessionId session_id) {
+    std::promise<EgressEvent> reply;
+    reply.set_value({session_id, {}});
+    return reply.get_future();
+  });
+  measure("task", [](const SessionId session_id) {
+    return Task::ready({session_id, {}});
+  });
+
+  // the names fit the strings, only the task is allocated
+  auto auction = [](const SessionId session_id) {
+    return [auction = Auction{"owner", "buyer", 10, "item", {}}, session_id]() {
+      return EgressEvent{auction.price > 0 ? session_id : 0, {}};
+    };
+  };
+  std::printf("auction\n");
+  measure("future", [&auction](const SessionId session_id) {
+    return std::async(std::launch::deferred, auction(session_id));
+  });
+  measure("task", [&auction](const SessionId session_id) {
+    return Task{auction(session_id)};
+  });
+
+  // the parsed request, the reply is allocated when the task is run
+  Accounts accounts;
+  AuctionList auctions;
+  SessionManager sessions;
+  Database engine{accounts, auctions, sessions};
+  spdlog::set_level(spdlog::level::off);
+  std::printf("request\n");
+  measure("task", [&engine](const SessionId session_id) {
+    return create_command_task(IngressEvent{{}, session_id, "BID 1 100"},
+                               engine);
+  });
+  if (auto allocated = command_task_allocations(engine); allocated != 0) {
+    std::printf("A command task has made %zu allocations!\n", allocated);
+    return EXIT_FAILURE;
+  }
+}
@@ -0,0 +1,80 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+// Measures the throughput of the tasks executor with more and more workers.
+// Many sessions queue commands which keep a worker busy, with and without
+// an exclusive settlement among them now and then. The speedup is bound by
+// the cores of the machine.
+//
+#include "tasks_executor.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+using namespace auction_house::engine;
+using BenchClock = std::chrono::steady_clock;
+
+constexpr SessionId SESSIONS = 64;
+constexpr unsigned COMMANDS = 200000;
+constexpr auto COMMAND_COST = std::chrono::microseconds{2};
+
+// A task which keeps its worker busy like a command
+static Task make_task(const SessionId session_id) {
+  return [session_id]() {
+    auto end = BenchClock::now() + COMMAND_COST;
+    while (BenchClock::now() < end) {
+    }
+    return EgressEvent{session_id, {}};
+  };
+}
+
+// Reports the commands run per second, every settle_every command is followed
+// by an exclusive task (none if it's 0)
+static void run(const std::size_t workers, const unsigned settle_every) {
+  TasksExecutor tasks{workers};
+  std::atomic<bool> stop = false;
+  std::vector<std::thread> threads;
+  for (std::size_t worker = 0; worker < workers; ++worker) {
+    threads.emplace_back([&tasks, &stop, worker] {
+      while (!stop) {
+        tasks.pop(worker).get();
+      }
+    });
+  }
+
+  auto start = BenchClock::now();
+  for (unsigned i = 0; i < COMMANDS; ++i) {
+    auto session_id = static_cast<SessionId>(i % SESSIONS);
+    tasks.enqueue(make_task(session_id), session_id);
+    if (settle_every > 0 && i % settle_every == 0) {
+      tasks.enqueue_exclusive(make_task(0));
+    }
+  }
+  tasks.enqueue_exclusive([&stop] {
+    stop = true;
+    return EgressEvent{};
+  });
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  std::chrono::duration<double> elapsed = BenchClock::now() - start;
+  std::printf("  %2zu workers %10.0f commands/s\n", workers,
+              COMMANDS / elapsed.count());
+}
+
+int main() {
+  std::printf("%u cores, %u sessions, %lld us per command\n",
+              std::thread::hardware_concurrency(),
+              static_cast<unsigned>(SESSIONS),
+              static_cast<long long>(COMMAND_COST.count()));
+  std::printf("commands only\n");
+  for (std::size_t workers : {1, 2, 4, 8}) {
+    run(workers, 0);
+  }
+  std::printf("a settlement every 1000 commands\n");
+  for (std::size_t workers : {1, 2, 4, 8}) {
+    run(workers, 1000);
+  }
+}
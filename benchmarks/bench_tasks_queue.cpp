@@ -0,0 +1,104 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+// Measures how long light sessions wait for their commands while a heavy
+// session floods the tasks queue. The same load is queued per session (fair)
+// and with all the tasks in one sub-queue, which is how a single FIFO serves
+// them.
+//
+#include "bench_server.h"
+#include <atomic>
+#include <future>
+
+using namespace auction_house;
+using namespace auction_house::benchmarks;
+using namespace auction_house::engine;
+
+constexpr unsigned LIGHT_SESSIONS = 8;
+constexpr unsigned LIGHT_COMMANDS = 200;
+constexpr std::size_t HEAVY_BACKLOG = 2000; // tasks the heavy session keeps
+constexpr auto COMMAND_COST = std::chrono::microseconds{2};
+constexpr SessionId HEAVY_SESSION = 0;
+
+// A task which keeps the tasks processor busy like a cheap command
+static Task make_task(const SessionId session_id) {
+  return [session_id]() {
+    auto end = Clock::now() + COMMAND_COST;
+    while (Clock::now() < end) {
+    }
+    return EgressEvent{session_id, {}};
+  };
+}
+
+// Reports the latencies of the light sessions' commands
+static void run(const bool fair) {
+  TasksQueue queue;
+  std::atomic<bool> done = false;
+  std::atomic<std::size_t> heavy_queued = 0;
+  auto key = [fair](const SessionId session_id) {
+    return fair ? std::optional<SessionId>{session_id} : std::nullopt;
+  };
+
+  std::thread processor{[&queue, &heavy_queued] {
+    for (;;) {
+      auto event = queue.pop().get();
+      if (!event.session_id.has_value()) {
+        return;
+      }
+      if (event.session_id.value() == HEAVY_SESSION) {
+        --heavy_queued;
+      }
+    }
+  }};
+  std::thread heavy{[&] {
+    while (!done) {
+      if (heavy_queued < HEAVY_BACKLOG) {
+        ++heavy_queued;
+        queue.enqueue(make_task(HEAVY_SESSION), key(HEAVY_SESSION));
+      } else {
+        std::this_thread::yield();
+      }
+    }
+  }};
+
+  // the light sessions send a command and wait for its reply in turns
+  std::vector<Latencies> latencies(LIGHT_SESSIONS);
+  std::vector<std::thread> light;
+  for (SessionId s = 1; s <= LIGHT_SESSIONS; ++s) {
+    light.emplace_back([&, s] {
+      for (unsigned i = 0; i < LIGHT_COMMANDS; ++i) {
+        std::promise<void> executed;
+        auto start = Clock::now();
+        queue.enqueue(
+            [&executed, s]() {
+              executed.set_value();
+              return EgressEvent{s, {}};
+            },
+            key(s));
+        executed.get_future().wait();
+        latencies[s - 1].push_back(Clock::now() - start);
+        std::this_thread::sleep_for(std::chrono::microseconds{100});
+      }
+    });
+  }
+  auto start = Clock::now();
+  for (auto &thread : light) {
+    thread.join();
+  }
+  auto elapsed = Clock::now() - start;
+  done = true;
+  heavy.join();
+  queue.enqueue_barrier([] { return EgressEvent{}; });
+  processor.join();
+
+  Latencies all;
+  for (auto &session : latencies) {
+    all.insert(all.end(), session.begin(), session.end());
+  }
+  report(fair ? "fair" : "fifo", std::move(all), elapsed);
+}
+
+int main() {
+  run(false);
+  run(true);
+}
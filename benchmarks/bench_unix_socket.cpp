@@ -0,0 +1,96 @@
+//
+// Created by mswiercz on 28.11.2021.
+//
+// Compares loopback TCP with a Unix domain socket: the same command mix is
+// sent by the same number of clients through both listeners of one server.
+//
+#include "bench_server.h"
+#include <arpa/inet.h>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace auction_house;
+using namespace auction_house::benchmarks;
+
+constexpr uint16_t PORT = 10101;
+constexpr auto UNIX_PATH = "/tmp/auction_house_bench.sock";
+constexpr unsigned ROUNDS = 2000;
+
+// Reads until a whole reply (terminated by the prompt) has been received
+static void read_reply(const int fd) {
+  char buffer[4096];
+  std::string received;
+  while (received.find(network::RESPONSE_SUFFIX) == std::string::npos) {
+    auto n = recv(fd, buffer, sizeof(buffer), 0);
+    if (n <= 0) {
+      std::perror("recv");
+      std::exit(1);
+    }
+    received.append(buffer, n);
+  }
+}
+
+// Connects a client, logs it in and returns the function sending a command
+static std::function<void(const std::string &)>
+connect_client(const bool local, const unsigned id) {
+  int fd;
+  if (local) {
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, UNIX_PATH);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address))) {
+      std::perror("connect");
+      std::exit(1);
+    }
+  } else {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &opt, sizeof(opt));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(PORT);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address))) {
+      std::perror("connect");
+      std::exit(1);
+    }
+  }
+  read_reply(fd); // the help banner
+  auto login = "LOGIN " + std::string{local ? "local" : "tcp"} +
+               std::to_string(id) + "\n";
+  send(fd, login.data(), login.size(), MSG_NOSIGNAL);
+  read_reply(fd);
+  return [fd](const std::string &command) {
+    send(fd, command.data(), command.size(), MSG_NOSIGNAL);
+    read_reply(fd);
+  };
+}
+
+int main(int argc, char *argv[]) {
+  // the backend can be given as the only argument, epoll by default
+  auto backend = network::parse_backend(argc > 1 ? argv[1] : "epoll");
+  if (!backend.has_value()) {
+    std::fprintf(stderr, "Usage: %s [epoll|io_uring]\n", argv[0]);
+    return 1;
+  }
+  Server server{backend.value(), {PORT, {}, UNIX_PATH, {}}};
+  for (auto clients : {1u, 8u}) {
+    for (auto local : {false, true}) {
+      auto start = Clock::now();
+      auto latencies = run_clients(
+          clients, ROUNDS, COMMAND_MIX,
+          [local](unsigned id) { return connect_client(local, id); });
+      auto elapsed = Clock::now() - start;
+      report((local ? "unix x" : "tcp x") + std::to_string(clients),
+             std::move(latencies), elapsed);
+    }
+  }
+  std::fflush(stdout);
+  // the server threads serve forever
+  std::quick_exit(0);
+}
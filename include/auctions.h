@@ -3,12 +3,15 @@
 //
 #pragma once
 #include "funds_type.h"
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <list>
 #include <optional>
 #include <shared_mutex>
+#include <string>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace auction_house::engine {
@@ -22,12 +25,20 @@ struct Auction {
   FundsType price;
   std::string item;
   TimePoint expiration_time;
+  // The most the buyer is willing to pay, see bid_item_max
+  FundsType max_price = 0;
 };
 
 enum class BidResult { DoesNotExist, TooLowPrice, OwnerBid, Successful };
 
 using ExpiredAuctions = std::list<Auction>;
 
+// All the auctions together with the id of the next one
+struct AuctionsSnapshot {
+  std::unordered_map<AuctionId, Auction> auctions;
+  AuctionId next_id = 0;
+};
+
 class AuctionList {
 public:
   // Adds a new auction, returns false if an error has occurred
@@ -41,6 +52,23 @@ public:
   BidResult bid_item(AuctionId id, FundsType new_price,
                      const std::string &new_buyer);
 
+  // Bids an item up to the maximum price, the price is raised only as far as
+  // it takes to outbid the others. A winning buyer's maximum is kept, a later
+  // bid up to it gets outbid at once. The higher maximum wins, the earlier one
+  // on a tie. The results are the same as of bid_item.
+  BidResult bid_item_max(AuctionId id, FundsType max_price,
+                         const std::string &new_buyer);
+
+  // Adds the auctions under a single lock, returns the id of every auction
+  // or none if it couldn't be added
+  std::vector<std::optional<AuctionId>>
+  add_auctions(std::vector<Auction> &&auctions);
+
+  // Bids the items under a single lock, returns the result of every bid
+  std::vector<BidResult>
+  bid_items(const std::vector<std::pair<AuctionId, FundsType>> &bids,
+            const std::string &new_buyer);
+
   // Returns list of list auctions that has expired
   ExpiredAuctions collect_expired();
 
@@ -51,11 +79,34 @@ public:
   // Returns a vector of auctions as printable strings
   std::vector<std::string> get_printable_list();
 
+  // Copies all the auctions, e.g. to hand them over to another process. The
+  // expiration times are taken from the steady clock, which is shared by all
+  // the processes of a host on Linux.
+  AuctionsSnapshot snapshot();
+
+  // Replaces all the auctions with the given ones
+  void restore(AuctionsSnapshot &&snapshot);
+
+  // Makes wait_for_expired block until resume_expiry is called. Returns once
+  // the waiting thread has been paused, the auctions it has collected before
+  // have been served already. Has to be called while a thread serves the
+  // expired auctions in a loop.
+  void pause_expiry();
+  void resume_expiry();
+
 private:
+  // Both expect the lock to be taken, see add_auction and bid_item
+  std::optional<AuctionId> _add(Auction &&auction, bool &change_timeout);
+  BidResult _bid(AuctionId id, FundsType new_price,
+                 const std::string &new_buyer, const bool max_bid);
+
   std::unordered_map<AuctionId, Auction> _auctions;
   std::shared_mutex _mutex;
   std::condition_variable_any _cv_empty_list;
   std::condition_variable_any _cv_timer;
+  std::condition_variable_any _cv_pause;
+  std::atomic<bool> _pause_requested = false;
+  std::atomic<bool> _expiry_paused = false;
   AuctionId _next_id = 0;
   TimePoint _nearest_expire = TimePoint::max();
 };
@@ -0,0 +1,141 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// Binary protocol for automated clients, served on a separate port.
+//
+// Request frame:  u16 body length | u8 opcode | arguments
+// Reply frame:    u32 body length | u8 result code | reply
+//
+// Integers are little-endian, u64 unless stated otherwise. Strings are
+// prefixed with their u8 length, the ones of replies with their u16 length.
+// Replies come in the order of requests, notifications are marked with the
+// Notification result code.
+//
+// A reply is the text a telnet client would get, except for the successful
+// SHOW commands which reply with typed fields:
+//   SHOW FUNDS  funds
+//   SHOW ITEMS  u32 count | items
+//   SHOW SALES  u32 count | auction id, item, owner, price, buyer (empty if
+//               there is none), u32 time to the expiration [s] per auction
+// A batch gets a single reply to EXEC, made of the reply frames of its
+// commands (and of the text of a rollback).
+namespace auction_house::engine {
+enum class Opcode : std::uint8_t {
+  Help = 1,
+  Login,         // string username
+  Logout,        //
+  DepositFunds,  // amount
+  DepositItem,   // string item
+  WithdrawFunds, // amount
+  WithdrawItem,  // string item
+  Sell,          // string item, starting price, u32 expiration time [s]
+  Bid,           // auction id, new price
+  ShowFunds,
+  ShowItems,
+  ShowSales,
+  Multi,       // the commands up to EXEC are batched, they aren't replied to
+  MultiAtomic, // the same, the batch is all-or-nothing
+  Exec,        // one reply to the whole batch
+  Discard,
+  SellMany,    // starting price, u32 expiration time [s], items up to the end
+  BidMany,     // auction id and new price pairs up to the end
+  DepositMany, // items up to the end
+  BidMax       // auction id, maximum price
+};
+
+constexpr std::size_t REQUEST_HEADER_SIZE = 2;
+constexpr std::size_t REPLY_HEADER_SIZE = 5;
+constexpr std::size_t MAX_FRAME_LENGTH = 4096;
+
+// Splits received data into request frames
+class FrameBuffer {
+public:
+  explicit FrameBuffer(std::size_t max_frame_length = MAX_FRAME_LENGTH)
+      : _max_frame_length(max_frame_length) {}
+
+  void append(std::string_view data);
+
+  // Returns the body of the next complete frame, too long frames are skipped
+  std::optional<std::string> next_frame();
+
+  // Returns number of buffered bytes
+  std::size_t pending() const { return _data.size() - _begin; }
+
+  // The unread data together with the bytes of a too long frame left to
+  // drop, see LineBuffer
+  std::string snapshot() const;
+  void restore(std::string_view snapshot);
+
+private:
+  std::string _data;
+  std::size_t _begin = 0;
+  std::size_t _skip = 0; // bytes of a too long frame left to drop
+  std::size_t _max_frame_length;
+};
+
+// Returns the body with the header of a request frame
+std::string frame_request(std::string_view body);
+
+// Reads arguments of a request frame or fields of a reply, throws
+// std::out_of_range when the frame is too short
+class FrameReader {
+public:
+  explicit FrameReader(std::string_view frame) : _frame(frame) {}
+
+  std::uint8_t read_u8();
+  std::uint16_t read_u16();
+  std::uint32_t read_u32();
+  std::uint64_t read_u64();
+  std::string_view read_string(); // a view of the frame
+  std::string_view read_long_string(); // the same, of a reply
+
+  // Returns true when the whole frame has been read
+  bool done() const { return _offset == _frame.size(); }
+
+private:
+  std::uint64_t _read_integer(std::size_t size);
+  std::string_view _read_bytes(const std::size_t size);
+
+  std::string_view _frame;
+  std::size_t _offset = 0;
+};
+
+// Builds request frames, used by clients
+class FrameWriter {
+public:
+  explicit FrameWriter(const Opcode opcode);
+
+  FrameWriter &write_u32(const std::uint32_t value);
+  FrameWriter &write_u64(const std::uint64_t value);
+  FrameWriter &write_string(std::string_view value);
+
+  // Returns the frame with its header
+  std::string frame() const;
+
+private:
+  std::string _body;
+};
+
+// Builds typed replies
+class ReplyWriter {
+public:
+  ReplyWriter &write_u32(const std::uint32_t value);
+  ReplyWriter &write_u64(const std::uint64_t value);
+  ReplyWriter &write_string(std::string_view value);
+
+  const std::string &data() const { return _data; }
+
+private:
+  std::string _data;
+};
+
+// Returns a reply with its header, e.g. of a command of a batch
+std::string frame_reply(const std::uint8_t result, std::string_view reply);
+} // namespace auction_house::engine
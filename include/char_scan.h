@@ -0,0 +1,53 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Scanning of the text protocol for the classes of characters its grammar
+// uses. The classes are ASCII ones, the same as of the "C" locale:
+// - space: ' ', '\t', '\n', '\v', '\f', '\r',
+// - word: letters, digits and '_',
+// - digit: '0' - '9'.
+// The scans run on vector instructions if the CPU has them, the kernel is
+// chosen once at runtime.
+namespace auction_house::engine {
+enum class CharClass : std::uint8_t { Space, Word, Digit };
+
+enum class ScanKernel : std::uint8_t { Scalar, Sse42, Avx2 };
+
+// Returns the position of the first character which is in the class (or out
+// of it if in_class is false), the size of the text if there is none
+std::size_t find_class(std::string_view text, const CharClass char_class,
+                       const bool in_class);
+
+inline std::size_t skip_spaces(std::string_view text) {
+  return find_class(text, CharClass::Space, false);
+}
+
+inline std::size_t find_space(std::string_view text) {
+  return find_class(text, CharClass::Space, true);
+}
+
+// Both are true for an empty text
+inline bool all_word_chars(std::string_view text) {
+  return find_class(text, CharClass::Word, false) == text.size();
+}
+
+inline bool all_digits(std::string_view text) {
+  return find_class(text, CharClass::Digit, false) == text.size();
+}
+
+// The kernel used by the scans
+ScanKernel scan_kernel();
+
+// Returns true if the CPU can run the kernel
+bool supports_kernel(const ScanKernel kernel);
+
+// Replaces the kernel, e.g. to compare them. Returns false if the CPU can't
+// run it, the kernel stays the same then. Not thread-safe, has to be called
+// before the scans are used.
+bool set_scan_kernel(const ScanKernel kernel);
+} // namespace auction_house::engine
@@ -2,32 +2,111 @@
 // Created by mswiercz on 24.11.2021.
 //
 #pragma once
+#include "auctions.h"
 #include "events.h"
-#include "session_id.h"
-#include "tasks.h"
-#include <memory>
+#include "funds_type.h"
 #include <optional>
-#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
+#include <vector>
 
 namespace auction_house::engine {
-class Command;
-using CommandPtr = std::unique_ptr<Command>;
-
 class Database;
 
+// Typed arguments of the commands. Names are views of the parsed data, numbers
+// which don't fit their type are none and rejected when the command is
+// executed, after the login has been checked.
+namespace commands {
+struct Help {};
+struct Login {
+  std::string_view username;
+};
+struct Logout {};
+struct DepositFunds {
+  std::optional<FundsType> amount;
+};
+struct DepositItem {
+  std::string_view item;
+};
+struct WithdrawFunds {
+  std::optional<FundsType> amount;
+};
+struct WithdrawItem {
+  std::string_view item;
+};
+struct Sell {
+  std::string_view item;
+  std::optional<FundsType> price;
+  std::optional<int> expiration_time; // seconds
+};
+struct Bid {
+  std::optional<AuctionId> auction_id;
+  std::optional<FundsType> price;
+  bool max; // BID MAX, the price is the most the user will pay
+};
+struct ShowFunds {};
+struct ShowItems {};
+struct ShowSales {};
+// Bulk commands, every item or bid gets its own result
+struct SellMany {
+  std::optional<FundsType> price;
+  std::optional<int> expiration_time; // seconds
+  std::vector<std::string_view> items;
+};
+struct BidMany {
+  // none if any of the numbers doesn't fit
+  std::optional<std::vector<std::pair<AuctionId, FundsType>>> bids;
+};
+struct DepositMany {
+  std::vector<std::string_view> items;
+};
+
+// Batches, commands between MULTI and EXEC are executed as one task. An
+// atomic batch of account commands is rolled back if any of them fails.
+struct Multi {
+  bool atomic;
+};
+struct Exec {};
+struct Discard {};
+struct Wrong {}; // unknown or malformed command
+} // namespace commands
+
 class Command {
 public:
-  Command(IngressEvent &&event) : _event(std::move(event)) {}
+  using Variant =
+      std::variant<commands::Help, commands::Login, commands::Logout,
+                   commands::DepositFunds, commands::DepositItem,
+                   commands::WithdrawFunds, commands::WithdrawItem,
+                   commands::Sell, commands::Bid, commands::ShowFunds,
+                   commands::ShowItems, commands::ShowSales, commands::Multi,
+                   commands::Exec, commands::Discard, commands::SellMany,
+                   commands::BidMany, commands::DepositMany, commands::Wrong>;
+
+  Command(Variant command) : _command(command) {}
+
+  // Parses a line of the text protocol. The command keeps views of the
+  // event's data, the event mustn't be moved or destroyed before the command.
+  static Command parse(const IngressEvent &event);
+
+  // Decodes a binary request frame, the same as parse otherwise
+  static Command decode(const IngressEvent &event);
+
+  // Executes the command for the event's session and user
+  EgressEvent execute(const IngressEvent &event, Database &database) const;
 
-  // Consume the event and return a command executor
-  static CommandPtr parse(IngressEvent &&event);
+  // Points the views of the data the command has been parsed from at its
+  // copy, e.g. once the event has been moved and its short data with it
+  void rebase(const std::string_view from, const char *to);
 
-  // Executes the parsed command
-  virtual EgressEvent execute(Database &database) = 0;
+  const Variant &get() const { return _command; }
 
-  virtual ~Command() = default;
+  // Returns false for an unknown or malformed command
+  bool valid() const {
+    return !std::holds_alternative<commands::Wrong>(_command);
+  }
 
-protected:
-  IngressEvent _event;
+private:
+  Variant _command;
 };
 } // namespace auction_house::engine
@@ -0,0 +1,93 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#pragma once
+#include "network.h"
+#include "output_queue.h"
+#include <array>
+#include <atomic>
+#ifndef WIN32
+#include <sys/epoll.h>
+#include <unordered_map>
+#include <unordered_set>
+#else
+#include <winsock.h>
+#endif
+
+namespace auction_house::network {
+// Readiness based backend, uses edge-triggered epoll on Linux and falls back
+// to select() on Windows. On Linux replies are handed over to the ingress
+// thread and written from per-connection output queues, it never blocks on a
+// slow peer.
+class EpollReactor : public Reactor {
+public:
+  EpollReactor(const EgressLimit &limit, const SocketOptions &options)
+      : _limit(limit), _options(options) {}
+
+  ConnectionId init_server_socket(const uint16_t port) override;
+  ConnectionId init_unix_server_socket(const std::string &path) override;
+  void close_connection(const ConnectionId connection) override;
+  std::vector<ConnectionId>
+  handle_new_connections(const ConnectionId server_fd) override;
+  ReceivedData receive_data(const ConnectionId connection) override;
+  std::vector<ConnectionId> wait_for_traffic(
+      const std::optional<std::chrono::milliseconds> timeout) override;
+  void send_data(ConnectionId connection, Reply reply) override;
+  EgressStats egress_stats() const override;
+  void wake_up() override;
+  bool adopt_server_socket(const ConnectionId server_fd) override;
+  bool adopt_connection(const ConnectionId connection,
+                        const std::string &output) override;
+  std::optional<std::string>
+  release_connection(const ConnectionId connection) override;
+
+  ~EpollReactor() override;
+
+private:
+  EgressLimit _limit;
+  SocketOptions _options;
+  std::atomic<std::uint64_t> _paused_count{0};
+  std::atomic<std::uint64_t> _disconnected_count{0};
+
+  // Starts watching a listener for new connections, exits on failure
+  ConnectionId _add_listener(const ConnectionId server_fd);
+
+#ifndef WIN32
+  // Starts watching a connected socket, returns false on failure
+  bool _add_connection(const ConnectionId connection, const bool tcp);
+#endif
+
+#ifndef WIN32
+  struct Connection {
+    OutputQueue output;
+    bool paused = false; // reading is paused until the output drains
+  };
+
+  // Creates the epoll instance and registers the wakeup event
+  void _init_epoll();
+
+  // Moves replies handed over by other threads to the output queues and
+  // flushes the touched connections
+  void _take_outgoing();
+
+  // Writes as much of the connection's output queue as the socket accepts,
+  // the rest waits for EPOLLOUT
+  void _flush(const ConnectionId connection);
+
+  // Applies the slow client policy if the output queue is over the limit
+  void _enforce_limit(const ConnectionId connection, Connection &state);
+
+  int _epoll_fd = INVALID_CONNECTION;
+  int _wakeup_fd = INVALID_CONNECTION;
+  std::array<epoll_event, MAX_EVENTS> _events{};
+  std::unordered_map<ConnectionId, Connection> _connections;
+  std::unordered_set<ConnectionId> _local_listeners; // no TCP options
+  std::vector<ConnectionId> _resumed; // reported with the next traffic
+  Outbox _outbox;
+#else
+  fd_set _read_fds{};
+  fd_set _connected_fds{};
+  ConnectionId _max_connection_id = INVALID_CONNECTION;
+#endif
+};
+} // namespace auction_house::network
@@ -3,6 +3,8 @@
 //
 #pragma once
 #include "funds_type.h"
+#include "payload.h"
+#include "protocol.h"
 #include "session_id.h"
 #include <optional>
 
@@ -12,6 +14,8 @@ struct IngressEvent {
   std::optional<std::string> username;
   SessionId session_id;
   std::string data;
+  // Binary events carry a whole request frame in the data
+  Protocol protocol = Protocol::Text;
 };
 
 struct EgressEvent {
@@ -19,6 +23,7 @@ struct EgressEvent {
   // processing when seller is connected and logged in. Egress events with none
   // session id are dropped.
   std::optional<SessionId> session_id;
-  std::string data;
+  Payload data;
+  ResultCode result = ResultCode::Ok;
 };
 } // namespace auction_house::engine
@@ -7,5 +7,4 @@
 
 namespace auction_house::engine {
 using FundsType = std::uint64_t;
-#define parse_funds(funds) std::stoull(funds)
 }
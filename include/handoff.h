@@ -0,0 +1,53 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#pragma once
+#include "auctions.h"
+#include "session_processor.h"
+#include "user_account.h"
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// Zero-downtime restart (Linux only, epoll backend). A running server listens
+// on a Unix socket for its successor. A new server connects to it on startup,
+// the old one stops accepting and reading, lets the tasks queued so far run
+// and sends the listeners and the client connections over SCM_RIGHTS,
+// together with the sessions, the receive buffers, the unsent replies, the
+// accounts and the auctions. Once the new server has taken everything over it
+// acknowledges and the old one exits, otherwise the old one carries on.
+// Shared memory clients aren't handed over, they have to reconnect.
+namespace auction_house::engine {
+class Database;
+class TasksExecutor;
+
+// Everything handed over except for the descriptors, which are sent in the
+// order of the listeners and then of the connections
+struct HandoffState {
+  HandedIngress ingress;
+  std::unordered_map<std::string, UserAccount> accounts;
+  AuctionsSnapshot auctions;
+};
+
+// The descriptors aren't serialized, they are left invalid by deserialize,
+// which throws std::out_of_range on truncated data
+std::string serialize_state(const HandoffState &state);
+HandoffState deserialize_state(std::string_view data);
+
+// Creates the socket successors connect to, replaces a stale socket file,
+// exits on failure
+ConnectionId create_handoff_socket(const std::string &path);
+
+// Waits for successors on the handoff socket and hands everything over to the
+// first one which takes it, then exits the process. Failed attempts are
+// logged and the server keeps serving.
+[[noreturn]] void serve_successors(const ConnectionId handoff_socket,
+                                   Database &database, TasksExecutor &tasks,
+                                   SessionProcessor &session_proc);
+
+// Takes the listeners, connections and data over from a server waiting for
+// its successor on the path. Returns false if there is no such server, exits
+// if taking over has failed. Has to be called before serve_ingress.
+bool take_over(const std::string &path, Database &database,
+               SessionProcessor &session_proc);
+} // namespace auction_house::engine
@@ -0,0 +1,43 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#pragma once
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace auction_house::engine {
+// Per-connection receive buffer, splits the received stream into lines and
+// keeps a partial line until the rest of it arrives
+class LineBuffer {
+public:
+  static constexpr std::size_t MAX_LINE_LENGTH = 4096;
+
+  explicit LineBuffer(const std::size_t max_line_length = MAX_LINE_LENGTH)
+      : _max_line_length(max_line_length) {}
+
+  // Appends received data
+  void append(std::string_view data);
+
+  // Returns the next complete line without the line ending ("\n" or "\r\n"),
+  // none when there is no complete line. Lines longer than the limit are
+  // dropped.
+  std::optional<std::string> next_line();
+
+  // Returns number of buffered bytes that don't form a complete line yet
+  std::size_t pending() const { return _data.size() - _begin; }
+
+  // The unread data together with the state of the parser, a connection
+  // handed over to another process continues where it has stopped
+  std::string snapshot() const;
+  void restore(std::string_view snapshot);
+
+private:
+  std::string _data;
+  std::size_t _begin = 0;    // beginning of the first unread line
+  std::size_t _scanned = 0;  // everything before is known to have no '\n'
+  bool _discarding = false;  // set while skipping the rest of a too long line
+  std::size_t _max_line_length;
+};
+} // namespace auction_house::engine
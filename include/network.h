@@ -3,33 +3,170 @@
 //
 #pragma once
 #include "connection_id.h"
+#include "payload.h"
+#include "protocol.h"
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <optional>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace auction_house::network {
-constexpr auto MAX_CONNECTIONS = 100;
+constexpr auto MAX_EVENTS = 1024; // maximum number of events per wakeup
+// maximum number of connections accepted per wakeup, the rest is reported by
+// the next one
+constexpr auto MAX_ACCEPTS = 256;
+// maximum number of bytes read from a connection per wakeup, the rest is read
+// by the next one, so a fast sender doesn't hold the ingress thread
+constexpr std::size_t MAX_READ_BYTES = 64 * 1024;
 constexpr auto INVALID_CONNECTION = -1;
 #ifndef WIN32
 constexpr auto SOCKET_ERROR = -1;
 #endif
+// Every reply is wrapped into the telnet prompt
+constexpr std::string_view RESPONSE_PREFIX = "RESP>> ";
+constexpr std::string_view RESPONSE_SUFFIX = "\nCMD>>";
 
-// Initializes the server sockets, binds to port etc.
-ConnectionId init_server_socket(const uint16_t port);
+// Network backends that can be selected at startup, the shared memory one
+// serves only local clients next to one of the others
+enum class Backend { Epoll, IoUring, SharedMemory };
 
-// Closes a connection
-void close_connection(const ConnectionId connection);
+// What happens to a client which doesn't read its replies
+enum class SlowClientPolicy { PauseReading, Disconnect };
 
-// Handles a new connection
-ConnectionId handle_new_connection(const ConnectionId server_fd);
+// Limit of bytes waiting to be sent to a single connection, past it the policy
+// fires. Reading is resumed once half of the limit is left.
+struct EgressLimit {
+  static constexpr std::size_t DEFAULT_MAX_PENDING_BYTES = 1 << 20;
 
-// Returns user data or none when user hasn't sent anything yet, empty data
-// means data a user hung up
-std::optional<std::string> receive_data(const ConnectionId connection);
+  std::size_t max_pending_bytes = DEFAULT_MAX_PENDING_BYTES;
+  SlowClientPolicy policy = SlowClientPolicy::PauseReading;
+};
 
-// Awaits for new connections or user data to receive
-void wait_for_traffic();
+// Options of the listeners and the accepted connections
+struct SocketOptions {
+  static constexpr int DEFAULT_BACKLOG = 4096;
 
-// Sends data to user, in case of an error drops it
-void send_data(ConnectionId connectionId, std::string &&data);
+  // length of the accept queue, capped by the kernel (net.core.somaxconn)
+  int backlog = DEFAULT_BACKLOG;
+  // disables Nagle's algorithm on accepted TCP connections
+  bool no_delay = false;
+  // connections are reported once the client has sent something, or after
+  // this many seconds (Linux only)
+  std::optional<int> defer_accept;
+};
+
+// A reply together with everything needed to frame it
+struct Reply {
+  Payload data;
+  ResultCode result = ResultCode::Ok;
+  Protocol protocol = Protocol::Text;
+};
+
+// How many times the slow client policies have fired
+struct EgressStats {
+  std::uint64_t paused = 0;
+  std::uint64_t disconnected = 0;
+};
+
+struct ReceivedData {
+  std::string data;
+  // Set when a user hung up, the data received before are still valid
+  bool hung_up = false;
+};
+
+// Interface of the network backends, the ingress side (everything except
+// send_data) is used by a single thread, send_data can be called from any
+// thread
+class Reactor {
+public:
+  // Initializes a server socket, binds to port etc. Can be called for several
+  // ports, each one gets its own listener.
+  virtual ConnectionId init_server_socket(const uint16_t port) = 0;
+
+  // Initializes a listener of local (AF_UNIX) stream connections bound to
+  // the path, its connections are served like the TCP ones
+  virtual ConnectionId init_unix_server_socket(const std::string &path) = 0;
+
+  // Closes a connection
+  virtual void close_connection(const ConnectionId connection) = 0;
+
+  // Accepts pending connections of a listener, at most MAX_ACCEPTS at a time
+  virtual std::vector<ConnectionId>
+  handle_new_connections(const ConnectionId server_fd) = 0;
+
+  // Returns all the data a user has sent since the last call
+  virtual ReceivedData receive_data(const ConnectionId connection) = 0;
+
+  // Awaits for new connections or user data to receive, returns only the
+  // connections that are ready to be served. Gives up after the timeout if
+  // it's given, the returned list may be empty then.
+  virtual std::vector<ConnectionId> wait_for_traffic(
+      const std::optional<std::chrono::milliseconds> timeout = {}) = 0;
+
+  // Sends a reply to user, in case of an error drops it
+  virtual void send_data(ConnectionId connection, Reply reply) = 0;
+
+  // Returns the slow client counters, can be called from any thread
+  virtual EgressStats egress_stats() const = 0;
+
+  // Makes the ingress thread return from wait_for_traffic, can be called from
+  // any thread
+  virtual void wake_up() = 0;
+
+  // Handing connections over to another process (see handoff.h) is
+  // supported only by the epoll backend on Linux, the others refuse it.
+
+  // Starts serving a listener inherited from another process, returns false
+  // on failure
+  virtual bool adopt_server_socket(const ConnectionId /*server_fd*/) {
+    return false;
+  }
+
+  // Starts serving a connection inherited from another process, the output
+  // left by the previous owner is sent first. Returns false on failure.
+  virtual bool adopt_connection(const ConnectionId /*connection*/,
+                                const std::string & /*output*/) {
+    return false;
+  }
+
+  // Stops serving a connection without closing it, returns the replies which
+  // haven't been sent yet. Returns none if the backend can't release it.
+  virtual std::optional<std::string>
+  release_connection(const ConnectionId /*connection*/) {
+    return {};
+  }
+
+  virtual ~Reactor() = default;
+};
+
+using ReactorPtr = std::unique_ptr<Reactor>;
+
+// Creates a reactor for the given backend, returns nullptr if the backend
+// isn't supported on this platform or by the kernel
+ReactorPtr create_reactor(const Backend backend, const EgressLimit &limit = {},
+                          const SocketOptions &options = {});
+
+// Parses a backend name, returns none for unknown names
+std::optional<Backend> parse_backend(const std::string &name);
+
+// Parses a slow client policy name, returns none for unknown names
+std::optional<SlowClientPolicy>
+parse_slow_client_policy(const std::string &name);
+
+// Creates a listening TCP socket bound to the port, exits on failure
+ConnectionId create_server_socket(const uint16_t port,
+                                  const SocketOptions &options);
+
+// Creates a listening Unix domain socket bound to the path, replaces a stale
+// socket file left by a previous run, exits on failure
+ConnectionId create_unix_server_socket(const std::string &path,
+                                       const SocketOptions &options);
+
+// Applies the options to an accepted connection, returns false on failure
+bool configure_connection(const ConnectionId connection,
+                          const SocketOptions &options);
 } // namespace auction_house::network
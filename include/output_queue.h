@@ -0,0 +1,84 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#pragma once
+#include "connection_id.h"
+#include "network.h"
+#include "payload.h"
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
+
+namespace auction_house::network {
+constexpr std::size_t MAX_IOVECS = 64; // pieces gathered by a single send
+
+// Replies waiting to be written to a single connection, they are written
+// with a single gathering syscall whenever the socket is writable. Nothing is
+// copied, the queue keeps references to the payloads and to the static
+// framing.
+class OutputQueue {
+public:
+  // Queues a raw payload
+  void push(Payload data);
+
+  // Queues a reply framed according to its protocol
+  void push_response(Reply &&reply);
+
+  bool empty() const { return _pieces.empty(); }
+
+  // Returns number of bytes waiting to be sent
+  std::size_t size() const { return _size; }
+
+  // Returns the unsent part of the first piece
+  std::string_view front() const {
+    return _pieces.front().data.substr(_offset);
+  }
+
+#ifndef WIN32
+  // Points the iovecs to the waiting data, returns number of used entries
+  std::size_t gather(iovec *iovecs, const std::size_t max_iovecs) const;
+#endif
+
+  // Drops the bytes that have been sent
+  void consume(std::size_t n_bytes);
+
+private:
+  struct Piece {
+    std::string_view data;
+    Payload owner; // empty for static data
+    // data of small pieces built for a single reply, e.g. binary headers
+    std::array<char, 8> inline_data;
+  };
+
+  void _push(Piece &&piece);
+  void _push_inline(std::string_view data);
+
+  std::deque<Piece> _pieces;
+  std::size_t _offset = 0; // bytes of the front piece that have been sent
+  std::size_t _size = 0;
+};
+
+// Replies handed over to a reactor by other threads
+class Outbox {
+public:
+  using Replies = std::vector<std::pair<ConnectionId, Reply>>;
+
+  // Returns true when the outbox was empty, the reactor has to be woken up
+  // then, otherwise it already knows there is something to send
+  bool push(const ConnectionId connection, Reply &&reply);
+
+  // Takes all the replies
+  Replies take();
+
+private:
+  std::mutex _mutex;
+  Replies _replies;
+};
+} // namespace auction_house::network
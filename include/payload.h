@@ -0,0 +1,32 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace auction_house {
+// Immutable, reference counted reply text. Copies share the same buffer, so
+// one rendered reply can be queued for many connections without copying it.
+class Payload {
+public:
+  Payload() = default;
+  Payload(std::string data);
+  Payload(const char *data) : Payload(std::string{data}) {}
+
+  const std::string &str() const;
+  operator const std::string &() const { return str(); }
+  std::string_view view() const { return str(); }
+  std::size_t size() const { return str().size(); }
+  bool empty() const { return str().empty(); }
+
+  friend bool operator==(const Payload &lhs, const Payload &rhs) {
+    return lhs.view() == rhs.view();
+  }
+
+private:
+  std::shared_ptr<const std::string> _data;
+};
+} // namespace auction_house
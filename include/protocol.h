@@ -0,0 +1,29 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#pragma once
+#include <cstdint>
+
+namespace auction_house {
+// Wire protocols, the text one is meant for humans using telnet, the binary
+// one for automated clients
+enum class Protocol : std::uint8_t { Text, Binary };
+
+// Outcome of a command, binary clients get it instead of parsing the reply
+enum class ResultCode : std::uint8_t {
+  Ok = 0,
+  WrongCommand,
+  InvalidArgument,
+  NotLoggedIn,
+  AlreadyLoggedIn,
+  LoginFailed,
+  InsufficientFunds,
+  NoSuchItem,
+  NoSuchAuction,
+  TooLowPrice,
+  OwnerBid,
+  ServerError,
+  Notification, // a message which isn't a reply, e.g. result of an auction
+  RateLimited   // the command hasn't been executed, the client sends too much
+};
+} // namespace auction_house
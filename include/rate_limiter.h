@@ -0,0 +1,89 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace auction_house::engine {
+// A client may send up to burst commands at once and then rate commands per
+// second on average
+struct RateLimit {
+  double rate;
+  double burst;
+};
+
+// What happens to the commands over the limit, a reply tells the client the
+// command hasn't been executed. Binary clients which match replies to their
+// requests should be served with replies.
+enum class OverLimitPolicy : std::uint8_t { Drop, Reply };
+
+// A limit which isn't set is disabled. The user limit is shared by all the
+// sessions of a user over time, it applies to logged in sessions only.
+struct RateLimits {
+  std::optional<RateLimit> session;
+  std::optional<RateLimit> user;
+  OverLimitPolicy policy = OverLimitPolicy::Drop;
+};
+
+// Parses the limits, one setting per line, '#' starts a comment:
+//   session <rate> [<burst>]
+//   user <rate> [<burst>]
+//   policy <drop|reply>
+// The burst defaults to the rate, to one command if the rate is lower.
+// Returns none if the text is malformed.
+std::optional<RateLimits> parse_rate_limits(std::string_view text);
+
+// Token bucket, it's full at the start and refills at the rate of the limit
+class TokenBucket {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Refills the bucket and returns the number of whole tokens in it
+  std::size_t available(const RateLimit &limit,
+                        const Clock::time_point now = Clock::now());
+
+  // Takes tokens which are available
+  void take(const std::size_t tokens) { _tokens -= tokens; }
+
+private:
+  std::optional<Clock::time_point> _last_refill;
+  double _tokens = 0;
+};
+
+// Admits the commands of the sessions within their limits, the session
+// buckets are kept by the caller, the user ones by the limiter. Can be called
+// from any thread.
+class RateLimiter {
+public:
+  // Replaces the limits, the user buckets start full again
+  void set_limits(const RateLimits &limits);
+
+  // The current limits, cheap to get for every batch of commands
+  std::shared_ptr<const RateLimits> limits() const {
+    return std::atomic_load(&_limits);
+  }
+
+  // Returns how many of the commands, counted from the first one, are within
+  // the limits and takes tokens for them. The username is given if the
+  // session is logged in.
+  std::size_t admit(const RateLimits &limits, TokenBucket &session,
+                    const std::optional<std::string> &username,
+                    const std::size_t commands,
+                    const TokenBucket::Clock::time_point now =
+                        TokenBucket::Clock::now());
+
+private:
+  std::shared_ptr<const RateLimits> _limits =
+      std::make_shared<const RateLimits>();
+  std::unordered_map<std::string, TokenBucket> _users;
+  std::mutex _users_mutex;
+};
+} // namespace auction_house::engine
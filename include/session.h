@@ -4,6 +4,7 @@
 #pragma once
 #include "session_id.h"
 #include "connection_id.h"
+#include <atomic>
 #include <optional>
 #include <shared_mutex>
 #include <string>
@@ -17,6 +18,9 @@ struct Session {
 
 class SessionManager {
 public:
+  // Returns a new unique session id, can be called from any thread
+  SessionId generate_session_id();
+
   // Creates a new session when a user connects
   bool start_session(const SessionId id, const ConnectionId conn_id);
 
@@ -39,10 +43,17 @@ public:
   // Returns a connection id for the given session
   std::optional<ConnectionId> get_connection_id(const SessionId id);
 
+  // Restores a session handed over by another process, logs its user in.
+  // Session ids generated later are greater. Returns false if the session or
+  // the user exist already.
+  bool restore_session(const SessionId id, const ConnectionId conn_id,
+                       const std::optional<std::string> &username);
+
 private:
   // keeps the current sessions and if user is logged in
   std::unordered_map<SessionId, Session> _sessions;
   std::unordered_map<std::string, SessionId> _logged_users;
   std::shared_mutex _mutex;
+  std::atomic<SessionId> _next_session_id = 0;
 };
 } // namespace auction_house::engine
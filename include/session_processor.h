@@ -2,48 +2,220 @@
 // Created by mswiercz on 24.11.2021.
 //
 #pragma once
+#include "binary_protocol.h"
 #include "connection_id.h"
+#include "line_buffer.h"
+#include "network.h"
+#include "protocol.h"
+#include "rate_limiter.h"
 #include "session_id.h"
-#include <list>
+#include "tasks.h"
+#include "timing_wheel.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace auction_house::engine {
 class Database;
-class TasksQueue;
+class TasksExecutor;
+
+// Commands received between MULTI and EXEC
+struct Batch {
+  bool atomic = false;
+  std::vector<Request> requests;
+  std::string input; // the commands as received, to hand them over
+};
+
+// Longer batches are discarded, they would hold the tasks processor too long
+constexpr std::size_t MAX_BATCH_COMMANDS = 1024;
 
 struct Connection {
+  SessionId session_id;
+  Protocol protocol = Protocol::Text;
+  LineBuffer input;     // text protocol
+  FrameBuffer frames;   // binary protocol
+  TokenBucket commands; // rate limit of the session
+  std::optional<Batch> batch;
+  // a batch with a rejected command is rejected up to its EXEC or DISCARD
+  bool rejected_batch = false;
+};
+
+// Connections which stay silent or don't log in for too long are closed, a
+// timeout which isn't set is disabled
+struct SessionTimeouts {
+  std::optional<std::chrono::seconds> idle;
+  std::optional<std::chrono::seconds> login;
+};
+
+// Listeners of the text protocol (TCP and Unix socket) and of the binary
+// one, the shared memory handshake listener is a binary one
+enum class ListenerKind : std::uint8_t { Text, Binary, Local };
+
+// A listener handed over to another process
+struct HandedListener {
+  ConnectionId server_fd;
+  ListenerKind kind;
+};
+
+// A connection handed over to another process together with its session
+struct HandedConnection {
   ConnectionId connection;
   SessionId session_id;
+  Protocol protocol;
+  std::optional<std::string> username;
+  std::string input;  // snapshot of the receive buffer
+  std::string output; // replies which haven't been sent yet
+  std::string batch;  // commands of an open batch, as received
+};
+
+struct HandedIngress {
+  std::vector<HandedListener> listeners;
+  std::vector<HandedConnection> connections;
+};
+
+// State of a single ingress reactor, each one is served by its own thread
+struct Ingress {
+  network::ReactorPtr reactor;
+  std::unordered_map<ConnectionId, ListenerKind> listeners;
+  // Maps active connections to their sessions and receive buffers
+  std::unordered_map<ConnectionId, Connection> connections;
+  TimingWheel idle_timers;  // restarted whenever a connection sends data
+  TimingWheel login_timers; // started once a connection is accepted
 };
 
 class SessionProcessor {
 public:
-  SessionProcessor(Database &database, TasksQueue &queue)
-      : _database(database), _queue(queue) {}
+  // Each reactor gets its own listener socket and set of connections
+  SessionProcessor(Database &database, TasksExecutor &tasks,
+                   std::vector<network::ReactorPtr> &&reactors,
+                   const SessionTimeouts &timeouts = {});
 
   // Receives data from already connected users, waits for new connections
   // and starts new sessions for them, closes connections and remove unused
-  // sessions when a user hangs up
-  void serve_ingress(const uint16_t port);
+  // sessions when a user hangs up. Every reactor is served by a separate
+  // thread, the first one by the calling thread. Binary clients are served
+  // on a separate port if it's given. Local clients are served on a Unix
+  // socket if its path is given, by the first reactor only as the path can't
+  // be shared.
+  void serve_ingress(const uint16_t port,
+                     const std::optional<uint16_t> binary_port = {},
+                     const std::optional<std::string> &unix_path = {});
+
+  // Serves local clients through the shared memory reactor on a separate
+  // thread, the handshake socket is bound to the path. Has to be called
+  // before serve_ingress.
+  void add_shm_ingress(network::ReactorPtr &&reactor, const std::string &path);
+
+  // Sends data through the reactor that owns the connection, framed for the
+  // connection's protocol, can be called from any thread
+  void send_data(const ConnectionId connection_id, Payload data,
+                 const ResultCode result);
+
+  // Replaces the limits of the commands sessions and users can send, they
+  // are checked before a task is created. Can be called from any thread.
+  void set_rate_limits(const RateLimits &limits);
+
+  // Enqueues the commands received from a connection which are within the
+  // rate limits, handles the rest according to the policy. The commands
+  // rejected in a row get a single reply, a batch is admitted or rejected as
+  // a whole.
+  void enqueue_commands(Connection &connection,
+                        std::vector<std::string> &commands);
+
+  // Handing the ingress over to another process (see handoff.h)
+
+  // Makes every ingress thread stop accepting and reading, blocks until all
+  // of them are paused. Replies are kept by the reactors meanwhile.
+  void pause_ingress();
+
+  // Releases the connections of the paused ingress threads from their
+  // reactors, returns them with the listeners. The shared memory ones aren't
+  // handed over. Returns none if a reactor can't release its connections,
+  // nothing is released then.
+  std::optional<HandedIngress> release_ingress();
+
+  // Serves the released connections again and resumes the ingress threads
+  void resume_ingress(const std::vector<HandedConnection> &released);
+
+  // Serves the listeners and connections handed over by another process,
+  // restores their sessions. Listeners of each kind are spread between the
+  // reactors, serve_ingress creates only the missing ones. Has to be called
+  // before serve_ingress.
+  void adopt_ingress(HandedIngress &&handed);
 
 private:
+  // Runs the event loop of a single reactor
+  void _serve_reactor(Ingress &ingress);
+
   // Creates a new session for a new connection
-  bool _create_new_session(const ConnectionId connection_id);
+  bool _create_new_session(Ingress &ingress, const ConnectionId connection_id,
+                           const Protocol protocol);
 
   // Ends a session and associated connection
-  void _end_connection(const ConnectionId connection_id,
+  void _end_connection(Ingress &ingress, const ConnectionId connection_id,
                        const SessionId session_id);
 
-  // Prepares a task for received data and puts it on a queue
-  void _serve_user_data(std::string &&data, const SessionId session_id);
+  // Ends the sessions whose idle or login timers have expired
+  void _reap_expired(Ingress &ingress);
+
+  // Prepares a task for every complete line or frame received so far which
+  // is within the rate limits and puts them on a queue
+  void _serve_user_data(Connection &connection);
+
+  // Follows the batches through a command over the rate limit, the batch it
+  // belongs to is discarded
+  void _reject_command(Connection &connection, const Request &request);
 
-  // Goes through the active connections, reads the data and prepares tasks,
-  // closes inactive connections
-  void _scan_connections();
+  // Keeps the commands of a batch until EXEC, returns false if the command
+  // isn't a part of a batch
+  bool _batch_command(Connection &connection, Request &request);
 
-  std::list<Connection> _connections;
+  // Receives the commands of a batch handed over by another process again
+  void _restore_batch(Connection &connection, const std::string &input);
+
+  // Reads the data from a ready connection and prepares tasks, closes the
+  // connection when a user has hung up
+  void _serve_connection(Ingress &ingress, const ConnectionId connection_id);
+
+  // Starts the timers of a new session
+  void _start_timers(Ingress &ingress, const ConnectionId connection_id,
+                     const bool logged_in);
+
+  // Blocks an ingress thread while the ingress is paused
+  void _park();
+
+  // Gives the released connections back to their reactors
+  void _serve_again(const std::vector<HandedConnection> &released);
+
+  // Returns the ingress whose reactor serves the connection
+  Ingress *_find_ingress(const network::Reactor *reactor);
+
+  std::vector<Ingress> _ingresses;
+  std::unique_ptr<Ingress> _shm_ingress;
+  struct Owner {
+    network::Reactor *reactor;
+    Protocol protocol;
+  };
+
+  // Maps connections to the reactors that serve them, used by the egress
+  std::unordered_map<ConnectionId, Owner> _owners;
+  std::shared_mutex _owners_mutex;
   Database &_database;
-  TasksQueue &_queue;
-  SessionId _next_session_id = 0;
+  TasksExecutor &_tasks;
+  SessionTimeouts _timeouts;
+  RateLimiter _rate_limiter;
+
+  std::atomic<bool> _pause_requested = false;
+  unsigned _parked = 0; // ingress threads waiting for the resume
+  std::mutex _pause_mutex;
+  std::condition_variable _pause_cv;
 };
 } // namespace auction_house::engine
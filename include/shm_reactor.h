@@ -0,0 +1,93 @@
+//
+// Created by mswiercz on 29.11.2021.
+//
+#pragma once
+#include "network.h"
+#include "output_queue.h"
+#include "shm_transport.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <sys/epoll.h>
+#include <unordered_map>
+
+namespace auction_house::network {
+// Serves clients connected through shared memory rings (Linux only), the
+// listener is a Unix socket used only for the handshake. The rings of all
+// connections are checked on every call and the reactor spins for a while
+// before it falls asleep on the notification descriptors, a busy client is
+// served without any system call. Meant for a few local clients with heavy
+// traffic, e.g. a co-located bidding process.
+class ShmReactor : public Reactor {
+public:
+  static constexpr std::uint32_t RING_CAPACITY = 1 << 20;
+  // while busy, the listener and hang-ups are checked this often
+  static constexpr std::chrono::milliseconds POLL_INTERVAL{1};
+
+  explicit ShmReactor(const EgressLimit &limit)
+      : _limit(limit), _spin_count(spin_count()) {}
+
+  // Shared memory clients don't connect through TCP, exits
+  ConnectionId init_server_socket(const uint16_t port) override;
+  ConnectionId init_unix_server_socket(const std::string &path) override;
+  void close_connection(const ConnectionId connection) override;
+  std::vector<ConnectionId>
+  handle_new_connections(const ConnectionId server_fd) override;
+  ReceivedData receive_data(const ConnectionId connection) override;
+  std::vector<ConnectionId> wait_for_traffic(
+      const std::optional<std::chrono::milliseconds> timeout) override;
+  void send_data(ConnectionId connection, Reply reply) override;
+  EgressStats egress_stats() const override;
+  void wake_up() override;
+
+  ~ShmReactor() override;
+
+private:
+  struct Connection {
+    ShmChannelPtr channel;
+    OutputQueue output;
+    bool paused = false; // reading is paused until the output drains
+    bool hung_up = false;
+  };
+
+  // Moves replies handed over by other threads to the output queues and
+  // flushes the touched connections
+  void _take_outgoing();
+
+  // Copies as much of the output queue as fits into the reply ring
+  void _flush(Connection &state);
+
+  // Hangs up a connection whose client has corrupted the rings
+  void _check_channel(const ConnectionId connection, Connection &state);
+
+  // Applies the slow client policy if the output queue is over the limit
+  void _enforce_limit(const ConnectionId connection, Connection &state);
+
+  // Adds the connections with requests to read or which have hung up
+  void _collect_ready(std::vector<ConnectionId> &ready);
+
+  // Waits for the descriptors, handles hang-ups and notifications, returns
+  // false on failure
+  bool _poll(std::vector<ConnectionId> &ready, const int timeout_ms);
+
+  // Announces sleeping to the clients and the egress, returns false if
+  // something has arrived meanwhile
+  bool _prepare_sleep();
+  void _finish_sleep();
+
+  EgressLimit _limit;
+  unsigned _spin_count; // checks of the rings before falling asleep
+  std::atomic<std::uint64_t> _paused_count{0};
+  std::atomic<std::uint64_t> _disconnected_count{0};
+
+  int _epoll_fd = INVALID_CONNECTION;
+  int _wakeup_fd = INVALID_CONNECTION;
+  std::array<epoll_event, MAX_EVENTS> _events{};
+  std::chrono::steady_clock::time_point _next_poll{};
+  std::unordered_map<ConnectionId, Connection> _connections;
+  Outbox _outbox;
+  // the egress only wakes the reactor up while it's sleeping
+  std::atomic<bool> _pending_replies{false};
+  std::atomic<bool> _sleeping{false};
+};
+} // namespace auction_house::network
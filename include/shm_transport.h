@@ -0,0 +1,119 @@
+//
+// Created by mswiercz on 29.11.2021.
+//
+#pragma once
+#include "protocol.h"
+#include "spsc_ring.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace auction_house::network {
+// Shared memory transport of clients running on the same host (Linux only).
+// A client connects to a Unix socket and the server answers with a memfd
+// holding a pair of rings, and two eventfds used for notifications, one per
+// side. Both rings carry binary protocol frames. The socket is kept open, a
+// side which closes it hangs up. The memfd is sealed, the client can't resize
+// it under the server.
+constexpr std::uint32_t SHM_MAGIC = 0x314d4841; // "AHM1"
+
+// Beginning of the shared segment, followed by the data of the request ring
+// and then of the reply ring
+struct ShmLayout {
+  std::uint32_t magic;
+  std::uint32_t capacity; // of every ring
+  RingHeader requests;    // client -> server
+  RingHeader replies;     // server -> client
+};
+
+// A mapped shared segment together with the notification descriptors
+class ShmChannel {
+public:
+  // Creates a segment with rings of the given capacity (a power of two),
+  // returns nullptr on failure
+  static std::unique_ptr<ShmChannel> create(const std::uint32_t capacity);
+
+  // Maps a segment received from the server, returns nullptr if it isn't a
+  // valid one, takes the ownership of the descriptors in any case
+  static std::unique_ptr<ShmChannel>
+  map(const int memfd, const int server_event, const int client_event);
+
+  ShmChannel(const ShmChannel &) = delete;
+  ShmChannel &operator=(const ShmChannel &) = delete;
+  ~ShmChannel();
+
+  SpscRing &requests() { return _requests; }
+  SpscRing &replies() { return _replies; }
+
+  // True once the other side has corrupted a ring
+  bool corrupted() const {
+    return _requests.corrupted() || _replies.corrupted();
+  }
+
+  int memfd() const { return _memfd; }
+  int server_event() const { return _server_event; }
+  int client_event() const { return _client_event; }
+
+  // Wakes the other side up
+  void notify_server() const;
+  void notify_client() const;
+
+  // Drains pending notifications of an event descriptor
+  static void drain(const int event);
+
+private:
+  ShmChannel(const int memfd, const int server_event, const int client_event,
+             void *memory, const std::size_t size,
+             const std::uint32_t capacity);
+
+  int _memfd;
+  int _server_event;
+  int _client_event;
+  void *_memory;
+  std::size_t _size;
+  SpscRing _requests;
+  SpscRing _replies;
+};
+
+using ShmChannelPtr = std::unique_ptr<ShmChannel>;
+
+// Number of checks of a ring before a side falls asleep. Spinning only pays
+// off if the other side runs on another core, it's 0 on a single core host.
+unsigned spin_count();
+
+// Sends the channel's descriptors to a client over a Unix socket, returns
+// false on failure
+bool send_channel(const int socket, const ShmChannel &channel);
+
+// Client of the shared memory transport, blocking and meant for a single
+// thread. Waiting spins for a while before it falls asleep, a busy client
+// doesn't make any system calls.
+class ShmClient {
+public:
+  // Connects to the handshake socket, throws std::system_error on failure
+  explicit ShmClient(const std::string &path);
+
+  ShmClient(const ShmClient &) = delete;
+  ShmClient &operator=(const ShmClient &) = delete;
+  ~ShmClient();
+
+  // Sends a request frame (see binary_protocol.h), waits while the ring is
+  // full
+  void send(std::string_view frame);
+
+  // Waits for the next reply, returns its result code and text. Throws
+  // std::system_error if the server has hung up.
+  std::pair<ResultCode, std::string> receive();
+
+private:
+  // Blocks until the server signals or hangs up
+  void _wait();
+
+  int _socket;
+  ShmChannelPtr _channel;
+  std::string _received; // a partially received reply
+};
+} // namespace auction_house::network
@@ -0,0 +1,80 @@
+//
+// Created by mswiercz on 29.11.2021.
+//
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace auction_house::network {
+// Control block of a ring, lives in memory shared by the producer and the
+// consumer, possibly in different processes. The positions only grow, they
+// are wrapped when indexing the data.
+struct RingHeader {
+  alignas(64) std::atomic<std::uint64_t> head{0}; // next byte to read
+  alignas(64) std::atomic<std::uint64_t> tail{0}; // next byte to write
+  // Set by a side which is about to block, the other side has to signal it
+  alignas(64) std::atomic<std::uint32_t> consumer_waiting{0};
+  std::atomic<std::uint32_t> producer_waiting{0};
+};
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free,
+              "the ring is shared between processes");
+
+// Single producer, single consumer byte stream on top of a shared buffer,
+// neither side makes any system call. A side which runs out of data (or
+// space) announces it in the header before blocking on its own notification,
+// so the other side only has to signal while it's really waiting.
+//
+// The other side may be another process which can't be trusted: a side keeps
+// its own position to itself and only loads the other one from the header.
+// A position which would make the ring hold more than its capacity (or less
+// than nothing) marks it as corrupted, nothing is read or written anymore.
+class SpscRing {
+public:
+  // The capacity has to be a power of two, the positions are taken from the
+  // header
+  SpscRing(RingHeader &header, char *data, const std::size_t capacity);
+
+  // Producer side, copies as much of the data as fits, returns the number of
+  // bytes written
+  std::size_t write(std::string_view data);
+
+  // Consumer side, moves up to size bytes to the buffer, returns the number
+  // of bytes read
+  std::size_t read(char *buffer, const std::size_t size);
+
+  // Consumer side
+  std::size_t readable() const;
+  // Producer side
+  std::size_t writable() const;
+  std::size_t capacity() const { return _capacity; }
+
+  // True once the other side has written a position out of range
+  bool corrupted() const { return _corrupted; }
+
+  // Consumer side, announces that it's about to block, returns false (and
+  // withdraws the announcement) if there is something to read already
+  bool prepare_consumer_wait();
+  void finish_consumer_wait();
+  // Producer side, returns true if the consumer has to be signaled after a
+  // write
+  bool consumer_waiting() const;
+
+  // Producer side, the same for a full ring
+  bool prepare_producer_wait();
+  void finish_producer_wait();
+  // Consumer side, returns true if the producer has to be signaled after a
+  // read
+  bool producer_waiting() const;
+
+private:
+  RingHeader &_header;
+  char *_data;
+  std::size_t _capacity;
+  std::uint64_t _head; // owned by the consumer
+  std::uint64_t _tail; // owned by the producer
+  // set by the side which has detected it
+  mutable bool _corrupted = false;
+};
+} // namespace auction_house::network
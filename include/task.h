@@ -0,0 +1,109 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#pragma once
+#include "events.h"
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace auction_house::engine {
+// A deferred computation of a reply, run once by the thread which gets it.
+// Unlike a deferred std::future it has no shared state: a small function is
+// kept inside the task, only a bigger one is allocated. Exceptions thrown by
+// the function are thrown by get. Move-only and not thread-safe.
+class Task {
+public:
+  // Functions up to this size are kept inside the task, a command task with
+  // its request too (see tasks.h)
+  static constexpr std::size_t INLINE_SIZE = 152;
+
+  Task() = default;
+
+  template <typename Function,
+            typename = std::enable_if_t<
+                !std::is_same_v<std::decay_t<Function>, Task> &&
+                std::is_invocable_r_v<EgressEvent, std::decay_t<Function> &>>>
+  Task(Function &&function) {
+    using Stored = std::decay_t<Function>;
+    if constexpr (fits_inline<Stored>()) {
+      new (_storage) Stored(std::forward<Function>(function));
+      _operations = &INLINE_OPERATIONS<Stored>;
+    } else {
+      new (_storage) Stored *(new Stored(std::forward<Function>(function)));
+      _operations = &HEAP_OPERATIONS<Stored>;
+    }
+  }
+
+  // A task which only passes the reply on
+  static Task ready(EgressEvent &&event);
+
+  Task(Task &&other) noexcept;
+  Task &operator=(Task &&other) noexcept;
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  ~Task();
+
+  // Runs the function and returns its reply, the task is empty afterwards
+  EgressEvent get();
+
+  // Returns false for an empty task
+  bool valid() const { return _operations != nullptr; }
+
+  // Returns true if the reply is known already, see ready
+  bool is_ready() const { return _ready; }
+
+private:
+  struct Operations {
+    EgressEvent (*run)(void *storage);
+    // move-constructs the function in the other storage and destroys it
+    void (*move)(void *from, void *to) noexcept;
+    void (*destroy)(void *storage) noexcept;
+  };
+
+  template <typename Function> static constexpr bool fits_inline() {
+    return sizeof(Function) <= INLINE_SIZE &&
+           alignof(Function) <= alignof(std::max_align_t) &&
+           std::is_nothrow_move_constructible_v<Function>;
+  }
+
+  template <typename Function> static Function &inline_function(void *storage) {
+    return *std::launder(reinterpret_cast<Function *>(storage));
+  }
+
+  template <typename Function> static Function *&heap_function(void *storage) {
+    return *std::launder(reinterpret_cast<Function **>(storage));
+  }
+
+  template <typename Function>
+  static constexpr Operations INLINE_OPERATIONS{
+      [](void *storage) -> EgressEvent {
+        return inline_function<Function>(storage)();
+      },
+      [](void *from, void *to) noexcept {
+        auto &function = inline_function<Function>(from);
+        new (to) Function(std::move(function));
+        function.~Function();
+      },
+      [](void *storage) noexcept {
+        inline_function<Function>(storage).~Function();
+      }};
+
+  template <typename Function>
+  static constexpr Operations HEAP_OPERATIONS{
+      [](void *storage) -> EgressEvent {
+        return (*heap_function<Function>(storage))();
+      },
+      [](void *from, void *to) noexcept {
+        new (to) Function *(heap_function<Function>(from));
+      },
+      [](void *storage) noexcept { delete heap_function<Function>(storage); }};
+
+  void _reset();
+
+  alignas(std::max_align_t) std::byte _storage[INLINE_SIZE];
+  const Operations *_operations = nullptr;
+  bool _ready = false;
+};
+} // namespace auction_house::engine
@@ -2,18 +2,52 @@
 // Created by mswiercz on 24.11.2021.
 //
 #pragma once
+#include "command.h"
 #include "events.h"
-#include <future>
+#include "task.h"
+#include <string_view>
+#include <vector>
 
 namespace auction_house::engine {
 class Database;
 class Auction;
+class TasksExecutor;
 
-using Task = std::future<EgressEvent>;
+// A command parsed together with its event. The command keeps views of the
+// event's data, they are pointed at the new data when the request is moved,
+// so a task keeps the request without allocating it.
+struct Request {
+  explicit Request(IngressEvent &&event);
+  Request(Request &&other) noexcept;
+  Request(const Request &) = delete;
+  Request &operator=(const Request &) = delete;
 
-// Consumes a user event and returns a task that process it
+  IngressEvent event;
+  Command command;
+
+private:
+  Request(Request &&other, const std::string_view data) noexcept;
+};
+
+// Consumes a user event and returns a task that process it. The command is
+// parsed by the caller, a malformed one gets a ready reply task.
 Task create_command_task(IngressEvent &&event, Database &database);
+Task create_command_task(Request &&request, Database &database);
+
+// Consumes the commands of a batch and returns a task that executes them in
+// order and replies once with the replies of all of them. An atomic batch may
+// hold account commands only, it stops at the first command which fails and
+// the user's account is restored.
+Task create_batch_task(std::vector<Request> &&requests,
+                       const SessionId session_id, const bool atomic,
+                       Database &database);
+
+// Consumes the expired auctions and returns a task that settles all of them,
+// the notifications are queued to the sellers' sessions
+Task create_settlement_task(ExpiredAuctions &&auctions,
+                            Database &database, TasksExecutor &tasks);
 
-// Consumes an expired auction and returns a task that process it
-Task create_auction_task(Auction &&auction, Database &database);
+// Returns a task that only passes a ready reply on, e.g. for a command which
+// has been rejected before it could be parsed
+Task create_reply_task(EgressEvent &&event);
 } // namespace auction_house::engine
\ No newline at end of file
@@ -0,0 +1,48 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#pragma once
+#include "session_id.h"
+#include "task.h"
+#include "tasks_queue.h"
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace auction_house::engine {
+// Routes the tasks to a pool of workers, each one serves a tasks queue of its
+// own. The tasks of a session always go to the same worker, so they run in
+// the order they have been queued, while the tasks of other sessions run in
+// parallel. A user is logged in to a single session, so the commands touching
+// its account run in order too.
+//
+// The tasks which touch several users, i.e. the settlements of the expired
+// auctions, are exclusive: such a task runs once every task queued before it
+// has run, and the tasks queued after it wait until it's done. It's run by
+// the last worker to reach it, the others wait for it. The workers are
+// stopped for every exclusive task, so the auctions expired at once are
+// settled by a single one. They aren't routed by the sessions of the users:
+// a user who logs in to another session moves to another worker meanwhile.
+class TasksExecutor {
+public:
+  explicit TasksExecutor(const std::size_t workers = 1);
+
+  // Queues a task to the worker of the session, the tasks without a session
+  // go to the first worker
+  void enqueue(Task &&task, const std::optional<SessionId> session = {});
+
+  // Queues a task which runs while all the workers wait, e.g. to pause them
+  void enqueue_exclusive(Task &&task);
+
+  // Blocks until there is a task for the worker
+  Task pop(const std::size_t worker);
+
+  std::size_t workers() const { return _queues.size(); }
+
+private:
+  std::vector<TasksQueue> _queues;
+  // keeps the exclusive tasks in the same order in all the queues
+  std::mutex _exclusive_mutex;
+};
+} // namespace auction_house::engine
@@ -3,20 +3,54 @@
 //
 #pragma once
 #include "events.h"
+#include "session_id.h"
 #include "tasks.h"
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
 #include <deque>
-#include <future>
 #include <mutex>
+#include <optional>
+#include <unordered_map>
 
 namespace auction_house::engine {
+// Tasks of every session wait in a queue of their own and the sessions are
+// served round-robin, one task per turn, so a session which sends a burst of
+// commands delays every other session by one task at most. Tasks of a session
+// are popped in the order they have been queued.
 class TasksQueue {
 public:
-  void enqueue(Task &&task);
+  // Queues a task of a session, the tasks without a session (e.g. auction
+  // notifications) are served as one more session
+  void enqueue(Task &&task, const std::optional<SessionId> session = {});
+
+  // Queues a task which is popped once every task queued before it has been
+  // popped, ahead of the tasks queued after it
+  void enqueue_barrier(Task &&task);
+
+  // Blocks until there is a task
   Task pop();
 
 private:
-  std::deque<Task> _queue;
+  using Key = std::optional<SessionId>;
+
+  struct Entry {
+    Task task;
+    std::uint64_t sequence; // order of all the queued tasks
+  };
+
+  struct Barrier {
+    Task task;
+    std::uint64_t sequence;
+    std::size_t remaining; // tasks queued before which haven't been popped
+  };
+
+  std::unordered_map<Key, std::deque<Entry>> _sessions;
+  std::deque<Key> _turns; // sessions with tasks, the front one is served next
+  std::deque<Barrier> _barriers;
+  std::size_t _size = 0; // tasks in the sessions' queues
+  std::uint64_t _sequence = 0;
   std::mutex _mutex;
   std::condition_variable _cv;
 };
-} // namespace auction_house::engine
\ No newline at end of file
+} // namespace auction_house::engine
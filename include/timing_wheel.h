@@ -0,0 +1,65 @@
+//
+// Created by mswiercz on 28.11.2021.
+//
+#pragma once
+#include "connection_id.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+namespace auction_house::engine {
+// Hashed timing wheel of per-connection timers. Time is divided into ticks,
+// a timer is kept in the slot of its deadline tick modulo the number of
+// slots, so starting, restarting and cancelling a timer is O(1) and advancing
+// the wheel only visits the slots the time has passed through.
+class TimingWheel {
+public:
+  using Clock = std::chrono::steady_clock;
+  static constexpr Clock::duration DEFAULT_TICK = std::chrono::seconds{1};
+  static constexpr std::size_t DEFAULT_SLOTS = 512;
+
+  explicit TimingWheel(const Clock::duration tick = DEFAULT_TICK,
+                       const std::size_t slots = DEFAULT_SLOTS,
+                       const Clock::time_point start = Clock::now());
+
+  // Starts the timer of a connection, restarts it if it's already running.
+  // The timer expires no earlier than the timeout from now.
+  void schedule(const ConnectionId connection, const Clock::duration timeout,
+                const Clock::time_point now = Clock::now());
+
+  // Stops the timer of a connection, does nothing if it isn't running
+  void cancel(const ConnectionId connection);
+
+  // Moves the wheel forward and returns the connections whose timers have
+  // expired, their timers are stopped
+  std::vector<ConnectionId> advance(const Clock::time_point now = Clock::now());
+
+  // Returns the number of running timers
+  std::size_t size() const { return _timers.size(); }
+
+  bool empty() const { return _timers.empty(); }
+
+  Clock::duration tick() const { return _tick; }
+
+private:
+  using Slot = std::list<ConnectionId>;
+
+  struct Timer {
+    std::uint64_t deadline; // in ticks since the start
+    std::size_t slot;
+    Slot::iterator position;
+  };
+
+  // Returns the number of whole ticks elapsed since the start
+  std::uint64_t _ticks(const Clock::time_point now) const;
+
+  Clock::duration _tick;
+  Clock::time_point _start;
+  std::uint64_t _current = 0; // the last tick that has been processed
+  std::vector<Slot> _slots;
+  std::unordered_map<ConnectionId, Timer> _timers;
+};
+} // namespace auction_house::engine
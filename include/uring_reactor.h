@@ -0,0 +1,153 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#pragma once
+#include "network.h"
+#include "output_queue.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <linux/io_uring.h>
+#include <memory>
+#include <sys/socket.h>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace auction_house::network {
+// Completion based backend (Linux only), the listener uses multishot accept,
+// connections use multishot recv with provided buffers. Replies are handed
+// over to the ingress thread, queued per connection and submitted in batches,
+// one gathering send per connection at a time.
+class UringReactor : public Reactor {
+public:
+  static constexpr unsigned RING_ENTRIES = 4096;
+  static constexpr unsigned BUFFERS_COUNT = 1024;
+  static constexpr unsigned BUFFER_SIZE = 4096;
+
+  UringReactor(const EgressLimit &limit, const SocketOptions &options)
+      : _limit(limit), _options(options) {}
+
+  // Checks once whether the kernel has all the operations and flags the
+  // reactor needs: multishot accept and recv, skipped completions (6.0)
+  static bool supported();
+
+  ConnectionId init_server_socket(const uint16_t port) override;
+  ConnectionId init_unix_server_socket(const std::string &path) override;
+  void close_connection(const ConnectionId connection) override;
+  std::vector<ConnectionId>
+  handle_new_connections(const ConnectionId server_fd) override;
+  ReceivedData receive_data(const ConnectionId connection) override;
+  std::vector<ConnectionId> wait_for_traffic(
+      const std::optional<std::chrono::milliseconds> timeout) override;
+  void send_data(ConnectionId connection, Reply reply) override;
+  EgressStats egress_stats() const override;
+  void wake_up() override;
+
+  ~UringReactor() override;
+
+private:
+  enum class Operation : std::uint8_t {
+    Accept = 1,
+    Recv,
+    Send,
+    Wakeup,
+    ProvideBuffers,
+    Cancel
+  };
+
+  struct Connection {
+    // completions of closed connections whose descriptors have been reused
+    // are recognized by the generation
+    std::uint32_t generation;
+    ReceivedData received;
+    OutputQueue output;
+    bool receiving = false;
+    bool cancelling = false; // the recv is being cancelled
+    bool sending = false;
+    bool paused = false; // reading is paused until the output drains
+    bool disconnected = false;
+    // has to live as long as the send is in flight
+    msghdr message{};
+    std::array<iovec, MAX_IOVECS> iovecs{};
+  };
+  using ConnectionPtr = std::unique_ptr<Connection>;
+
+  // Maps the rings and registers the provided buffers
+  void _setup_ring();
+
+  // Returns a free submission entry, submits the queued ones if the ring is
+  // full
+  io_uring_sqe *_get_sqe();
+
+  // Submits queued entries and waits for at least min_complete completions,
+  // gives up after the timeout if it's given
+  void _submit(unsigned min_complete,
+               const std::optional<std::chrono::milliseconds> timeout = {});
+
+  // Sets the ring up on the first call and starts accepting connections
+  ConnectionId _add_listener(const ConnectionId server_fd);
+
+  void _arm_accept(const ConnectionId server_fd);
+  void _arm_recv(const ConnectionId connection);
+  void _arm_wakeup();
+  void _arm_send(const ConnectionId connection, Connection &state);
+
+  // Hands a range of buffers over to the kernel, the recv picks them
+  void _provide_buffers(const std::uint16_t first_id,
+                        const std::uint16_t count);
+
+  // Moves replies handed over by other threads to the output queues and
+  // starts sending them
+  void _take_outgoing();
+
+  // Applies the slow client policy if the output queue is over the limit
+  void _enforce_limit(const ConnectionId connection, Connection &state);
+
+  // Handles a single completion, adds the connection to the ready list when
+  // there is something to serve
+  void _handle_completion(const io_uring_cqe &cqe,
+                          std::vector<ConnectionId> &ready);
+
+  EgressLimit _limit;
+  SocketOptions _options;
+  std::atomic<std::uint64_t> _paused_count{0};
+  std::atomic<std::uint64_t> _disconnected_count{0};
+
+  int _ring_fd = INVALID_CONNECTION;
+  int _wakeup_fd = INVALID_CONNECTION;
+  std::uint64_t _wakeup_value = 0;
+
+  // submission queue ring
+  void *_sq_ptr = nullptr;
+  std::size_t _sq_size = 0;
+  unsigned *_sq_head = nullptr;
+  unsigned *_sq_tail = nullptr;
+  unsigned *_sq_mask = nullptr;
+  unsigned *_sq_array = nullptr;
+  io_uring_sqe *_sqes = nullptr;
+  std::size_t _sqes_size = 0;
+  unsigned _to_submit = 0;
+
+  // completion queue ring
+  void *_cq_ptr = nullptr;
+  std::size_t _cq_size = 0;
+  unsigned *_cq_head = nullptr;
+  unsigned *_cq_tail = nullptr;
+  unsigned *_cq_mask = nullptr;
+  io_uring_cqe *_cqes = nullptr;
+
+  // provided buffers
+  char *_buffers = nullptr;
+
+  // accepted connections of every listener, not handed over yet
+  std::unordered_map<ConnectionId, std::deque<ConnectionId>> _accepted;
+  std::unordered_set<ConnectionId> _local_listeners; // no TCP options
+  std::unordered_map<ConnectionId, ConnectionPtr> _connections;
+  // closed connections with a send in flight, keyed by the send user data
+  std::unordered_map<std::uint64_t, ConnectionPtr> _closing;
+  std::uint32_t _next_generation = 0;
+  std::vector<ConnectionId> _starved; // connections waiting for buffers
+  Outbox _outbox;
+};
+} // namespace auction_house::network
@@ -25,6 +25,27 @@ public:
   FundsType get_funds(const std::string &username);
   std::string get_items(const std::string &username);
 
+  // Runs the update on the account of a user under a single lock, e.g. for
+  // the bulk commands, and returns its result
+  template <typename Update>
+  auto update(const std::string &username, Update &&update) {
+    std::lock_guard _l(_mutex);
+    return update(_accounts[username]);
+  }
+
+  // Copies the account of a user, none if there is no account yet
+  std::optional<UserAccount> get_account(const std::string &username);
+
+  // Replaces the account of a user, removes it if none is given
+  void restore_account(const std::string &username,
+                       std::optional<UserAccount> &&account);
+
+  // Copies all the accounts, e.g. to hand them over to another process
+  std::unordered_map<std::string, UserAccount> snapshot();
+
+  // Replaces all the accounts with the given ones
+  void restore(std::unordered_map<std::string, UserAccount> &&accounts);
+
 private:
   std::mutex _mutex;
   std::unordered_map<std::string, UserAccount> _accounts;
@@ -3,118 +3,321 @@
 //
 #include "database.h"
 #include "network.h"
+#include "rate_limiter.h"
 #include "session_processor.h"
 #include "tasks.h"
-#include "tasks_queue.h"
+#include "tasks_executor.h"
+#include <climits>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 #include <spdlog/spdlog.h>
 #include <thread>
-#ifdef WIN32
+#include <vector>
+#ifndef WIN32
+#include "handoff.h"
+#include <csignal>
+#else
 #include <winsock.h>
 #endif
 
-std::uint16_t parse_arguments(int argc, char *argv[]) {
+constexpr auto MAX_INGRESS_THREADS = 64;
+constexpr auto MAX_TASKS_THREADS = 64;
+
+struct Options {
+  std::uint16_t port = 10000; // default
+  std::optional<std::uint16_t> binary_port;
+  std::optional<std::string> unix_path;
+  std::optional<std::string> shm_path;
+  std::optional<std::string> handoff_path;
+  std::optional<std::string> rate_limits_path;
+  auction_house::network::Backend backend =
+      auction_house::network::Backend::Epoll;
+  unsigned ingress_threads = 1;
+  unsigned tasks_threads = 1;
+  auction_house::network::EgressLimit egress_limit{};
+  auction_house::network::SocketOptions socket_options{};
+  auction_house::engine::SessionTimeouts timeouts{};
+};
+
+Options parse_arguments(int argc, char *argv[]) {
   spdlog::set_level(spdlog::level::info);
-  auto port = 10000; // default
+  Options options{};
   try {
-    if (argc < 5) {
-      auto read_port = false;
-      for (auto i = 1; i < argc; ++i) {
-        if (std::strcmp(argv[i], "--debug") == 0 && read_port == false) {
-          spdlog::set_level(spdlog::level::debug);
-        } else if (std::strcmp(argv[i], "--port") == 0 && read_port == false) {
-          read_port = true;
-        } else if (read_port) {
-          auto parsed_port =
-              std::stoul(std::string{argv[i], std::strlen(argv[i])});
-          if (parsed_port > 65535) {
-            throw std::out_of_range{""};
-          }
-          port = static_cast<std::uint16_t>(parsed_port);
-          read_port = false;
-        } else {
+    // returns the value of an option, throws if it's missing
+    auto read_value = [argc, argv](int &i) {
+      if (++i >= argc) {
+        throw std::invalid_argument{""};
+      }
+      return std::string{argv[i], std::strlen(argv[i])};
+    };
+    auto read_port = [&read_value](int &i) {
+      auto parsed_port = std::stoul(read_value(i));
+      if (parsed_port > 65535) {
+        throw std::out_of_range{""};
+      }
+      return static_cast<std::uint16_t>(parsed_port);
+    };
+    auto read_seconds = [&read_value](int &i) {
+      auto seconds = std::stoul(read_value(i));
+      if (seconds == 0) {
+        throw std::invalid_argument{""};
+      }
+      return std::chrono::seconds{seconds};
+    };
+    for (auto i = 1; i < argc; ++i) {
+      if (std::strcmp(argv[i], "--debug") == 0) {
+        spdlog::set_level(spdlog::level::debug);
+      } else if (std::strcmp(argv[i], "--port") == 0) {
+        options.port = read_port(i);
+      } else if (std::strcmp(argv[i], "--binary-port") == 0) {
+        options.binary_port = read_port(i);
+      } else if (std::strcmp(argv[i], "--unix-socket") == 0) {
+        options.unix_path = read_value(i);
+      } else if (std::strcmp(argv[i], "--shm-socket") == 0) {
+        options.shm_path = read_value(i);
+      } else if (std::strcmp(argv[i], "--handoff") == 0) {
+        options.handoff_path = read_value(i);
+      } else if (std::strcmp(argv[i], "--rate-limits") == 0) {
+        options.rate_limits_path = read_value(i);
+      } else if (std::strcmp(argv[i], "--backend") == 0) {
+        auto backend = auction_house::network::parse_backend(read_value(i));
+        if (!backend.has_value()) {
           throw std::invalid_argument{""};
         }
-      }
-      if (read_port) {
+        options.backend = backend.value();
+      } else if (std::strcmp(argv[i], "--ingress-threads") == 0) {
+        auto threads = std::stoul(read_value(i));
+        if (threads == 0 || threads > MAX_INGRESS_THREADS) {
+          throw std::invalid_argument{""};
+        }
+        options.ingress_threads = static_cast<unsigned>(threads);
+      } else if (std::strcmp(argv[i], "--tasks-threads") == 0) {
+        auto threads = std::stoul(read_value(i));
+        if (threads == 0 || threads > MAX_TASKS_THREADS) {
+          throw std::invalid_argument{""};
+        }
+        options.tasks_threads = static_cast<unsigned>(threads);
+      } else if (std::strcmp(argv[i], "--max-output") == 0) {
+        auto max_output = std::stoull(read_value(i));
+        if (max_output == 0) {
+          throw std::invalid_argument{""};
+        }
+        options.egress_limit.max_pending_bytes = max_output;
+      } else if (std::strcmp(argv[i], "--slow-clients") == 0) {
+        auto policy =
+            auction_house::network::parse_slow_client_policy(read_value(i));
+        if (!policy.has_value()) {
+          throw std::invalid_argument{""};
+        }
+        options.egress_limit.policy = policy.value();
+      } else if (std::strcmp(argv[i], "--backlog") == 0) {
+        auto backlog = std::stoul(read_value(i));
+        if (backlog == 0 || backlog > INT_MAX) {
+          throw std::invalid_argument{""};
+        }
+        options.socket_options.backlog = static_cast<int>(backlog);
+      } else if (std::strcmp(argv[i], "--tcp-nodelay") == 0) {
+        options.socket_options.no_delay = true;
+      } else if (std::strcmp(argv[i], "--defer-accept") == 0) {
+        options.socket_options.defer_accept =
+            static_cast<int>(read_seconds(i).count());
+      } else if (std::strcmp(argv[i], "--idle-timeout") == 0) {
+        options.timeouts.idle = read_seconds(i);
+      } else if (std::strcmp(argv[i], "--login-timeout") == 0) {
+        options.timeouts.login = read_seconds(i);
+      } else {
         throw std::invalid_argument{""};
       }
     }
   } catch (std::invalid_argument &) {
-    std::cerr << "Wrong arguments! Allowed: [--port <port>] [--debug]"
+    std::cerr << "Wrong arguments! Allowed: [--port <port>] "
+                 "[--binary-port <port>] [--unix-socket <path>] "
+                 "[--shm-socket <path>] [--handoff <path>] "
+                 "[--backend <epoll|io_uring>] [--ingress-threads <1-"
+              << MAX_INGRESS_THREADS << ">] [--tasks-threads <1-"
+              << MAX_TASKS_THREADS
+              << ">] [--max-output <bytes>] "
+                 "[--slow-clients <pause|disconnect>] "
+                 "[--idle-timeout <seconds>] [--login-timeout <seconds>] "
+                 "[--backlog <n>] [--tcp-nodelay] [--defer-accept <seconds>] "
+                 "[--rate-limits <path>] [--debug]"
               << std::endl;
     std::exit(1);
   } catch (std::out_of_range &) {
     std::cerr << "Incorrect port number!" << std::endl;
     std::exit(1);
   }
-  return port;
+  return options;
+}
+
+// Reads the rate limits from a file, returns none if it can't be read or
+// parsed
+std::optional<auction_house::engine::RateLimits>
+load_rate_limits(const std::string &path) {
+  std::ifstream file{path};
+  if (!file) {
+    spdlog::error("Couldn't open the rate limits file {}!", path);
+    return {};
+  }
+  std::stringstream text;
+  text << file.rdbuf();
+  auto limits = auction_house::engine::parse_rate_limits(text.str());
+  if (!limits.has_value()) {
+    spdlog::error("The rate limits file {} is malformed!", path);
+  }
+  return limits;
 }
 
 int main(int argc, char *argv[]) {
-  auto port = parse_arguments(argc, argv);
+  auto options = parse_arguments(argc, argv);
+  if (options.handoff_path.has_value() &&
+      options.backend != auction_house::network::Backend::Epoll) {
+    std::cerr << "Only the epoll backend can hand its connections over!"
+              << std::endl;
+    return 1;
+  }
+  #ifdef WIN32
+  if (options.handoff_path.has_value()) {
+    std::cerr << "Handing connections over isn't supported!" << std::endl;
+    return 1;
+  }
+  #endif
+  std::vector<auction_house::network::ReactorPtr> reactors;
+  for (unsigned i = 0; i < options.ingress_threads; ++i) {
+    reactors.push_back(auction_house::network::create_reactor(
+        options.backend, options.egress_limit, options.socket_options));
+    if (!reactors.back()) {
+      std::cerr << "The selected backend isn't supported!" << std::endl;
+      return 1;
+    }
+  }
 
   auction_house::engine::Accounts accounts;
   auction_house::engine::AuctionList auctions;
   auction_house::engine::SessionManager sessions;
   auction_house::engine::Database database{accounts, auctions, sessions};
-  auction_house::engine::TasksQueue queue;
-  auction_house::engine::SessionProcessor session_proc{database, queue};
+  auction_house::engine::TasksExecutor tasks{options.tasks_threads};
+  auction_house::engine::SessionProcessor session_proc{
+      database, tasks, std::move(reactors), options.timeouts};
+  if (options.rate_limits_path.has_value()) {
+    auto limits = load_rate_limits(options.rate_limits_path.value());
+    if (!limits.has_value()) {
+      return 1;
+    }
+    session_proc.set_rate_limits(limits.value());
+  }
+
+  // Rate limits reloader, SIGHUP is blocked before the other threads start
+  // so that only this one receives it
+  #ifndef WIN32
+  if (options.rate_limits_path.has_value()) {
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    std::thread{[signals, &path = options.rate_limits_path.value(),
+                 &session_proc]() {
+      for (;;) {
+        int signal = 0;
+        if (sigwait(&signals, &signal) != 0 || signal != SIGHUP) {
+          continue;
+        }
+        // a malformed file leaves the limits as they are
+        auto limits = load_rate_limits(path);
+        if (limits.has_value()) {
+          session_proc.set_rate_limits(limits.value());
+          spdlog::info("Reloaded the rate limits from {}", path);
+        }
+      }
+    }}.detach();
+  }
+  #endif
 
   // Auctions processor
-  std::thread auctions_proc{[&database, &queue]() {
+  std::thread auctions_proc{[&database, &tasks]() {
     for (;;) {
       database.auctions.wait_for_expired();
       auto expired_list = database.auctions.collect_expired();
 
       spdlog::debug("Collected {} expired auctions", expired_list.size());
 
-      for (auto &auction : expired_list) {
-        auto notify_seller = auction_house::engine::create_auction_task(
-            std::move(auction), database);
+      // the buyers' and the sellers' accounts are settled while no other
+      // task runs, all the collected auctions at once
+      if (!expired_list.empty()) {
+        auto settle = auction_house::engine::create_settlement_task(
+            std::move(expired_list), database, tasks);
 
-        queue.enqueue(std::move(notify_seller));
+        tasks.enqueue_exclusive(std::move(settle));
       }
     }
   }};
 
-  // Tasks processor
-  std::thread tasks_proc{[&database, &queue]() {
-    for (;;) {
-      auto task = queue.pop();
-      task.wait();
-
-      try {
-        auto event = task.get();
-        if (event.session_id.has_value()) {
-          auto session_id = event.session_id.value();
-          auto connection =
-              database.sessions.get_connection_id(event.session_id.value());
-          if (connection.has_value()) {
-            auto connection_id = connection.value();
-            spdlog::debug("Sending reply to session {}, connection {}, data {}",
-                          session_id, connection_id, event.data);
-            auction_house::network::send_data(connection_id,
-                                              std::move(event.data));
+  // Tasks processors, one per worker of the executor
+  std::vector<std::thread> tasks_procs;
+  for (std::size_t worker = 0; worker < tasks.workers(); ++worker) {
+    tasks_procs.emplace_back([&database, &tasks, &session_proc, worker]() {
+      for (;;) {
+        auto task = tasks.pop(worker);
+
+        try {
+          auto event = task.get();
+          if (event.session_id.has_value()) {
+            auto session_id = event.session_id.value();
+            auto connection =
+                database.sessions.get_connection_id(event.session_id.value());
+            if (connection.has_value()) {
+              auto connection_id = connection.value();
+              spdlog::debug(
+                  "Sending reply to session {}, connection {}, data {}",
+                  session_id, connection_id, event.data.view());
+              session_proc.send_data(connection_id, std::move(event.data),
+                                     event.result);
+            } else {
+              spdlog::debug("Dropping event, lack of connection "
+                            "for session {}, data: {}",
+                            event.session_id.value(), event.data.view());
+            }
           } else {
-            spdlog::debug("Dropping event, lack of connection "
-                          "for session {}, data: {}",
-                          event.session_id.value(), event.data);
+            spdlog::debug("Dropping event with data: {}", event.data.view());
           }
-        } else {
-          spdlog::debug("Dropping event with data: {}", event.data);
+        } catch (const std::exception &e) {
+          spdlog::error("Couldn't handle task: {}", e.what());
         }
-      } catch (const std::exception &e) {
-        spdlog::error("Couldn't handle task: {}", e.what());
       }
-    }
-  }};
+    });
+  }
+
+  // Handoff processor, takes over from the previous server first
+  #ifndef WIN32
+  if (options.handoff_path.has_value()) {
+    auto &path = options.handoff_path.value();
+    auction_house::engine::take_over(path, database, session_proc);
+    auto handoff_socket = auction_house::engine::create_handoff_socket(path);
+    std::thread{[handoff_socket, &database, &tasks, &session_proc]() {
+      auction_house::engine::serve_successors(handoff_socket, database, tasks,
+                                              session_proc);
+    }}.detach();
+  }
+  #endif
 
   // Sessions processor
-  session_proc.serve_ingress(port);
+  if (options.shm_path.has_value()) {
+    auto reactor = auction_house::network::create_reactor(
+        auction_house::network::Backend::SharedMemory, options.egress_limit);
+    if (!reactor) {
+      std::cerr << "Shared memory clients aren't supported!" << std::endl;
+      return 1;
+    }
+    session_proc.add_shm_ingress(std::move(reactor), options.shm_path.value());
+  }
+  session_proc.serve_ingress(options.port, options.binary_port,
+                             options.unix_path);
 
   auctions_proc.join();
-  tasks_proc.join();
+  for (auto &tasks_proc : tasks_procs) {
+    tasks_proc.join();
+  }
   #ifdef WIN32
   WSACleanup();
   #endif
@@ -17,7 +17,8 @@ EgressEvent process_auction(Database &database, Auction &&auction) {
       database.accounts.deposit_item(auction.owner, auction.item);
       return {seller_session, "Your item: " + auction.item +
                                   ", hasn't been sold! The " + buyer +
-                                  " couldn't pay for it!"};
+                                  " couldn't pay for it!",
+              ResultCode::Notification};
     }
 
     // Seller hasn't accepted the payment
@@ -30,19 +31,22 @@ EgressEvent process_auction(Database &database, Auction &&auction) {
       return {seller_session,
               "Your item: " + auction.item +
                   ", hasn't been sold! You didn't accept the payment from " +
-                  buyer + "!"};
+                  buyer + "!",
+              ResultCode::Notification};
     }
 
     // Successfully conclude the auction
     database.accounts.deposit_item(auction.buyer.value(), auction.item);
     return {seller_session,
             "Your item: " + auction.item + ", has been sold for " +
-                std::to_string(auction.price) + " by " + buyer + "!"};
+                std::to_string(auction.price) + " by " + buyer + "!",
+            ResultCode::Notification};
   } else { // there is no buyer
     database.accounts.deposit_item(auction.owner, auction.item);
 
     return {seller_session,
-            "Your item: " + auction.item + ", hasn't been sold!"};
+            "Your item: " + auction.item + ", hasn't been sold!",
+            ResultCode::Notification};
   };
 }
 
@@ -11,17 +11,7 @@ bool AuctionList::add_auction(Auction &&auction) {
   auto change_timeout = false;
   {
     std::unique_lock _l{_mutex};
-    auto id = _next_id++;
-    // In this simulation is highly unlikely that we outrun of ids, but just in
-    // case...
-    if (_auctions.find(id) == _auctions.end()) {
-      _auctions[id] = std::move(auction);
-      result = true;
-      if (auction.expiration_time < _nearest_expire) {
-        _nearest_expire = auction.expiration_time;
-        change_timeout = true;
-      }
-    }
+    result = _add(std::move(auction), change_timeout).has_value();
   }
   if(result) {
     if(change_timeout) {
@@ -32,21 +22,97 @@ bool AuctionList::add_auction(Auction &&auction) {
   return result;
 }
 
+std::vector<std::optional<AuctionId>>
+AuctionList::add_auctions(std::vector<Auction> &&auctions) {
+  std::vector<std::optional<AuctionId>> ids;
+  ids.reserve(auctions.size());
+  auto change_timeout = false;
+  {
+    std::unique_lock _l{_mutex};
+    _auctions.reserve(_auctions.size() + auctions.size());
+    for (auto &auction : auctions) {
+      ids.push_back(_add(std::move(auction), change_timeout));
+    }
+  }
+  if (change_timeout) {
+    _cv_timer.notify_one();
+  }
+  _cv_empty_list.notify_one();
+  return ids;
+}
+
+std::optional<AuctionId> AuctionList::_add(Auction &&auction,
+                                           bool &change_timeout) {
+  auto id = _next_id++;
+  // In this simulation is highly unlikely that we outrun of ids, but just in
+  // case...
+  if (_auctions.find(id) != _auctions.end()) {
+    return {};
+  }
+  if (auction.expiration_time < _nearest_expire) {
+    _nearest_expire = auction.expiration_time;
+    change_timeout = true;
+  }
+  _auctions[id] = std::move(auction);
+  return id;
+}
+
 BidResult AuctionList::bid_item(AuctionId id, FundsType new_price,
                                 const std::string &new_buyer) {
   std::unique_lock _l{_mutex};
+  return _bid(id, new_price, new_buyer, false);
+}
+
+BidResult AuctionList::bid_item_max(AuctionId id, FundsType max_price,
+                                    const std::string &new_buyer) {
+  std::unique_lock _l{_mutex};
+  return _bid(id, max_price, new_buyer, true);
+}
+
+std::vector<BidResult> AuctionList::bid_items(
+    const std::vector<std::pair<AuctionId, FundsType>> &bids,
+    const std::string &new_buyer) {
+  std::vector<BidResult> results;
+  results.reserve(bids.size());
+  std::unique_lock _l{_mutex};
+  for (auto &[id, new_price] : bids) {
+    results.push_back(_bid(id, new_price, new_buyer, false));
+  }
+  return results;
+}
+
+BidResult AuctionList::_bid(AuctionId id, FundsType new_price,
+                            const std::string &new_buyer, const bool max_bid) {
   auto auction_it = _auctions.find(id);
   if (auction_it == _auctions.end()) {
     return BidResult::DoesNotExist;
   }
-  if (auction_it->second.owner == new_buyer) {
+  auto &auction = auction_it->second;
+  if (auction.owner == new_buyer) {
     return BidResult::OwnerBid;
   }
-  if (auction_it->second.price >= new_price) {
+  if (auction.price >= new_price) {
     return BidResult::TooLowPrice;
   }
-  auction_it->second.buyer = new_buyer;
-  auction_it->second.price = new_price;
+  // the winning buyer raises either the price or the maximum
+  if (auction.buyer == new_buyer) {
+    if (!max_bid) {
+      auction.price = new_price;
+    }
+    auction.max_price = max_bid ? new_price
+                                : std::max(auction.max_price, new_price);
+    return BidResult::Successful;
+  }
+  // a plain bid is its own maximum
+  auto winning_max = std::max(auction.price, auction.max_price);
+  if (auction.buyer.has_value() && new_price <= winning_max) {
+    // the winner's maximum outbids the new one right away
+    auction.price = new_price < winning_max ? new_price + 1 : winning_max;
+    return BidResult::TooLowPrice;
+  }
+  auction.buyer = new_buyer;
+  auction.price = max_bid ? std::min(new_price, winning_max + 1) : new_price;
+  auction.max_price = new_price;
   return BidResult::Successful;
 }
 
@@ -74,10 +140,54 @@ void AuctionList::wait_for_expired() {
   std::shared_lock lck{_mutex};
   // waits for at least one expired auction
   _cv_timer.wait_until(lck, _nearest_expire, [this]() {
-    return this->_nearest_expire <= Clock::now();
+    return this->_nearest_expire <= Clock::now() || this->_pause_requested;
   });
   // waits if there is no auctions at all
-  _cv_empty_list.wait(lck, [this]() { return !this->_auctions.empty(); });
+  _cv_empty_list.wait(lck, [this]() {
+    return !this->_auctions.empty() || this->_pause_requested;
+  });
+  if (_pause_requested) {
+    _expiry_paused = true;
+    _cv_pause.notify_all();
+    _cv_pause.wait(lck, [this]() { return !this->_pause_requested; });
+    _expiry_paused = false;
+  }
+}
+
+void AuctionList::pause_expiry() {
+  std::unique_lock lck{_mutex};
+  // set under the lock, so the waiter can't miss the notification
+  _pause_requested = true;
+  _cv_timer.notify_all();
+  _cv_empty_list.notify_all();
+  _cv_pause.wait(lck, [this]() { return this->_expiry_paused.load(); });
+}
+
+void AuctionList::resume_expiry() {
+  {
+    std::unique_lock _l{_mutex};
+    _pause_requested = false;
+  }
+  _cv_pause.notify_all();
+}
+
+AuctionsSnapshot AuctionList::snapshot() {
+  std::shared_lock _l{_mutex};
+  return {_auctions, _next_id};
+}
+
+void AuctionList::restore(AuctionsSnapshot &&snapshot) {
+  {
+    std::unique_lock _l{_mutex};
+    _auctions = std::move(snapshot.auctions);
+    _next_id = snapshot.next_id;
+    _nearest_expire = TimePoint::max();
+    for (auto &[_, auction] : _auctions) {
+      _nearest_expire = std::min(_nearest_expire, auction.expiration_time);
+    }
+  }
+  _cv_timer.notify_all();
+  _cv_empty_list.notify_all();
 }
 
 std::vector<std::string> AuctionList::get_printable_list() {
@@ -0,0 +1,166 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#include "binary_protocol.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace auction_house::engine {
+static void write_integer(std::string &data, std::uint64_t value,
+                          const std::size_t size) {
+  for (std::size_t i = 0; i < size; ++i, value >>= 8) {
+    data.push_back(static_cast<char>(value & 0xff));
+  }
+}
+
+void FrameBuffer::append(std::string_view data) {
+  // drop the rest of a too long frame as it arrives
+  auto skipped = std::min(_skip, data.size());
+  _skip -= skipped;
+  data.remove_prefix(skipped);
+
+  // reclaim the space taken by already consumed frames
+  if (_begin > 0 && _begin >= _data.size() / 2) {
+    _data.erase(0, _begin);
+    _begin = 0;
+  }
+  _data.append(data);
+}
+
+std::optional<std::string> FrameBuffer::next_frame() {
+  while (pending() >= REQUEST_HEADER_SIZE) {
+    auto length = static_cast<std::size_t>(
+        static_cast<unsigned char>(_data[_begin]) |
+        static_cast<unsigned char>(_data[_begin + 1]) << 8);
+    auto begin = _begin + REQUEST_HEADER_SIZE;
+    if (length > _max_frame_length) {
+      auto skipped = std::min(length, _data.size() - begin);
+      _skip = length - skipped;
+      _begin = begin + skipped;
+      continue;
+    }
+    if (_data.size() - begin < length) {
+      break;
+    }
+    _begin = begin + length;
+    return _data.substr(begin, length);
+  }
+  return {};
+}
+
+std::string FrameBuffer::snapshot() const {
+  std::string snapshot;
+  for (std::size_t i = 0; i < sizeof(std::uint64_t); ++i) {
+    snapshot.push_back(static_cast<char>((_skip >> (8 * i)) & 0xff));
+  }
+  return snapshot + _data.substr(_begin);
+}
+
+void FrameBuffer::restore(std::string_view snapshot) {
+  FrameReader reader{snapshot};
+  _skip = static_cast<std::size_t>(reader.read_u64());
+  _data = snapshot.substr(sizeof(std::uint64_t));
+  _begin = 0;
+}
+
+std::uint8_t FrameReader::read_u8() {
+  return static_cast<std::uint8_t>(_read_integer(1));
+}
+
+std::uint16_t FrameReader::read_u16() {
+  return static_cast<std::uint16_t>(_read_integer(2));
+}
+
+std::uint32_t FrameReader::read_u32() {
+  return static_cast<std::uint32_t>(_read_integer(4));
+}
+
+std::uint64_t FrameReader::read_u64() { return _read_integer(8); }
+
+std::string_view FrameReader::read_string() {
+  return _read_bytes(read_u8());
+}
+
+std::string_view FrameReader::read_long_string() {
+  return _read_bytes(read_u16());
+}
+
+std::string_view FrameReader::_read_bytes(const std::size_t size) {
+  if (_frame.size() - _offset < size) {
+    throw std::out_of_range{"The frame is too short!"};
+  }
+  auto value = _frame.substr(_offset, size);
+  _offset += size;
+  return value;
+}
+
+std::uint64_t FrameReader::_read_integer(std::size_t size) {
+  if (_frame.size() - _offset < size) {
+    throw std::out_of_range{"The frame is too short!"};
+  }
+  std::uint64_t value = 0;
+  for (std::size_t i = 0; i < size; ++i) {
+    value |= static_cast<std::uint64_t>(
+                 static_cast<unsigned char>(_frame[_offset + i]))
+             << (8 * i);
+  }
+  _offset += size;
+  return value;
+}
+
+FrameWriter::FrameWriter(const Opcode opcode) {
+  _body.push_back(static_cast<char>(opcode));
+}
+
+FrameWriter &FrameWriter::write_u32(const std::uint32_t value) {
+  write_integer(_body, value, 4);
+  return *this;
+}
+
+FrameWriter &FrameWriter::write_u64(const std::uint64_t value) {
+  write_integer(_body, value, 8);
+  return *this;
+}
+
+FrameWriter &FrameWriter::write_string(std::string_view value) {
+  value = value.substr(0, 255);
+  _body.push_back(static_cast<char>(value.size()));
+  _body.append(value);
+  return *this;
+}
+
+std::string frame_request(std::string_view body) {
+  std::string frame;
+  frame.reserve(REQUEST_HEADER_SIZE + body.size());
+  frame.push_back(static_cast<char>(body.size() & 0xff));
+  frame.push_back(static_cast<char>(body.size() >> 8));
+  return frame.append(body);
+}
+
+std::string FrameWriter::frame() const { return frame_request(_body); }
+
+ReplyWriter &ReplyWriter::write_u32(const std::uint32_t value) {
+  write_integer(_data, value, 4);
+  return *this;
+}
+
+ReplyWriter &ReplyWriter::write_u64(const std::uint64_t value) {
+  write_integer(_data, value, 8);
+  return *this;
+}
+
+ReplyWriter &ReplyWriter::write_string(std::string_view value) {
+  value = value.substr(0, UINT16_MAX);
+  write_integer(_data, value.size(), 2);
+  _data.append(value);
+  return *this;
+}
+
+std::string frame_reply(const std::uint8_t result, std::string_view reply) {
+  std::string frame;
+  frame.reserve(REPLY_HEADER_SIZE + reply.size());
+  write_integer(frame, reply.size() + 1, 4);
+  frame.push_back(static_cast<char>(result));
+  return frame.append(reply);
+}
+} // namespace auction_house::engine
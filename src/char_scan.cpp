@@ -0,0 +1,255 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#include "char_scan.h"
+#include <array>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CHAR_SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+// The vector kernels read a whole vector at the end of the text if it
+// doesn't cross a page, such a read can't fault. The address sanitizer
+// reports it anyway, the tail is scanned one character at a time then.
+#if defined(__SANITIZE_ADDRESS__)
+#define CHAR_SCAN_OVERREAD 0
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define CHAR_SCAN_OVERREAD 0
+#endif
+#endif
+#ifndef CHAR_SCAN_OVERREAD
+#define CHAR_SCAN_OVERREAD 1
+#endif
+
+namespace auction_house::engine {
+constexpr std::uint8_t class_bit(const CharClass char_class) {
+  return static_cast<std::uint8_t>(1u << static_cast<unsigned>(char_class));
+}
+
+// The classes of every byte
+constexpr auto CLASSES = [] {
+  std::array<std::uint8_t, 256> classes{};
+  for (unsigned c = 0; c < classes.size(); ++c) {
+    auto digit = c >= '0' && c <= '9';
+    if (c == ' ' || (c >= '\t' && c <= '\r')) {
+      classes[c] |= class_bit(CharClass::Space);
+    }
+    if (digit) {
+      classes[c] |= class_bit(CharClass::Digit);
+    }
+    if (digit || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        c == '_') {
+      classes[c] |= class_bit(CharClass::Word);
+    }
+  }
+  return classes;
+}();
+
+static std::size_t find_scalar(std::string_view text,
+                               const CharClass char_class,
+                               const bool in_class) {
+  auto bit = class_bit(char_class);
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    auto c = static_cast<unsigned char>(text[i]);
+    if (((CLASSES[c] & bit) != 0) == in_class) {
+      return i;
+    }
+  }
+  return text.size();
+}
+
+#ifdef CHAR_SCAN_X86
+#define SSE42 __attribute__((target("sse4.2")))
+#define AVX2 __attribute__((target("avx2")))
+
+// Returns true if a vector of the size can be read from the address without
+// crossing a page
+template <std::size_t Size> static bool within_page(const char *data) {
+  constexpr std::uintptr_t PAGE_SIZE = 4096;
+  return (reinterpret_cast<std::uintptr_t>(data) & (PAGE_SIZE - 1)) <=
+         PAGE_SIZE - Size;
+}
+
+// The classes are given as ranges of bytes to PCMPESTRI
+constexpr int IN_RANGES =
+    _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT;
+constexpr int OUT_OF_RANGES = IN_RANGES | _SIDD_MASKED_NEGATIVE_POLARITY;
+
+// Returns the index of the first of the size bytes which is in the ranges (or
+// out of them), 16 if there is none
+SSE42 static int find_ranges(const __m128i ranges, const int ranges_size,
+                             const char *data, const int size,
+                             const bool in_class) {
+  auto chunk = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data));
+  return in_class
+             ? _mm_cmpestri(ranges, ranges_size, chunk, size, IN_RANGES)
+             : _mm_cmpestri(ranges, ranges_size, chunk, size, OUT_OF_RANGES);
+}
+
+SSE42 static std::size_t find_sse42(std::string_view text,
+                                    const CharClass char_class,
+                                    const bool in_class) {
+  __m128i ranges;
+  int ranges_size;
+  switch (char_class) {
+  case CharClass::Space:
+    ranges = _mm_setr_epi8('\t', '\r', ' ', ' ', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                           0, 0);
+    ranges_size = 4;
+    break;
+  case CharClass::Word:
+    ranges = _mm_setr_epi8('a', 'z', 'A', 'Z', '0', '9', '_', '_', 0, 0, 0, 0,
+                           0, 0, 0, 0);
+    ranges_size = 8;
+    break;
+  default:
+    ranges =
+        _mm_setr_epi8('0', '9', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    ranges_size = 2;
+    break;
+  }
+  auto data = text.data();
+  std::size_t i = 0;
+  for (; i + 16 <= text.size(); i += 16) {
+    auto index = find_ranges(ranges, ranges_size, data + i, 16, in_class);
+    if (index < 16) {
+      return i + index;
+    }
+  }
+  if (i == text.size()) {
+    return i;
+  }
+  if (CHAR_SCAN_OVERREAD && within_page<16>(data + i)) {
+    auto rest = static_cast<int>(text.size() - i);
+    auto index = find_ranges(ranges, ranges_size, data + i, rest, in_class);
+    return index < rest ? i + index : text.size();
+  }
+  return i + find_scalar(text.substr(i), char_class, in_class);
+}
+
+// Bytes of the vector within [low, high] are set to 0xff
+AVX2 static __m256i in_range(const __m256i bytes, const char low,
+                             const char high) {
+  auto offset = _mm256_sub_epi8(bytes, _mm256_set1_epi8(low));
+  auto limit = _mm256_set1_epi8(static_cast<char>(high - low));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(offset, limit), offset);
+}
+
+// Returns a bit for every byte of the vector, set if it's in the class
+AVX2 static std::uint32_t class_mask(const char *data,
+                                     const CharClass char_class) {
+  auto bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data));
+  __m256i matches;
+  switch (char_class) {
+  case CharClass::Space:
+    matches = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+                              in_range(bytes, '\t', '\r'));
+    break;
+  case CharClass::Word: {
+    // upper case letters are folded into the lower case ones
+    auto folded = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+    matches = _mm256_or_si256(
+        _mm256_or_si256(in_range(bytes, '0', '9'), in_range(folded, 'a', 'z')),
+        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_')));
+    break;
+  }
+  default:
+    matches = in_range(bytes, '0', '9');
+    break;
+  }
+  return static_cast<std::uint32_t>(_mm256_movemask_epi8(matches));
+}
+
+AVX2 static std::size_t find_avx2(std::string_view text,
+                                  const CharClass char_class,
+                                  const bool in_class) {
+  auto data = text.data();
+  std::size_t i = 0;
+  for (; i + 32 <= text.size(); i += 32) {
+    auto mask = class_mask(data + i, char_class);
+    if (!in_class) {
+      mask = ~mask;
+    }
+    if (mask != 0) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+  if (i == text.size()) {
+    return i;
+  }
+  if (CHAR_SCAN_OVERREAD && within_page<32>(data + i)) {
+    auto mask = class_mask(data + i, char_class);
+    if (!in_class) {
+      mask = ~mask;
+    }
+    // the bytes past the text don't count
+    mask &= (1u << (text.size() - i)) - 1;
+    return mask != 0 ? i + __builtin_ctz(mask) : text.size();
+  }
+  return i + find_scalar(text.substr(i), char_class, in_class);
+}
+#endif
+
+using FindFunction = std::size_t (*)(std::string_view, const CharClass,
+                                     const bool);
+
+static FindFunction kernel_function(const ScanKernel kernel) {
+  switch (kernel) {
+#ifdef CHAR_SCAN_X86
+  case ScanKernel::Sse42:
+    return find_sse42;
+  case ScanKernel::Avx2:
+    return find_avx2;
+#endif
+  default:
+    return find_scalar;
+  }
+}
+
+bool supports_kernel(const ScanKernel kernel) {
+#ifdef CHAR_SCAN_X86
+  // the CPU may be checked before the constructors have run
+  __builtin_cpu_init();
+  switch (kernel) {
+  case ScanKernel::Sse42:
+    return __builtin_cpu_supports("sse4.2");
+  case ScanKernel::Avx2:
+    return __builtin_cpu_supports("avx2");
+  default:
+    return true;
+  }
+#else
+  return kernel == ScanKernel::Scalar;
+#endif
+}
+
+static ScanKernel best_kernel() {
+  for (auto kernel : {ScanKernel::Avx2, ScanKernel::Sse42}) {
+    if (supports_kernel(kernel)) {
+      return kernel;
+    }
+  }
+  return ScanKernel::Scalar;
+}
+
+static ScanKernel _kernel = best_kernel();
+static FindFunction _find = kernel_function(_kernel);
+
+std::size_t find_class(std::string_view text, const CharClass char_class,
+                       const bool in_class) {
+  return _find(text, char_class, in_class);
+}
+
+ScanKernel scan_kernel() { return _kernel; }
+
+bool set_scan_kernel(const ScanKernel kernel) {
+  if (!supports_kernel(kernel)) {
+    return false;
+  }
+  _kernel = kernel;
+  _find = kernel_function(kernel);
+  return true;
+}
+} // namespace auction_house::engine
@@ -2,491 +2,1150 @@
 // Created by mswiercz on 24.11.2021.
 //
 #include "command.h"
+#include "binary_protocol.h"
+#include "char_scan.h"
 #include "database.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <functional>
 #include <numeric>
-#include <regex>
 #include <spdlog/spdlog.h>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace auction_house::engine {
 
-static const std::regex help_regex{R"(\s*(HELP)\s*)", std::regex::icase};
-static const std::regex login_regex{R"(\s*(LOGIN)\s+(\w+)\s*)",
-                                    std::regex::icase};
-static const std::regex logout_regex{R"(\s*(LOGOUT)\s*)", std::regex::icase};
-static const std::regex deposit_funds_regex{
-    R"(\s*(DEPOSIT)\s+(FUNDS)\s+(\d+)\s*)", std::regex::icase};
-static const std::regex deposit_item_regex{
-    R"(\s*(DEPOSIT)\s+(ITEM)\s+(\w+)\s*)", std::regex::icase};
-static const std::regex withdraw_funds_regex{
-    R"(\s*(WITHDRAW)\s+(FUNDS)\s+(\d+)\s*)", std::regex::icase};
-static const std::regex withdraw_item_regex{
-    R"(\s*(WITHDRAW)\s+(ITEM)\s+(\w+)\s*)", std::regex::icase};
-static const std::regex sell_regex{
-    R"(\s*(SELL)\s+(\w+)\s+(\d+)\s*(\d+)?\s*)", std::regex::icase};
-static const std::regex bid_regex{R"(\s*(BID)\s+(\d+)\s+(\d+)\s*)",
-                                  std::regex::icase};
-static const std::regex show_funds_regex{R"(\s*(SHOW)\s+(FUNDS)\s*)",
-                                         std::regex::icase};
-static const std::regex show_items_regex{R"(\s*(SHOW)\s+(ITEMS)\s*)",
-                                         std::regex::icase};
-static const std::regex show_sales_regex{R"(\s*(SHOW)\s+(SALES)\s*)",
-                                         std::regex::icase};
-
-class HelpCommand : public Command {
+// Splits a command line into words separated by whitespace, the words are
+// views of the line
+class Tokenizer {
 public:
-  HelpCommand(IngressEvent &&event) : Command(std::move(event)) {}
+  explicit Tokenizer(std::string_view line) : _rest(line) {}
 
-  virtual EgressEvent execute(Database &) override {
-    spdlog::info("user {}, session {}, asked for help",
-                 _event.username.value_or(""), _event.session_id);
-    return {_event.session_id,
-            "Welcome, available commands:\n"
-            "\tHELP\n"
-            "\tLOGIN <username>\n"
-            "\tLOGOUT\n"
-            "\tDEPOSIT FUNDS <amount>\n"
-            "\tDEPOSIT ITEM <item>\n"
-            "\tWITHDRAWS FUNDS <amount>\n"
-            "\tWITHDRAWS FUNDS <item>\n"
-            "\tSELL <item> <starting-price> [<expiration-time>]\n"
-            "\tBID <auction-id> <new-price>\n"
-            "\tSHOW FUNDS\n"
-            "\tSHOW ITEMS\n"
-            "\tSHOW SALES"};
+  // Returns the next word, an empty one at the end of the line
+  std::string_view next() {
+    _skip_spaces();
+    auto word = _rest.substr(0, find_space(_rest));
+    _rest.remove_prefix(word.size());
+    return word;
   }
-};
 
-class LoginCommand : public Command {
-public:
-  LoginCommand(IngressEvent &&event, std::string &&username)
-      : Command(std::move(event)), _username(username) {}
-
-  EgressEvent execute(Database &database) override {
-    try {
-      if (database.sessions.get_username(_event.session_id)) {
-        spdlog::info("user {}, session {}, reject login second login as {}",
-                     _event.username.value_or(""), _event.session_id,
-                     _username);
-        return {_event.session_id, "You are already logged in as " +
-                                       _event.username.value_or("") + "!"};
-      }
-      if (database.sessions.login(_event.session_id, _username)) {
-        auto data = "Welcome " + _username + "!";
-        spdlog::info("user {}, session {}, has logged in!",
-                     _event.username.value_or(""), _event.session_id);
-        return {_event.session_id, std::move(data)};
-      }
-    } catch (std::bad_optional_access &e) {
-      spdlog::error("user {}, session {}, unexpected error: ",
-                    _event.username.value_or(""), _event.session_id, e.what());
-    }
-    spdlog::info("user {}, session {}, tried to login as {}",
-                 _event.username.value_or(""), _event.session_id, _username);
-    return {_event.session_id, "Couldn't login as " + _username + "!"};
+  // Returns the rest of the line, from its next word on
+  std::string_view rest() {
+    _skip_spaces();
+    auto rest = _rest;
+    _rest = {};
+    return rest;
+  }
+
+  // Returns true if there are no more words
+  bool done() {
+    _skip_spaces();
+    return _rest.empty();
   }
 
 private:
-  std::string _username;
+  void _skip_spaces() { _rest.remove_prefix(skip_spaces(_rest)); }
+
+  std::string_view _rest;
 };
 
-class LogoutCommand : public Command {
-public:
-  LogoutCommand(IngressEvent &&event) : Command(std::move(event)) {}
-
-  EgressEvent execute(Database &database) override {
-    try {
-      if (database.sessions.logout(_event.session_id)) {
-        auto data = "Good bay, " + _event.username.value() + "!";
-        spdlog::info("user {}, session {}, has logged out!",
-                     _event.username.value_or(""), _event.session_id);
-        return {_event.session_id, std::move(data)};
-      }
-    } catch (std::bad_optional_access &e) {
-      spdlog::error("user {}, session {}, unexpected error: ",
-                    _event.username.value_or(""), _event.session_id, e.what());
+// Keywords are case-insensitive
+static bool is_keyword(const std::string_view word,
+                       const std::string_view keyword) {
+  return std::equal(word.begin(), word.end(), keyword.begin(), keyword.end(),
+                    [](const unsigned char lhs, const unsigned char rhs) {
+                      return std::toupper(lhs) == rhs;
+                    });
+}
+
+// Usernames and items, binary arguments are checked the same way
+static bool is_word(const std::string_view value) {
+  return !value.empty() && all_word_chars(value);
+}
+
+static bool is_number(const std::string_view value) {
+  return !value.empty() && all_digits(value);
+}
+
+// A bid of the bulk command, <auction-id>:<new-price>
+static bool is_bid(const std::string_view value) {
+  auto colon = value.find(':');
+  return colon != std::string_view::npos &&
+         is_number(value.substr(0, colon)) &&
+         is_number(value.substr(colon + 1));
+}
+
+// Returns true if there is at least one word and all of them are valid
+static bool is_list(const std::string_view value,
+                    bool (*is_valid)(const std::string_view)) {
+  Tokenizer tokens{value};
+  auto empty = true;
+  while (!tokens.done()) {
+    if (!is_valid(tokens.next())) {
+      return false;
     }
-    return {_event.session_id, "You are not logged in!"};
+    empty = false;
+  }
+  return !empty;
+}
+
+static std::vector<std::string_view> split_words(const std::string_view value) {
+  std::vector<std::string_view> words;
+  Tokenizer tokens{value};
+  while (!tokens.done()) {
+    words.push_back(tokens.next());
+  }
+  return words;
+}
+
+// Parses a number with no sign, none if it doesn't fit the type
+template <typename Number>
+static std::optional<Number> parse_number(const std::string_view digits) {
+  Number value{};
+  auto end = digits.data() + digits.size();
+  auto [last, error] = std::from_chars(digits.data(), end, value);
+  if (error != std::errc{} || last != end) {
+    return {};
+  }
+  return value;
+}
+
+// Parses the bids of BID MANY, none if any of the numbers doesn't fit
+static std::optional<std::vector<std::pair<AuctionId, FundsType>>>
+parse_bids(const std::string_view value) {
+  std::vector<std::pair<AuctionId, FundsType>> bids;
+  for (auto bid : split_words(value)) {
+    auto colon = bid.find(':');
+    auto auction_id = parse_number<AuctionId>(bid.substr(0, colon));
+    auto price = parse_number<FundsType>(bid.substr(colon + 1));
+    if (!auction_id.has_value() || !price.has_value()) {
+      return {};
+    }
+    bids.emplace_back(auction_id.value(), price.value());
+  }
+  return bids;
+}
+
+// The expiration time of SELL is an int number of seconds
+static std::optional<int> to_seconds(const std::uint32_t seconds) {
+  if (seconds > static_cast<std::uint32_t>(INT_MAX)) {
+    return {};
   }
+  return static_cast<int>(seconds);
+}
+
+constexpr std::size_t MAX_ARGUMENTS = 3;
+
+// The lists take the rest of the line, one or more words. A keyword is a
+// fixed word of the command, e.g. MAX of BID MAX, named by itself.
+enum class ArgumentType : std::uint8_t { Word, Number, Words, Bids, Keyword };
+
+// An argument without a name isn't used, one with a default value is optional
+// and can be the last one only, so can be a list
+struct Argument {
+  ArgumentType type;
+  std::string_view name;
+  std::string_view default_value = {};
 };
 
-// Another base class that implements access check before running the actual
-// command
-class LimitedAccess : public Command {
-public:
-  LimitedAccess(IngressEvent &&event) : Command(std::move(event)) {}
+// The arguments of a parsed line, views of the line
+using Arguments = std::array<std::string_view, MAX_ARGUMENTS>;
 
-  EgressEvent execute(Database &database) final {
-    if (!_event.username.has_value()) {
-      spdlog::info("Not logged in session {}, tried to: {}", _event.session_id,
-                   _event.data);
-      return {_event.session_id, "You are not logged in!"};
+// A text command, the keywords are upper case and separated by a space. A
+// command can have several forms with the same keywords, they are tried in the
+// order of the table. The binary opcodes follow the order of the table.
+struct CommandSpec {
+  std::string_view keywords;
+  Opcode opcode;
+  std::array<Argument, MAX_ARGUMENTS> arguments;
+  Command::Variant (*create)(const Arguments &arguments);
+};
+
+// Every text command, HELP lists them in this order
+constexpr std::array COMMANDS{
+    CommandSpec{"HELP", Opcode::Help, {},
+                [](const Arguments &) -> Command::Variant {
+                  return commands::Help{};
+                }},
+    CommandSpec{"LOGIN", Opcode::Login,
+                {{{ArgumentType::Word, "<username>"}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::Login{arguments[0]};
+                }},
+    CommandSpec{"LOGOUT", Opcode::Logout, {},
+                [](const Arguments &) -> Command::Variant {
+                  return commands::Logout{};
+                }},
+    CommandSpec{"DEPOSIT FUNDS", Opcode::DepositFunds,
+                {{{ArgumentType::Number, "<amount>"}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::DepositFunds{
+                      parse_number<FundsType>(arguments[0])};
+                }},
+    CommandSpec{"DEPOSIT ITEM", Opcode::DepositItem,
+                {{{ArgumentType::Word, "<item>"}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::DepositItem{arguments[0]};
+                }},
+    CommandSpec{"WITHDRAW FUNDS", Opcode::WithdrawFunds,
+                {{{ArgumentType::Number, "<amount>"}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::WithdrawFunds{
+                      parse_number<FundsType>(arguments[0])};
+                }},
+    CommandSpec{"WITHDRAW ITEM", Opcode::WithdrawItem,
+                {{{ArgumentType::Word, "<item>"}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::WithdrawItem{arguments[0]};
+                }},
+    CommandSpec{"SELL", Opcode::Sell,
+                {{{ArgumentType::Word, "<item>"},
+                  {ArgumentType::Number, "<starting-price>"},
+                  // 5 minutes
+                  {ArgumentType::Number, "<expiration-time>", "300"}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::Sell{arguments[0],
+                                        parse_number<FundsType>(arguments[1]),
+                                        parse_number<int>(arguments[2])};
+                }},
+    CommandSpec{"BID", Opcode::Bid,
+                {{{ArgumentType::Number, "<auction-id>"},
+                  {ArgumentType::Number, "<new-price>"}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::Bid{parse_number<AuctionId>(arguments[0]),
+                                       parse_number<FundsType>(arguments[1]),
+                                       false};
+                }},
+    CommandSpec{"SHOW FUNDS", Opcode::ShowFunds, {},
+                [](const Arguments &) -> Command::Variant {
+                  return commands::ShowFunds{};
+                }},
+    CommandSpec{"SHOW ITEMS", Opcode::ShowItems, {},
+                [](const Arguments &) -> Command::Variant {
+                  return commands::ShowItems{};
+                }},
+    CommandSpec{"SHOW SALES", Opcode::ShowSales, {},
+                [](const Arguments &) -> Command::Variant {
+                  return commands::ShowSales{};
+                }},
+    CommandSpec{"MULTI", Opcode::Multi, {},
+                [](const Arguments &) -> Command::Variant {
+                  return commands::Multi{false};
+                }},
+    CommandSpec{"MULTI ATOMIC", Opcode::MultiAtomic, {},
+                [](const Arguments &) -> Command::Variant {
+                  return commands::Multi{true};
+                }},
+    CommandSpec{"EXEC", Opcode::Exec, {},
+                [](const Arguments &) -> Command::Variant {
+                  return commands::Exec{};
+                }},
+    CommandSpec{"DISCARD", Opcode::Discard, {},
+                [](const Arguments &) -> Command::Variant {
+                  return commands::Discard{};
+                }},
+    CommandSpec{"SELL MANY", Opcode::SellMany,
+                {{{ArgumentType::Number, "<starting-price>"},
+                  {ArgumentType::Number, "<expiration-time>"},
+                  {ArgumentType::Words, "<item>..."}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::SellMany{
+                      parse_number<FundsType>(arguments[0]),
+                      parse_number<int>(arguments[1]),
+                      split_words(arguments[2])};
+                }},
+    CommandSpec{"BID MANY", Opcode::BidMany,
+                {{{ArgumentType::Bids, "<auction-id>:<new-price>..."}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::BidMany{parse_bids(arguments[0])};
+                }},
+    CommandSpec{"DEPOSIT MANY", Opcode::DepositMany,
+                {{{ArgumentType::Words, "<item>..."}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::DepositMany{split_words(arguments[0])};
+                }},
+    CommandSpec{"BID", Opcode::BidMax,
+                {{{ArgumentType::Number, "<auction-id>"},
+                  {ArgumentType::Keyword, "MAX"},
+                  {ArgumentType::Number, "<max-price>"}}},
+                [](const Arguments &arguments) -> Command::Variant {
+                  return commands::Bid{parse_number<AuctionId>(arguments[0]),
+                                       parse_number<FundsType>(arguments[2]),
+                                       true};
+                }}};
+
+constexpr bool opcodes_follow_table() {
+  for (std::size_t i = 0; i < COMMANDS.size(); ++i) {
+    if (static_cast<std::size_t>(COMMANDS[i].opcode) != i + 1) {
+      return false;
     }
-    return execute_impl(database); // run the actual command
   }
+  return true;
+}
+
+static_assert(opcodes_follow_table(), "The opcodes follow the command table");
+
+// Returns the index of the next form of the command, 0 if there is none
+constexpr std::size_t find_next_form(const std::size_t index) {
+  for (auto i = index + 1; i < COMMANDS.size(); ++i) {
+    if (COMMANDS[i].keywords == COMMANDS[index].keywords) {
+      return i;
+    }
+  }
+  return 0;
+}
+
+constexpr auto NEXT_FORM = [] {
+  std::array<std::uint8_t, COMMANDS.size()> forms{};
+  for (std::size_t i = 0; i < COMMANDS.size(); ++i) {
+    forms[i] = static_cast<std::uint8_t>(find_next_form(i));
+  }
+  return forms;
+}();
 
-protected:
-  virtual EgressEvent execute_impl(Database &database) = 0;
+// Only the first form of a command is looked up by its keywords
+constexpr bool is_first_form(const std::size_t index) {
+  for (std::size_t i = 0; i < index; ++i) {
+    if (NEXT_FORM[i] == index) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static const CommandSpec *next_form(const CommandSpec *command) {
+  auto next = NEXT_FORM[command - COMMANDS.data()];
+  return next == 0 ? nullptr : &COMMANDS[next];
+}
+
+// Case-insensitive FNV-1a, the words of the keywords are hashed one by one
+constexpr std::uint32_t hash_keyword(const std::string_view word,
+                                     std::uint32_t hash) {
+  for (unsigned char c : word) {
+    hash ^= c >= 'a' && c <= 'z' ? c - 'a' + 'A' : c;
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+constexpr std::uint32_t hash_seed(const std::uint32_t seed) {
+  return 2166136261u ^ seed;
+}
+
+// The slot is taken from the top bits, FNV mixes them best
+constexpr unsigned KEYWORD_BITS = 5;
+constexpr std::size_t KEYWORD_SLOTS = 1 << KEYWORD_BITS;
+
+constexpr std::size_t keyword_slot(const std::uint32_t hash) {
+  return hash >> (32 - KEYWORD_BITS);
+}
+
+// Perfect hash of the keywords, the seed maps every command to its own slot.
+// A slot keeps the index of its command + 1, 0 if it's empty.
+struct KeywordIndex {
+  bool found;
+  std::uint32_t seed;
+  std::array<std::uint8_t, KEYWORD_SLOTS> slots;
 };
 
-class DepositFundsCommand : public LimitedAccess {
-public:
-  DepositFundsCommand(IngressEvent &&event, std::string &&amount)
-      : LimitedAccess(std::move(event)), _amount(amount) {}
-
-protected:
-  EgressEvent execute_impl(Database &database) override {
-    try {
-      if (database.accounts.deposit_funds(_event.username.value(),
-                                          parse_funds(_amount))) {
-        spdlog::info("user {}, session {}, deposited funds {} ",
-                     _event.username.value_or(""), _event.session_id, _amount);
-        return {_event.session_id,
-                "Successful deposition of funds: " + _amount + "!"};
+constexpr KeywordIndex build_keyword_index() {
+  for (std::uint32_t seed = 0; seed < 1000; ++seed) {
+    KeywordIndex index{true, seed, {}};
+    for (std::size_t i = 0; i < COMMANDS.size() && index.found; ++i) {
+      if (!is_first_form(i)) {
+        continue;
       }
-    } catch (std::bad_optional_access &e) {
-      spdlog::error("user {}, session {}, unexpected error: {}",
-                    _event.username.value_or(""), _event.session_id, e.what());
-      return {_event.session_id,
-              "Deposition of funds has failed! Server error!"};
-    } catch (std::invalid_argument &) {
-    } catch (std::out_of_range &) {
+      auto &slot = index.slots[keyword_slot(
+          hash_keyword(COMMANDS[i].keywords, hash_seed(seed)))];
+      index.found = slot == 0;
+      slot = static_cast<std::uint8_t>(i + 1);
+    }
+    if (index.found) {
+      return index;
     }
-    spdlog::warn(
-        "user {}, session {}, tried to deposit invalid amount of funds!",
-        _event.username.value_or(""), _event.session_id);
-    return {_event.session_id,
-            "Deposition of funds has failed! Invalid amount!"};
   }
+  return {false, 0, {}};
+}
 
-private:
-  std::string _amount;
-};
+constexpr auto KEYWORD_INDEX = build_keyword_index();
+static_assert(KEYWORD_INDEX.found, "The keywords have to be unique");
+
+// Returns the command hashed to the slot, if any
+static const CommandSpec *command_at(const std::uint32_t hash) {
+  auto slot = KEYWORD_INDEX.slots[keyword_slot(hash)];
+  return slot == 0 ? nullptr : &COMMANDS[slot - 1];
+}
+
+// Returns true if the keywords are the first ones of another command, e.g.
+// MULTI of MULTI ATOMIC
+constexpr bool starts_other(const std::string_view keywords) {
+  for (auto &command : COMMANDS) {
+    if (command.keywords.size() > keywords.size() &&
+        command.keywords.substr(0, keywords.size()) == keywords &&
+        command.keywords[keywords.size()] == ' ') {
+      return true;
+    }
+  }
+  return false;
+}
+
+constexpr auto STARTS_OTHER = [] {
+  std::array<bool, COMMANDS.size()> starts{};
+  for (std::size_t i = 0; i < COMMANDS.size(); ++i) {
+    starts[i] = starts_other(COMMANDS[i].keywords);
+  }
+  return starts;
+}();
+
+// Takes the keywords of a command, one or two words, from the line. The
+// longer command wins. Returns none if the line doesn't start with any.
+static const CommandSpec *find_command(Tokenizer &tokens) {
+  auto first = tokens.next();
+  auto hash = hash_keyword(first, hash_seed(KEYWORD_INDEX.seed));
+  auto single = command_at(hash);
+  if (single != nullptr && is_keyword(first, single->keywords)) {
+    if (!STARTS_OTHER[single - COMMANDS.data()]) {
+      return single;
+    }
+  } else {
+    single = nullptr;
+  }
+  auto rest = tokens;
+  auto second = rest.next();
+  auto command = command_at(hash_keyword(second, hash_keyword(" ", hash)));
+  if (command == nullptr) {
+    return single;
+  }
+  auto keywords = command->keywords;
+  auto space = keywords.find(' ');
+  if (space == std::string_view::npos ||
+      !is_keyword(first, keywords.substr(0, space)) ||
+      !is_keyword(second, keywords.substr(space + 1))) {
+    return single;
+  }
+  tokens = rest;
+  return command;
+}
+
+// Takes the first word of the line, returns the command with the single
+// keyword if there is one
+static const CommandSpec *find_single_command(Tokenizer &tokens) {
+  auto first = tokens.next();
+  auto command =
+      command_at(hash_keyword(first, hash_seed(KEYWORD_INDEX.seed)));
+  return command != nullptr && is_keyword(first, command->keywords)
+             ? command
+             : nullptr;
+}
+
+static std::string render_usage() {
+  std::string usage;
+  for (auto &command : COMMANDS) {
+    usage += (usage.empty() ? "\t" : "\n\t") + std::string{command.keywords};
+    for (auto &argument : command.arguments) {
+      if (argument.name.empty()) {
+        break;
+      }
+      usage += argument.default_value.empty()
+                   ? " " + std::string{argument.name}
+                   : " [" + std::string{argument.name} + "]";
+    }
+  }
+  return usage;
+}
+
+// Takes the arguments of the command from the line, returns none if they
+// don't match
+static std::optional<Arguments> parse_arguments(const CommandSpec &command,
+                                                Tokenizer &tokens) {
+  Arguments arguments;
+  for (std::size_t i = 0; i < MAX_ARGUMENTS; ++i) {
+    auto &argument = command.arguments[i];
+    if (argument.name.empty()) {
+      break;
+    }
+    auto list = argument.type == ArgumentType::Words ||
+                argument.type == ArgumentType::Bids;
+    arguments[i] = list ? tokens.rest() : tokens.next();
+    if (arguments[i].empty()) {
+      arguments[i] = argument.default_value;
+    }
+    auto valid = false;
+    switch (argument.type) {
+    case ArgumentType::Word:
+      valid = is_word(arguments[i]);
+      break;
+    case ArgumentType::Number:
+      valid = is_number(arguments[i]);
+      break;
+    case ArgumentType::Words:
+      valid = is_list(arguments[i], is_word);
+      break;
+    case ArgumentType::Bids:
+      valid = is_list(arguments[i], is_bid);
+      break;
+    case ArgumentType::Keyword:
+      valid = is_keyword(arguments[i], argument.name);
+      break;
+    }
+    if (!valid) {
+      return {};
+    }
+  }
+  return arguments;
+}
 
-class DepositItemCommand : public LimitedAccess {
+// Tries the forms of the command in order, returns the first one whose
+// arguments match the rest of the line
+static std::optional<Command::Variant> parse_forms(const CommandSpec *command,
+                                                   const Tokenizer &tokens) {
+  for (; command != nullptr; command = next_form(command)) {
+    auto rest = tokens;
+    auto arguments = parse_arguments(*command, rest);
+    if (arguments.has_value() && rest.done()) {
+      return command->create(arguments.value());
+    }
+  }
+  return {};
+}
+
+Command Command::parse(const IngressEvent &event) {
+  spdlog::debug("user {}, session {}, parsing command: {}",
+                event.username.value_or(""), event.session_id, event.data);
+
+  Tokenizer tokens{event.data};
+  auto line = tokens;
+  auto command = find_command(tokens);
+  if (auto parsed = parse_forms(command, tokens)) {
+    return parsed.value();
+  }
+  // the second word may be an argument, e.g. SELL MANY 10 sells MANY
+  auto single = find_single_command(line);
+  if (single != command) {
+    if (auto parsed = parse_forms(single, line)) {
+      return parsed.value();
+    }
+  }
+  return Command{commands::Wrong{}};
+}
+
+Command Command::decode(const IngressEvent &event) {
+  FrameReader reader{event.data};
+  try {
+    Variant command = commands::Wrong{};
+    auto opcode = static_cast<Opcode>(reader.read_u8());
+    switch (opcode) {
+    case Opcode::Help:
+      command = commands::Help{};
+      break;
+    case Opcode::Login:
+      command = commands::Login{reader.read_string()};
+      break;
+    case Opcode::Logout:
+      command = commands::Logout{};
+      break;
+    case Opcode::DepositFunds:
+      command = commands::DepositFunds{reader.read_u64()};
+      break;
+    case Opcode::DepositItem:
+      command = commands::DepositItem{reader.read_string()};
+      break;
+    case Opcode::WithdrawFunds:
+      command = commands::WithdrawFunds{reader.read_u64()};
+      break;
+    case Opcode::WithdrawItem:
+      command = commands::WithdrawItem{reader.read_string()};
+      break;
+    case Opcode::Sell: {
+      // the arguments are read in order
+      auto item = reader.read_string();
+      auto price = reader.read_u64();
+      command = commands::Sell{item, price, to_seconds(reader.read_u32())};
+      break;
+    }
+    case Opcode::Bid: {
+      auto auction_id = reader.read_u64();
+      command = commands::Bid{auction_id, reader.read_u64(), false};
+      break;
+    }
+    case Opcode::ShowFunds:
+      command = commands::ShowFunds{};
+      break;
+    case Opcode::ShowItems:
+      command = commands::ShowItems{};
+      break;
+    case Opcode::ShowSales:
+      command = commands::ShowSales{};
+      break;
+    case Opcode::Multi:
+    case Opcode::MultiAtomic:
+      command = commands::Multi{opcode == Opcode::MultiAtomic};
+      break;
+    case Opcode::Exec:
+      command = commands::Exec{};
+      break;
+    case Opcode::Discard:
+      command = commands::Discard{};
+      break;
+    case Opcode::SellMany: {
+      auto price = reader.read_u64();
+      commands::SellMany sell{price, to_seconds(reader.read_u32()), {}};
+      while (!reader.done()) {
+        sell.items.push_back(reader.read_string());
+      }
+      command = std::move(sell);
+      break;
+    }
+    case Opcode::BidMany: {
+      std::vector<std::pair<AuctionId, FundsType>> bids;
+      while (!reader.done()) {
+        auto auction_id = reader.read_u64();
+        bids.emplace_back(auction_id, reader.read_u64());
+      }
+      command = commands::BidMany{std::move(bids)};
+      break;
+    }
+    case Opcode::DepositMany: {
+      commands::DepositMany deposit;
+      while (!reader.done()) {
+        deposit.items.push_back(reader.read_string());
+      }
+      command = std::move(deposit);
+      break;
+    }
+    case Opcode::BidMax: {
+      auto auction_id = reader.read_u64();
+      command = commands::Bid{auction_id, reader.read_u64(), true};
+      break;
+    }
+    }
+    // names are checked like the text ones
+    auto valid_names = std::visit(
+        [](const auto &parsed) {
+          using Type = std::decay_t<decltype(parsed)>;
+          if constexpr (std::is_same_v<Type, commands::Login>) {
+            return is_word(parsed.username);
+          } else if constexpr (std::is_same_v<Type, commands::DepositItem> ||
+                               std::is_same_v<Type, commands::WithdrawItem> ||
+                               std::is_same_v<Type, commands::Sell>) {
+            return is_word(parsed.item);
+          } else if constexpr (std::is_same_v<Type, commands::SellMany> ||
+                               std::is_same_v<Type, commands::DepositMany>) {
+            return !parsed.items.empty() &&
+                   std::all_of(parsed.items.begin(), parsed.items.end(),
+                               is_word);
+          } else if constexpr (std::is_same_v<Type, commands::BidMany>) {
+            return !parsed.bids->empty();
+          }
+          return true;
+        },
+        command);
+    if (reader.done() && valid_names) {
+      return command;
+    }
+  } catch (std::out_of_range &) {
+  }
+  return Command{commands::Wrong{}};
+}
+
+// The command as it's written in the logs, binary frames aren't printable
+static std::string_view describe(const IngressEvent &event) {
+  if (event.protocol == Protocol::Text) {
+    return event.data;
+  }
+  for (auto &command : COMMANDS) {
+    if (!event.data.empty() &&
+        static_cast<std::uint8_t>(command.opcode) ==
+            static_cast<std::uint8_t>(event.data.front())) {
+      return command.keywords;
+    }
+  }
+  return "BINARY FRAME";
+}
+
+// Executes the commands, the ones which need a logged in user get its name
+class Executor {
 public:
-  DepositItemCommand(IngressEvent &&event, std::string &&item)
-      : LimitedAccess(std::move(event)), _item(item) {}
-
-protected:
-  EgressEvent execute_impl(Database &database) override {
-    try {
-      database.accounts.deposit_item(_event.username.value(), _item);
-      spdlog::info("user {}, session {}, deposited item: {} ",
-                   _event.username.value_or(""), _event.session_id, _item);
+  Executor(const IngressEvent &event, Database &database)
+      : _event(event), _database(database) {}
+
+  EgressEvent operator()(const commands::Help &) const {
+    spdlog::info("user {}, session {}, asked for help",
+                 _event.username.value_or(""), _event.session_id);
+    // sent on every connect, all the sessions share the same buffer
+    static const Payload help{"Welcome, available commands:\n" +
+                              render_usage()};
+    return {_event.session_id, help};
+  }
+
+  EgressEvent operator()(const commands::Login &command) const {
+    std::string username{command.username};
+    if (_database.sessions.get_username(_event.session_id)) {
+      spdlog::info("user {}, session {}, reject login second login as {}",
+                   _event.username.value_or(""), _event.session_id, username);
       return {_event.session_id,
-              "Successful deposition of item: " + _item + "!"};
-    } catch (std::bad_optional_access &e) {
-      spdlog::error("user {}, session {}, unexpected error: {}",
-                    _event.username.value_or(""), _event.session_id, e.what());
+              "You are already logged in as " + _event.username.value_or("") +
+                  "!",
+              ResultCode::AlreadyLoggedIn};
+    }
+    if (_database.sessions.login(_event.session_id, username)) {
+      spdlog::info("user {}, session {}, has logged in!",
+                   _event.username.value_or(""), _event.session_id);
+      return {_event.session_id, "Welcome " + username + "!"};
+    }
+    spdlog::info("user {}, session {}, tried to login as {}",
+                 _event.username.value_or(""), _event.session_id, username);
+    return {_event.session_id, "Couldn't login as " + username + "!",
+            ResultCode::LoginFailed};
+  }
+
+  EgressEvent operator()(const commands::Logout &) const {
+    if (_database.sessions.logout(_event.session_id)) {
+      spdlog::info("user {}, session {}, has logged out!",
+                   _event.username.value_or(""), _event.session_id);
       return {_event.session_id,
-              "Deposition of an item has failed! Server error!"};
+              "Good bay, " + _event.username.value_or("") + "!"};
     }
+    return {_event.session_id, "You are not logged in!",
+            ResultCode::NotLoggedIn};
   }
 
-private:
-  std::string _item;
-};
+  // The ingress starts and runs the batches, a batch command gets here only
+  // if it's out of place
+  EgressEvent operator()(const commands::Multi &) const {
+    return {_event.session_id, "Batches can't be nested!",
+            ResultCode::WrongCommand};
+  }
 
-class WithdrawFundsCommand : public LimitedAccess {
-public:
-  WithdrawFundsCommand(IngressEvent &&event, std::string &&amount)
-      : LimitedAccess(std::move(event)), _amount(amount) {}
-
-protected:
-  EgressEvent execute_impl(Database &database) override {
-    try {
-      if (database.accounts.withdraw_funds(_event.username.value(),
-                                           parse_funds(_amount))) {
-        spdlog::info("user {}, session {}, withdrawn funds: {} ",
-                     _event.username.value_or(""), _event.session_id, _amount);
-        return {_event.session_id, "Successfully withdrawn: " + _amount + "!"};
-      } else {
-        spdlog::info("user {}, session {}, tried to withdraw funds: {} ",
-                     _event.username.value_or(""), _event.session_id, _amount);
-        return {_event.session_id,
-                "Withdrawal of funds has failed! Insufficient funds!"};
-      }
-    } catch (std::bad_optional_access &e) {
-      spdlog::error("user {}, session {}, unexpected error: {}",
-                    _event.username.value_or(""), _event.session_id, e.what());
-      return {_event.session_id,
-              "Withdrawal of funds has failed! Server error!"};
-    } catch (std::invalid_argument &) {
-    } catch (std::out_of_range &) {
+  EgressEvent operator()(const commands::Exec &) const {
+    return {_event.session_id, "There is no batch to execute!",
+            ResultCode::WrongCommand};
+  }
+
+  EgressEvent operator()(const commands::Discard &) const {
+    return {_event.session_id, "There is no batch to discard!",
+            ResultCode::WrongCommand};
+  }
+
+  EgressEvent operator()(const commands::Wrong &) const {
+    auto command = _event.protocol == Protocol::Text
+                       ? std::string_view{_event.data}
+                       : std::string_view{"BINARY FRAME"};
+    spdlog::info("user {}, session {}, typed wrong command: {}",
+                 _event.username.value_or(""), _event.session_id, command);
+    return {_event.session_id, "WRONG COMMAND: " + std::string{command},
+            ResultCode::WrongCommand};
+  }
+
+  // The rest of the commands is for logged in users only
+  template <typename Limited>
+  EgressEvent operator()(const Limited &command) const {
+    if (!_event.username.has_value()) {
+      spdlog::info("Not logged in session {}, tried to: {}", _event.session_id,
+                   describe(_event));
+      return {_event.session_id, "You are not logged in!",
+              ResultCode::NotLoggedIn};
+    }
+    return execute(command, _event.username.value());
+  }
+
+private:
+  EgressEvent execute(const commands::DepositFunds &command,
+                      const std::string &username) const {
+    if (command.amount.has_value() &&
+        _database.accounts.deposit_funds(username, command.amount.value())) {
+      spdlog::info("user {}, session {}, deposited funds {} ", username,
+                   _event.session_id, command.amount.value());
+      return {_event.session_id, "Successful deposition of funds: " +
+                                     std::to_string(command.amount.value()) +
+                                     "!"};
     }
     spdlog::warn(
-        "user {}, session {}, tried to withdraw invalid amount of funds!",
-        _event.username.value_or(""), _event.session_id);
+        "user {}, session {}, tried to deposit invalid amount of funds!",
+        username, _event.session_id);
     return {_event.session_id,
-            "Withdrawal of funds has failed! Invalid amount!"};
+            "Deposition of funds has failed! Invalid amount!",
+            ResultCode::InvalidArgument};
   }
 
-private:
-  std::string _amount;
-};
+  EgressEvent execute(const commands::DepositItem &command,
+                      const std::string &username) const {
+    std::string item{command.item};
+    _database.accounts.deposit_item(username, item);
+    spdlog::info("user {}, session {}, deposited item: {} ", username,
+                 _event.session_id, item);
+    return {_event.session_id, "Successful deposition of item: " + item + "!"};
+  }
 
-class WithdrawItemCommand : public LimitedAccess {
-public:
-  WithdrawItemCommand(IngressEvent &&event, std::string &&item)
-      : LimitedAccess(std::move(event)), _item(item) {}
-
-protected:
-  EgressEvent execute_impl(Database &database) override {
-    try {
-      if (database.accounts.withdraw_item(_event.username.value(), _item)) {
-        spdlog::info("user {}, session {}, withdrawn item: {} ",
-                     _event.username.value_or(""), _event.session_id, _item);
-        return {_event.session_id,
-                "Successfully withdrawn item: " + _item + "!"};
-      }
-    } catch (std::bad_optional_access &e) {
-      spdlog::error("user {}, session {}, unexpected error: {}",
-                    _event.username.value_or(""), _event.session_id, e.what());
+  EgressEvent execute(const commands::WithdrawFunds &command,
+                      const std::string &username) const {
+    if (!command.amount.has_value()) {
+      spdlog::warn(
+          "user {}, session {}, tried to withdraw invalid amount of funds!",
+          username, _event.session_id);
+      return {_event.session_id,
+              "Withdrawal of funds has failed! Invalid amount!",
+              ResultCode::InvalidArgument};
+    }
+    auto amount = command.amount.value();
+    if (_database.accounts.withdraw_funds(username, amount)) {
+      spdlog::info("user {}, session {}, withdrawn funds: {} ", username,
+                   _event.session_id, amount);
       return {_event.session_id,
-              "Withdrawal of an item has failed! Server error!"};
+              "Successfully withdrawn: " + std::to_string(amount) + "!"};
     }
-    spdlog::info("user {}, session {}, tried to withdraw item: {} ",
-                 _event.username.value_or(""), _event.session_id, _item);
+    spdlog::info("user {}, session {}, tried to withdraw funds: {} ", username,
+                 _event.session_id, amount);
     return {_event.session_id,
-            "Withdrawal of an item has failed! No such item: " + _item + "!"};
+            "Withdrawal of funds has failed! Insufficient funds!",
+            ResultCode::InsufficientFunds};
   }
 
-private:
-  std::string _item;
-};
-
-class SellItemCommand : public LimitedAccess {
-public:
-  SellItemCommand(IngressEvent &&event, std::string &&item, std::string &&price,
-                  std::string &&time)
-      : LimitedAccess(std::move(event)), _item(item), _price(price),
-        _time(time) {}
+  EgressEvent execute(const commands::WithdrawItem &command,
+                      const std::string &username) const {
+    std::string item{command.item};
+    if (_database.accounts.withdraw_item(username, item)) {
+      spdlog::info("user {}, session {}, withdrawn item: {} ", username,
+                   _event.session_id, item);
+      return {_event.session_id, "Successfully withdrawn item: " + item + "!"};
+    }
+    spdlog::info("user {}, session {}, tried to withdraw item: {} ", username,
+                 _event.session_id, item);
+    return {_event.session_id,
+            "Withdrawal of an item has failed! No such item: " + item + "!",
+            ResultCode::NoSuchItem};
+  }
 
-protected:
-  EgressEvent execute_impl(Database &database) override {
+  EgressEvent execute(const commands::Sell &command,
+                      const std::string &username) const {
+    static constexpr FundsType FEE = 1;
+    std::string item{command.item};
     std::string data{};
-    try {
-      auto &username = _event.username.value();
-      auto price = parse_funds(_price);
-      auto expiration_time =
-          Clock::now() + std::chrono::seconds(std::stoi(_time));
-      if (database.accounts.withdraw_item(username, _item)) {
-        if (database.accounts.withdraw_funds(username, FEE)) {
-          if (database.auctions.add_auction(
-                  {username, {}, price, _item, expiration_time})) {
-            data = "Your item " + _item + " is being auctioned off!";
-          } else {
-            database.accounts.deposit_item(username, _item);
-            database.accounts.deposit_funds(username, FEE);
-            data = "Selling of an item has failed! Server error!";
-          }
-        } else {
-          data = "You can't sell your item, you don't have funds to cover the "
-                 "fee!";
-          database.accounts.deposit_item(username, _item);
-        }
-      } else {
-        data = "You can't sell your item, there is no " + _item + "!";
-      }
-    } catch (std::bad_optional_access &e) {
-      spdlog::error("user {}, session {}, unexpected error: {}",
-                    _event.username.value_or(""), _event.session_id, e.what());
-      data = "Selling of an item has failed! Server error!";
-    } catch (std::invalid_argument &) {
-      data = "You can't sell your item, invalid argument!";
-    } catch (std::out_of_range &) {
+    auto result = ResultCode::Ok;
+    if (!command.price.has_value() || !command.expiration_time.has_value()) {
       data = "You can't sell your item, invalid argument!";
+      result = ResultCode::InvalidArgument;
+    } else if (!_database.accounts.withdraw_item(username, item)) {
+      data = "You can't sell your item, there is no " + item + "!";
+      result = ResultCode::NoSuchItem;
+    } else if (!_database.accounts.withdraw_funds(username, FEE)) {
+      data = "You can't sell your item, you don't have funds to cover the "
+             "fee!";
+      result = ResultCode::InsufficientFunds;
+      _database.accounts.deposit_item(username, item);
+    } else if (_database.auctions.add_auction(
+                   {username, {}, command.price.value(), item,
+                    Clock::now() + std::chrono::seconds(
+                                       command.expiration_time.value())})) {
+      data = "Your item " + item + " is being auctioned off!";
+    } else {
+      _database.accounts.deposit_item(username, item);
+      _database.accounts.deposit_funds(username, FEE);
+      data = "Selling of an item has failed! Server error!";
+      result = ResultCode::ServerError;
     }
 
     spdlog::info("user {}, session {}, put item: {} on sale for {}, it "
                  "will expire in {} seconds, transaction result: {}",
-                 _event.username.value_or(""), _event.session_id, _item, _price,
-                 _time, data);
+                 username, _event.session_id, item,
+                 command.price.value_or(0),
+                 command.expiration_time.value_or(0), data);
 
-    return {_event.session_id, std::move(data)};
+    return {_event.session_id, std::move(data), result};
   }
 
-private:
-  static constexpr FundsType FEE = 1;
-  std::string _item;
-  std::string _price;
-  std::string _time;
-};
-
-class BidItemCommand : public LimitedAccess {
-public:
-  BidItemCommand(IngressEvent &&event, std::string &&auction_id,
-                 std::string &&new_price)
-      : LimitedAccess(std::move(event)), _auction_id(auction_id),
-        _new_price(new_price) {}
-
-protected:
-  EgressEvent execute_impl(Database &database) override {
+  EgressEvent execute(const commands::Bid &command,
+                      const std::string &username) const {
     std::string data{};
-    try {
-      auto &new_buyer = _event.username.value();
-      auto auction_id = std::stoull(_auction_id);
-      auto new_price = parse_funds(_new_price);
+    auto result_code = ResultCode::Ok;
+    if (!command.auction_id.has_value() || !command.price.has_value()) {
+      data = "The bid arguments are invalid!";
+      result_code = ResultCode::InvalidArgument;
+    } else {
+      auto auction_id = std::to_string(command.auction_id.value());
       auto result =
-          database.auctions.bid_item(auction_id, new_price, new_buyer);
+          command.max
+              ? _database.auctions.bid_item_max(command.auction_id.value(),
+                                                command.price.value(), username)
+              : _database.auctions.bid_item(command.auction_id.value(),
+                                            command.price.value(), username);
       switch (result) {
       case BidResult::Successful:
-        data = "You are winning the auction " + _auction_id + "!";
+        data = "You are winning the auction " + auction_id + "!";
         break;
       case BidResult::TooLowPrice:
-        data = "Your offer for the auction " + _auction_id + " was too low!";
+        data = "Your offer for the auction " + auction_id + " was too low!";
+        result_code = ResultCode::TooLowPrice;
         break;
       case BidResult::OwnerBid:
-        data = "You can't bid on the auction " + _auction_id +
+        data = "You can't bid on the auction " + auction_id +
                ", you are the seller!";
+        result_code = ResultCode::OwnerBid;
         break;
       case BidResult::DoesNotExist:
         data = "There is no such auction!";
+        result_code = ResultCode::NoSuchAuction;
         break;
       }
-    } catch (std::bad_optional_access &e) {
-      spdlog::error("user {}, session {}, unexpected error: {}",
-                    _event.username.value_or(""), _event.session_id, e.what());
-      data = "Bidding of an item has failed! Server error!";
-    } catch (std::invalid_argument &) {
-      data = "The bid arguments are invalid!";
-    } catch (std::out_of_range &) {
-      data = "The bid arguments are invalid!";
     }
 
-    spdlog::info("user {}, session {}, bit auction: {} on sale for {}, "
+    spdlog::info("user {}, session {}, bit auction: {} on sale for {}{}, "
                  "transaction result: {}",
-                 _event.username.value_or(""), _event.session_id, _auction_id,
-                 _new_price, data);
+                 username, _event.session_id, command.auction_id.value_or(0),
+                 command.max ? "up to " : "", command.price.value_or(0), data);
 
-    return {_event.session_id, std::move(data)};
+    return {_event.session_id, std::move(data), result_code};
   }
 
-private:
-  std::string _auction_id;
-  std::string _new_price;
-};
-
-class ShowItemsCommand : public LimitedAccess {
-public:
-  ShowItemsCommand(IngressEvent &&event) : LimitedAccess(std::move(event)) {}
-
-protected:
-  EgressEvent execute_impl(Database &database) override {
-    spdlog::info("user {}, session {}, asked for items list",
-                 _event.username.value_or(""), _event.session_id);
-    return {_event.session_id, "Your items:\n" + database.accounts.get_items(
-                                                     _event.username.value())};
-  }
-};
-
-class ShowFundsCommand : public LimitedAccess {
-public:
-  ShowFundsCommand(IngressEvent &&event) : LimitedAccess(std::move(event)) {}
+  EgressEvent execute(const commands::SellMany &command,
+                      const std::string &username) const {
+    static constexpr FundsType FEE = 1;
+    if (!command.price.has_value() || !command.expiration_time.has_value()) {
+      return {_event.session_id,
+              "You can't sell your items, invalid argument!",
+              ResultCode::InvalidArgument};
+    }
+    // the items and fees are taken in one go, the auctions added in another
+    std::vector<ResultCode> results(command.items.size(), ResultCode::Ok);
+    _database.accounts.update(username, [&](UserAccount &account) {
+      for (std::size_t i = 0; i < command.items.size(); ++i) {
+        auto item = std::find(account.items.begin(), account.items.end(),
+                              command.items[i]);
+        if (item == account.items.end()) {
+          results[i] = ResultCode::NoSuchItem;
+        } else if (account.funds < FEE) {
+          results[i] = ResultCode::InsufficientFunds;
+        } else {
+          account.items.erase(item);
+          account.funds -= FEE;
+        }
+      }
+    });
+    auto expiration_time =
+        Clock::now() + std::chrono::seconds(command.expiration_time.value());
+    std::vector<Auction> auctions;
+    for (std::size_t i = 0; i < command.items.size(); ++i) {
+      if (results[i] == ResultCode::Ok) {
+        auctions.push_back({username, {}, command.price.value(),
+                            std::string{command.items[i]}, expiration_time});
+      }
+    }
+    auto ids = _database.auctions.add_auctions(std::move(auctions));
 
-protected:
-  EgressEvent execute_impl(Database &database) override {
-    spdlog::info("user {}, session {}, asked for funds",
-                 _event.username.value_or(""), _event.session_id);
-    return {_event.session_id,
-            "Your funds: " + std::to_string(database.accounts.get_funds(
-                                 _event.username.value()))};
-  }
-};
+    std::string data;
+    std::size_t sold = 0;
+    std::vector<std::string> failed; // given back to the user
+    for (std::size_t i = 0, added = 0; i < command.items.size(); ++i) {
+      data += "\n" + std::string{command.items[i]} + ": ";
+      if (results[i] != ResultCode::Ok) {
+        data += results[i] == ResultCode::NoSuchItem ? "no such item"
+                                                     : "insufficient funds";
+      } else if (auto id = ids[added++]) {
+        data += "auction " + std::to_string(id.value());
+        ++sold;
+      } else {
+        results[i] = ResultCode::ServerError;
+        failed.emplace_back(command.items[i]);
+        data += "server error";
+      }
+    }
+    if (!failed.empty()) {
+      _database.accounts.update(username, [&](UserAccount &account) {
+        account.items.insert(account.items.end(), failed.begin(),
+                             failed.end());
+        account.funds += FEE * failed.size();
+      });
+    }
 
-class ShowSalesCommand : public LimitedAccess {
-public:
-  ShowSalesCommand(IngressEvent &&event) : LimitedAccess(std::move(event)) {}
+    spdlog::info("user {}, session {}, put {} of {} items on sale for {}, "
+                 "they will expire in {} seconds",
+                 username, _event.session_id, sold, command.items.size(),
+                 command.price.value(), command.expiration_time.value());
 
-protected:
-  EgressEvent execute_impl(Database &database) override {
-    spdlog::info("user {}, session {}, asked for sales",
-                 _event.username.value_or(""), _event.session_id);
-    auto auctions = database.auctions.get_printable_list();
     return {_event.session_id,
-            "SALES:\n" + std::accumulate(auctions.begin(), auctions.end(),
-                                         std::string{}, [](auto &a, auto &b) {
-                                           if (a.empty()) {
-                                             return b;
-                                           }
-                                           return a + "\n" + b;
-                                         })};
+            "Auctioned off " + std::to_string(sold) + " of " +
+                std::to_string(command.items.size()) + " items:" + data,
+            first_failure(results)};
   }
-};
 
-class WrongCommand : public Command {
-public:
-  WrongCommand(IngressEvent &&event) : Command(std::move(event)) {}
-
-  EgressEvent execute(Database &) override {
-    spdlog::info("user {}, session {}, typed wrong command: {}",
-                 _event.username.value_or(""), _event.session_id, _event.data);
-    return {_event.session_id, _event.data.insert(0, "WRONG COMMAND: ")};
-  }
-};
-
-CommandPtr Command::parse(IngressEvent &&event) {
-  std::smatch matches{};
-
-  spdlog::debug("user {}, session {}, parsing command: {}",
-                event.username.value_or(""), event.session_id, event.data);
-
-  if (std::regex_match(event.data, help_regex)) {
-    return CommandPtr{new HelpCommand{std::move(event)}};
-  }
+  EgressEvent execute(const commands::BidMany &command,
+                      const std::string &username) const {
+    if (!command.bids.has_value()) {
+      return {_event.session_id, "The bid arguments are invalid!",
+              ResultCode::InvalidArgument};
+    }
+    auto &bids = command.bids.value();
+    auto results = _database.auctions.bid_items(bids, username);
 
-  if (std::regex_match(event.data, matches, login_regex)) {
-    return CommandPtr{new LoginCommand{std::move(event), matches[2].str()}};
-  }
+    std::string data;
+    std::size_t winning = 0;
+    std::vector<ResultCode> codes;
+    codes.reserve(results.size());
+    for (std::size_t i = 0; i < bids.size(); ++i) {
+      data += "\n" + std::to_string(bids[i].first) + ": ";
+      switch (results[i]) {
+      case BidResult::Successful:
+        data += "winning";
+        codes.push_back(ResultCode::Ok);
+        ++winning;
+        break;
+      case BidResult::TooLowPrice:
+        data += "too low price";
+        codes.push_back(ResultCode::TooLowPrice);
+        break;
+      case BidResult::OwnerBid:
+        data += "you are the seller";
+        codes.push_back(ResultCode::OwnerBid);
+        break;
+      case BidResult::DoesNotExist:
+        data += "no such auction";
+        codes.push_back(ResultCode::NoSuchAuction);
+        break;
+      }
+    }
 
-  if (std::regex_match(event.data, logout_regex)) {
-    return CommandPtr{new LogoutCommand{std::move(event)}};
-  }
+    spdlog::info("user {}, session {}, is winning {} of {} bid auctions",
+                 username, _event.session_id, winning, bids.size());
 
-  if (std::regex_match(event.data, matches, deposit_funds_regex)) {
-    return CommandPtr{
-        new DepositFundsCommand{std::move(event), matches[3].str()}};
+    return {_event.session_id,
+            "Winning " + std::to_string(winning) + " of " +
+                std::to_string(bids.size()) + " auctions:" + data,
+            first_failure(codes)};
   }
 
-  if (std::regex_match(event.data, matches, deposit_item_regex)) {
-    return CommandPtr{
-        new DepositItemCommand{std::move(event), matches[3].str()}};
+  EgressEvent execute(const commands::DepositMany &command,
+                      const std::string &username) const {
+    _database.accounts.update(username, [&](UserAccount &account) {
+      account.items.insert(account.items.end(), command.items.begin(),
+                           command.items.end());
+    });
+    spdlog::info("user {}, session {}, deposited {} items", username,
+                 _event.session_id, command.items.size());
+    return {_event.session_id, "Successful deposition of " +
+                                   std::to_string(command.items.size()) +
+                                   " items!"};
   }
 
-  if (std::regex_match(event.data, matches, withdraw_funds_regex)) {
-    return CommandPtr{
-        new WithdrawFundsCommand{std::move(event), matches[3].str()}};
+  // The result of a bulk command is the one of its first failed item
+  static ResultCode first_failure(const std::vector<ResultCode> &results) {
+    auto failed = std::find_if(results.begin(), results.end(), [](auto result) {
+      return result != ResultCode::Ok;
+    });
+    return failed == results.end() ? ResultCode::Ok : *failed;
   }
 
-  if (std::regex_match(event.data, matches, withdraw_item_regex)) {
-    return CommandPtr{
-        new WithdrawItemCommand{std::move(event), matches[3].str()}};
+  EgressEvent execute(const commands::ShowItems &,
+                      const std::string &username) const {
+    spdlog::info("user {}, session {}, asked for items list", username,
+                 _event.session_id);
+    if (_event.protocol == Protocol::Binary) {
+      auto account = _database.accounts.get_account(username);
+      ReplyWriter reply;
+      if (!account.has_value()) {
+        return {_event.session_id, reply.write_u32(0).data()};
+      }
+      reply.write_u32(static_cast<std::uint32_t>(account->items.size()));
+      for (auto &item : account->items) {
+        reply.write_string(item);
+      }
+      return {_event.session_id, reply.data()};
+    }
+    return {_event.session_id,
+            "Your items:\n" + _database.accounts.get_items(username)};
   }
 
-  if (std::regex_match(event.data, matches, sell_regex)) {
-    auto time =
-        matches.size() > 4 ? matches[4].str() : "300"; // default 5 minutes
-    return CommandPtr{new SellItemCommand{std::move(event), matches[2].str(),
-                                          matches[3].str(), std::move(time)}};
+  EgressEvent execute(const commands::ShowFunds &,
+                      const std::string &username) const {
+    spdlog::info("user {}, session {}, asked for funds", username,
+                 _event.session_id);
+    auto funds = _database.accounts.get_funds(username);
+    if (_event.protocol == Protocol::Binary) {
+      return {_event.session_id, ReplyWriter{}.write_u64(funds).data()};
+    }
+    return {_event.session_id, "Your funds: " + std::to_string(funds)};
   }
 
-  if (std::regex_match(event.data, matches, bid_regex)) {
-    return CommandPtr{new BidItemCommand{std::move(event), matches[2].str(),
-                                         matches[3].str()}};
+  EgressEvent execute(const commands::ShowSales &,
+                      const std::string &username) const {
+    spdlog::info("user {}, session {}, asked for sales", username,
+                 _event.session_id);
+    if (_event.protocol == Protocol::Binary) {
+      return {_event.session_id, sales_reply()};
+    }
+    auto auctions = _database.auctions.get_printable_list();
+    return {_event.session_id,
+            "SALES:\n" + std::accumulate(auctions.begin(), auctions.end(),
+                                         std::string{}, [](auto &a, auto &b) {
+                                           if (a.empty()) {
+                                             return b;
+                                           }
+                                           return a + "\n" + b;
+                                         })};
   }
 
-  if (std::regex_match(event.data, matches, show_funds_regex)) {
-    return CommandPtr{new ShowFundsCommand{std::move(event)}};
+  // The auctions with the seconds left until they expire
+  std::string sales_reply() const {
+    auto auctions = _database.auctions.snapshot().auctions;
+    auto now = Clock::now();
+    ReplyWriter reply;
+    reply.write_u32(static_cast<std::uint32_t>(auctions.size()));
+    for (auto &[id, auction] : auctions) {
+      auto left = std::chrono::duration_cast<std::chrono::seconds>(
+          auction.expiration_time - now);
+      reply.write_u64(id)
+          .write_string(auction.item)
+          .write_string(auction.owner)
+          .write_u64(auction.price)
+          .write_string(auction.buyer.value_or(""))
+          .write_u32(static_cast<std::uint32_t>(
+              std::max<std::int64_t>(left.count(), 0)));
+    }
+    return reply.data();
   }
 
-  if (std::regex_match(event.data, matches, show_items_regex)) {
-    return CommandPtr{new ShowItemsCommand{std::move(event)}};
-  }
+  const IngressEvent &_event;
+  Database &_database;
+};
 
-  if (std::regex_match(event.data, matches, show_sales_regex)) {
-    return CommandPtr{new ShowSalesCommand{std::move(event)}};
+void Command::rebase(const std::string_view from, const char *to) {
+  if (from.data() == to) {
+    return;
   }
+  // the default arguments aren't views of the data
+  auto rebase_view = [from, to](std::string_view &view) {
+    std::less_equal<const char *> before;
+    if (before(from.data(), view.data()) &&
+        before(view.data() + view.size(), from.data() + from.size())) {
+      view = {to + (view.data() - from.data()), view.size()};
+    }
+  };
+  std::visit(
+      [&rebase_view](auto &command) {
+        using Type = std::decay_t<decltype(command)>;
+        if constexpr (std::is_same_v<Type, commands::Login>) {
+          rebase_view(command.username);
+        } else if constexpr (std::is_same_v<Type, commands::DepositItem> ||
+                             std::is_same_v<Type, commands::WithdrawItem> ||
+                             std::is_same_v<Type, commands::Sell>) {
+          rebase_view(command.item);
+        } else if constexpr (std::is_same_v<Type, commands::SellMany> ||
+                             std::is_same_v<Type, commands::DepositMany>) {
+          for (auto &item : command.items) {
+            rebase_view(item);
+          }
+        }
+      },
+      _command);
+}
 
-  return CommandPtr{new WrongCommand{std::move(event)}};
+EgressEvent Command::execute(const IngressEvent &event,
+                             Database &database) const {
+  return std::visit(Executor{event, database}, _command);
 }
-} // namespace auction_house::engine
\ No newline at end of file
+} // namespace auction_house::engine
@@ -0,0 +1,499 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#include "epoll_reactor.h"
+#include <spdlog/spdlog.h>
+#include <sys/types.h>
+#include <algorithm>
+#ifndef WIN32
+#include <arpa/inet.h>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifdef WIN32
+#define close(a) closesocket(a)
+using socklen_t = int;
+#endif
+
+namespace auction_house::network {
+#ifndef WIN32
+static bool set_non_blocking(const ConnectionId connection) {
+  auto flags = fcntl(connection, F_GETFL, 0);
+  return flags != -1 && fcntl(connection, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+#endif
+
+#ifndef WIN32
+void EpollReactor::_init_epoll() {
+  _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (_epoll_fd == INVALID_CONNECTION) {
+    spdlog::error("Couldn't create an epoll instance!");
+    std::exit(1);
+  }
+
+  // other threads wake the reactor up when they hand over replies
+  _wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  epoll_event wakeup_event{};
+  wakeup_event.events = EPOLLIN;
+  wakeup_event.data.fd = _wakeup_fd;
+  if (_wakeup_fd == INVALID_CONNECTION ||
+      epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wakeup_fd, &wakeup_event) ==
+          SOCKET_ERROR) {
+    spdlog::error("Couldn't create a wakeup event!");
+    std::exit(1);
+  }
+}
+#endif
+
+ConnectionId EpollReactor::init_server_socket(const uint16_t port) {
+  return _add_listener(create_server_socket(port, _options));
+}
+
+ConnectionId EpollReactor::init_unix_server_socket(const std::string &path) {
+  auto server_fd = create_unix_server_socket(path, _options);
+  #ifndef WIN32
+  _local_listeners.insert(server_fd);
+  #endif
+  return _add_listener(server_fd);
+}
+
+ConnectionId EpollReactor::_add_listener(const ConnectionId server_fd) {
+  #ifndef WIN32
+  if (_epoll_fd == INVALID_CONNECTION) {
+    _init_epoll();
+  }
+
+  // The listener stays level-triggered, it's drained up to MAX_ACCEPTS
+  // clients per wakeup and the rest is reported by the next epoll_wait
+  epoll_event server_event{};
+  server_event.events = EPOLLIN;
+  server_event.data.fd = server_fd;
+  if (!set_non_blocking(server_fd) ||
+      epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, server_fd, &server_event) ==
+          SOCKET_ERROR) {
+    spdlog::error("Couldn't register the server socket!");
+    std::exit(1);
+  }
+  #else
+  if (_max_connection_id == INVALID_CONNECTION) {
+    FD_ZERO(&_read_fds);
+    FD_ZERO(&_connected_fds);
+  }
+  FD_SET(server_fd, &_connected_fds);
+  _max_connection_id = max(_max_connection_id, server_fd);
+  #endif
+
+  return server_fd;
+}
+
+#ifndef WIN32
+bool EpollReactor::_add_connection(const ConnectionId connection,
+                                   const bool tcp) {
+  if (_epoll_fd == INVALID_CONNECTION) {
+    _init_epoll();
+  }
+  epoll_event client_event{};
+  client_event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  client_event.data.fd = connection;
+  if ((tcp && !configure_connection(connection, _options)) ||
+      epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, connection, &client_event) ==
+          SOCKET_ERROR) {
+    return false;
+  }
+  _connections[connection];
+  return true;
+}
+
+// Tells a Unix domain socket apart from a TCP one
+static bool is_local(const ConnectionId connection) {
+  sockaddr_storage address{};
+  socklen_t size = sizeof(address);
+  return getsockname(connection, reinterpret_cast<sockaddr *>(&address),
+                     &size) == 0 &&
+         address.ss_family == AF_UNIX;
+}
+#endif
+
+bool EpollReactor::adopt_server_socket(const ConnectionId server_fd) {
+  #ifndef WIN32
+  if (is_local(server_fd)) {
+    _local_listeners.insert(server_fd);
+  }
+  _add_listener(server_fd);
+  return true;
+  #else
+  return false;
+  #endif
+}
+
+bool EpollReactor::adopt_connection(const ConnectionId connection,
+                                    const std::string &output) {
+  #ifndef WIN32
+  // a socket with pending input is reported by the first epoll_wait
+  if (!set_non_blocking(connection) ||
+      !_add_connection(connection, !is_local(connection))) {
+    spdlog::error("Couldn't register an inherited connection {}!",
+                  connection);
+    return false;
+  }
+  if (!output.empty()) {
+    _connections[connection].output.push(output);
+    _flush(connection);
+  }
+  return true;
+  #else
+  return false;
+  #endif
+}
+
+std::optional<std::string>
+EpollReactor::release_connection(const ConnectionId connection) {
+  #ifndef WIN32
+  // replies handed over meanwhile are released together with the connection
+  _take_outgoing();
+  auto connection_it = _connections.find(connection);
+  if (connection_it == _connections.end()) {
+    return {};
+  }
+  std::string output;
+  auto &queue = connection_it->second.output;
+  output.reserve(queue.size());
+  while (!queue.empty()) {
+    auto piece = queue.front();
+    output.append(piece);
+    queue.consume(piece.size());
+  }
+  epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, connection, nullptr);
+  _connections.erase(connection_it);
+  _resumed.erase(std::remove(_resumed.begin(), _resumed.end(), connection),
+                 _resumed.end());
+  return output;
+  #else
+  return {};
+  #endif
+}
+
+void EpollReactor::close_connection(const ConnectionId connection) {
+  spdlog::info("Closing connection {}!", connection);
+  // closing the descriptor removes it from the epoll set as well
+  close(connection);
+  #ifndef WIN32
+  _connections.erase(connection);
+  _resumed.erase(std::remove(_resumed.begin(), _resumed.end(), connection),
+                 _resumed.end());
+  #else
+  FD_CLR(connection, &_connected_fds);
+  #endif
+}
+
+std::vector<ConnectionId>
+EpollReactor::handle_new_connections(const ConnectionId server_fd) {
+  std::vector<ConnectionId> accepted;
+  #ifndef WIN32
+  auto tcp = _local_listeners.count(server_fd) == 0;
+  while (accepted.size() < MAX_ACCEPTS) {
+    sockaddr_in client_address{};
+    socklen_t sin_size = sizeof(sockaddr_in);
+    auto client_fd =
+        accept4(server_fd, reinterpret_cast<sockaddr *>(&client_address),
+                &sin_size, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd == SOCKET_ERROR) {
+      // the client has given up while waiting in the queue
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        spdlog::error("Accepting a new connection has failed: {}!",
+                      std::strerror(errno));
+      }
+      break;
+    }
+
+    if (tcp) {
+      char address_buffer[INET_ADDRSTRLEN];
+      inet_ntop(AF_INET, &(client_address.sin_addr), address_buffer,
+                INET_ADDRSTRLEN);
+      spdlog::info("Received new connection from {}:{}",
+                   std::string(address_buffer, std::strlen(address_buffer)),
+                   htons(client_address.sin_port));
+    } else {
+      spdlog::info("Received new local connection {}", client_fd);
+    }
+
+    if (!_add_connection(client_fd, tcp)) {
+      spdlog::error("Couldn't register a new connection {}!", client_fd);
+      close(client_fd);
+      continue;
+    }
+    accepted.push_back(client_fd);
+  }
+  #else
+  sockaddr_in client_address{};
+  socklen_t sin_size = sizeof(sockaddr_in);
+  auto client_fd = accept(
+      server_fd, reinterpret_cast<sockaddr *>(&client_address), &sin_size);
+  if (client_fd == SOCKET_ERROR) {
+    spdlog::error("Accepting a new connection has failed!");
+    return accepted;
+  }
+  configure_connection(client_fd, _options);
+  FD_SET(client_fd, &_connected_fds);
+  _max_connection_id = max(_max_connection_id, client_fd);
+  accepted.push_back(client_fd);
+  #endif
+  return accepted;
+}
+
+ReceivedData EpollReactor::receive_data(const ConnectionId connection) {
+  ReceivedData result{};
+  #ifdef WIN32
+  if (!FD_ISSET(connection, &_read_fds)) {
+    return result;
+  }
+  #endif
+  spdlog::debug("Receiving data for connection {}", connection);
+  std::array<char, 1024> buffer;
+  for (;;) {
+    auto n_bytes = recv(connection, buffer.data(), buffer.size(), 0);
+    if (n_bytes > 0) {
+      result.data.append(buffer.data(), n_bytes);
+      #ifdef WIN32
+      // select is level-triggered, the rest is read on the next wakeup
+      break;
+      #else
+      // the edge has been consumed, the rest is served with the next traffic
+      if (result.data.size() >= MAX_READ_BYTES) {
+        _resumed.push_back(connection);
+        break;
+      }
+      continue;
+      #endif
+    }
+    if (n_bytes == 0) {
+      result.hung_up = true;
+    }
+    #ifndef WIN32
+    else if (errno == EINTR) {
+      continue;
+    } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      spdlog::error("Something went wrong while reading data for connection {}",
+                    connection);
+      result.hung_up = true;
+    }
+    #else
+    else {
+      spdlog::error("Something went wrong while reading data for connection {}",
+                    connection);
+      result.hung_up = true;
+    }
+    #endif
+    break;
+  }
+  return result;
+}
+
+std::vector<ConnectionId> EpollReactor::wait_for_traffic(
+    const std::optional<std::chrono::milliseconds> timeout) {
+  spdlog::debug("Waiting for incoming connections/data!");
+  std::vector<ConnectionId> ready{};
+  #ifndef WIN32
+  // replies handed over while the previous batch was being served
+  _take_outgoing();
+  auto timeout_ms =
+      timeout.has_value() ? static_cast<int>(timeout->count()) : -1;
+  if (!_resumed.empty()) {
+    timeout_ms = 0; // connections with unread input don't wait for new edges
+  }
+  auto n_events =
+      epoll_wait(_epoll_fd, _events.data(), _events.size(), timeout_ms);
+  if (n_events == SOCKET_ERROR) {
+    if (errno != EINTR) {
+      spdlog::error("Waiting for incoming connections/data has failed!");
+    }
+    return ready;
+  }
+  ready.reserve(n_events);
+  auto woken_up = false;
+  for (auto i = 0; i < n_events; ++i) {
+    auto connection = _events[i].data.fd;
+    if (connection == _wakeup_fd) {
+      std::uint64_t value;
+      while (read(_wakeup_fd, &value, sizeof(value)) > 0) {
+      }
+      woken_up = true;
+      continue;
+    }
+    if (_events[i].events & EPOLLOUT) {
+      _flush(connection);
+    }
+    auto connection_it = _connections.find(connection);
+    if (connection_it != _connections.end() && connection_it->second.paused) {
+      continue; // the input is read once the connection is resumed
+    }
+    if (_events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+      ready.push_back(connection);
+    }
+  }
+  if (woken_up) {
+    _take_outgoing();
+  }
+  // edges of paused connections have been swallowed, they are served anyway,
+  // as well as the ones read only partially; a connection paused meanwhile is
+  // added again once it's resumed
+  for (auto connection : _resumed) {
+    auto connection_it = _connections.find(connection);
+    if (connection_it != _connections.end() && !connection_it->second.paused) {
+      ready.push_back(connection);
+    }
+  }
+  _resumed.clear();
+  std::sort(ready.begin(), ready.end());
+  ready.erase(std::unique(ready.begin(), ready.end()), ready.end());
+  #else
+  _read_fds = _connected_fds;
+  timeval select_timeout{};
+  if (timeout.has_value()) {
+    select_timeout.tv_sec = static_cast<long>(timeout->count() / 1000);
+    select_timeout.tv_usec = static_cast<long>(timeout->count() % 1000 * 1000);
+  }
+  if ((select(_max_connection_id + 1, &_read_fds, nullptr, nullptr,
+              timeout.has_value() ? &select_timeout : nullptr)) ==
+      SOCKET_ERROR) {
+    spdlog::error("Waiting for incoming connections/data has failed!");
+    return ready;
+  }
+  for (u_int i = 0; i < _read_fds.fd_count; ++i) {
+    ready.push_back(_read_fds.fd_array[i]);
+  }
+  #endif
+  return ready;
+}
+
+void EpollReactor::send_data(ConnectionId connection, Reply reply) {
+  #ifndef WIN32
+  // the ingress thread is woken up once per batch of replies
+  if (_outbox.push(connection, std::move(reply))) {
+    wake_up();
+  }
+  #else
+  OutputQueue output;
+  output.push_response(std::move(reply));
+  while (!output.empty()) {
+    auto piece = output.front();
+    auto n_bytes = send(connection, piece.data(), piece.size(), 0);
+    if (n_bytes == SOCKET_ERROR) {
+      spdlog::warn("Sending data for connection {} has failed", connection);
+      return;
+    }
+    output.consume(n_bytes);
+  }
+  #endif
+}
+
+void EpollReactor::wake_up() {
+  #ifndef WIN32
+  std::uint64_t value = 1;
+  if (write(_wakeup_fd, &value, sizeof(value)) == SOCKET_ERROR) {
+    spdlog::error("Couldn't wake up the epoll reactor!");
+  }
+  #endif
+}
+
+#ifndef WIN32
+void EpollReactor::_take_outgoing() {
+  std::vector<ConnectionId> touched;
+  for (auto &[connection, reply] : _outbox.take()) {
+    auto connection_it = _connections.find(connection);
+    if (connection_it == _connections.end()) {
+      spdlog::debug("Dropping data for closed connection {}", connection);
+      continue;
+    }
+    if (connection_it->second.output.empty()) {
+      touched.push_back(connection);
+    }
+    connection_it->second.output.push_response(std::move(reply));
+  }
+  // all replies queued for a connection go out in one syscall
+  for (auto connection : touched) {
+    _flush(connection);
+    _enforce_limit(connection, _connections.at(connection));
+  }
+}
+
+void EpollReactor::_enforce_limit(const ConnectionId connection,
+                                  Connection &state) {
+  if (state.paused || state.output.size() <= _limit.max_pending_bytes) {
+    return;
+  }
+  switch (_limit.policy) {
+  case SlowClientPolicy::PauseReading:
+    state.paused = true;
+    spdlog::warn("Connection {} has {} bytes waiting, pausing reading ({} "
+                 "paused so far)",
+                 connection, state.output.size(), ++_paused_count);
+    break;
+  case SlowClientPolicy::Disconnect:
+    // the session is ended when the hang up is reported
+    spdlog::warn("Connection {} has {} bytes waiting, disconnecting ({} "
+                 "disconnected so far)",
+                 connection, state.output.size(), ++_disconnected_count);
+    state.output = {};
+    shutdown(connection, SHUT_RDWR);
+    break;
+  }
+}
+
+void EpollReactor::_flush(const ConnectionId connection) {
+  auto connection_it = _connections.find(connection);
+  if (connection_it == _connections.end()) {
+    return;
+  }
+  auto &state = connection_it->second;
+  auto &output = state.output;
+  std::array<iovec, MAX_IOVECS> iovecs;
+  while (!output.empty()) {
+    msghdr message{};
+    message.msg_iov = iovecs.data();
+    message.msg_iovlen = output.gather(iovecs.data(), iovecs.size());
+    // sendmsg is a writev which doesn't raise SIGPIPE
+    auto n_bytes = sendmsg(connection, &message, MSG_NOSIGNAL);
+    if (n_bytes >= 0) {
+      output.consume(n_bytes);
+    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+      break; // the rest is sent on EPOLLOUT
+    } else if (errno != EINTR) {
+      spdlog::warn("Sending data for connection {} has failed", connection);
+      output = {};
+    }
+  }
+  if (state.paused && output.size() <= _limit.max_pending_bytes / 2) {
+    spdlog::info("Connection {} has drained its output, resuming reading",
+                 connection);
+    state.paused = false;
+    _resumed.push_back(connection);
+  }
+}
+#endif
+
+EgressStats EpollReactor::egress_stats() const {
+  return {_paused_count.load(std::memory_order_relaxed),
+          _disconnected_count.load(std::memory_order_relaxed)};
+}
+
+EpollReactor::~EpollReactor() {
+  #ifndef WIN32
+  if (_epoll_fd != INVALID_CONNECTION) {
+    close(_epoll_fd);
+  }
+  if (_wakeup_fd != INVALID_CONNECTION) {
+    close(_wakeup_fd);
+  }
+  #endif
+}
+} // namespace auction_house::network
@@ -0,0 +1,500 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#include "handoff.h"
+#include "database.h"
+#include "network.h"
+#include "tasks_executor.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <future>
+#include <optional>
+#include <spdlog/spdlog.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+namespace auction_house::engine {
+constexpr std::uint32_t HANDOFF_MAGIC = 0x33484841; // "AHH3"
+constexpr std::size_t HEADER_SIZE = 16;
+constexpr std::size_t MAX_FDS_PER_MESSAGE = 253; // SCM_MAX_FD
+constexpr std::size_t MAX_CHUNK_SIZE = 32 * 1024;
+// a side which doesn't hear from the other one for so long gives up
+constexpr std::chrono::seconds HANDOFF_TIMEOUT{30};
+// the successor is ready to serve, the old server confirms before exiting
+constexpr char READY = 'R';
+constexpr char CONFIRMED = 'C';
+
+// Integers are little-endian, strings are prefixed with their u32 length
+class StateWriter {
+public:
+  StateWriter &write_u8(const std::uint8_t value) {
+    return _write_integer(value, 1);
+  }
+  StateWriter &write_u32(const std::uint32_t value) {
+    return _write_integer(value, 4);
+  }
+  StateWriter &write_u64(const std::uint64_t value) {
+    return _write_integer(value, 8);
+  }
+  StateWriter &write_string(std::string_view value) {
+    write_u32(static_cast<std::uint32_t>(value.size()));
+    _data.append(value);
+    return *this;
+  }
+  StateWriter &write_optional(const std::optional<std::string> &value) {
+    write_u8(value.has_value());
+    return value.has_value() ? write_string(value.value()) : *this;
+  }
+
+  std::string &data() { return _data; }
+
+private:
+  StateWriter &_write_integer(std::uint64_t value, const std::size_t size) {
+    for (std::size_t i = 0; i < size; ++i, value >>= 8) {
+      _data.push_back(static_cast<char>(value & 0xff));
+    }
+    return *this;
+  }
+
+  std::string _data;
+};
+
+// Reads what StateWriter has written, throws std::out_of_range when the data
+// is too short
+class StateReader {
+public:
+  explicit StateReader(std::string_view data) : _data(data) {}
+
+  std::uint8_t read_u8() {
+    return static_cast<std::uint8_t>(_read_integer(1));
+  }
+  std::uint32_t read_u32() {
+    return static_cast<std::uint32_t>(_read_integer(4));
+  }
+  std::uint64_t read_u64() { return _read_integer(8); }
+  std::string read_string() {
+    auto size = read_u32();
+    if (_data.size() < size) {
+      throw std::out_of_range{"The handoff state is too short!"};
+    }
+    std::string value{_data.substr(0, size)};
+    _data.remove_prefix(size);
+    return value;
+  }
+  std::optional<std::string> read_optional() {
+    if (read_u8() == 0) {
+      return {};
+    }
+    return read_string();
+  }
+
+private:
+  std::uint64_t _read_integer(const std::size_t size) {
+    if (_data.size() < size) {
+      throw std::out_of_range{"The handoff state is too short!"};
+    }
+    std::uint64_t value = 0;
+    for (std::size_t i = 0; i < size; ++i) {
+      value |= static_cast<std::uint64_t>(static_cast<unsigned char>(_data[i]))
+               << (8 * i);
+    }
+    _data.remove_prefix(size);
+    return value;
+  }
+
+  std::string_view _data;
+};
+
+std::string serialize_state(const HandoffState &state) {
+  StateWriter writer;
+  writer.write_u32(static_cast<std::uint32_t>(state.ingress.listeners.size()));
+  for (auto &listener : state.ingress.listeners) {
+    writer.write_u8(static_cast<std::uint8_t>(listener.kind));
+  }
+  writer.write_u32(
+      static_cast<std::uint32_t>(state.ingress.connections.size()));
+  for (auto &connection : state.ingress.connections) {
+    writer.write_u32(connection.session_id)
+        .write_u8(static_cast<std::uint8_t>(connection.protocol))
+        .write_optional(connection.username)
+        .write_string(connection.input)
+        .write_string(connection.output)
+        .write_string(connection.batch);
+  }
+  writer.write_u32(static_cast<std::uint32_t>(state.accounts.size()));
+  for (auto &[username, account] : state.accounts) {
+    writer.write_string(username)
+        .write_u64(account.funds)
+        .write_u32(static_cast<std::uint32_t>(account.items.size()));
+    for (auto &item : account.items) {
+      writer.write_string(item);
+    }
+  }
+  writer.write_u64(state.auctions.next_id)
+      .write_u32(static_cast<std::uint32_t>(state.auctions.auctions.size()));
+  for (auto &[id, auction] : state.auctions.auctions) {
+    auto expiration = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        auction.expiration_time.time_since_epoch());
+    writer.write_u64(id)
+        .write_string(auction.owner)
+        .write_optional(auction.buyer)
+        .write_u64(auction.price)
+        .write_string(auction.item)
+        .write_u64(static_cast<std::uint64_t>(expiration.count()))
+        .write_u64(auction.max_price);
+  }
+  return std::move(writer.data());
+}
+
+HandoffState deserialize_state(std::string_view data) {
+  StateReader reader{data};
+  HandoffState state;
+  for (auto count = reader.read_u32(); count > 0; --count) {
+    state.ingress.listeners.push_back(
+        {network::INVALID_CONNECTION,
+         static_cast<ListenerKind>(reader.read_u8())});
+  }
+  for (auto count = reader.read_u32(); count > 0; --count) {
+    // a braced list is evaluated in order
+    state.ingress.connections.push_back(
+        {network::INVALID_CONNECTION, reader.read_u32(),
+         static_cast<Protocol>(reader.read_u8()), reader.read_optional(),
+         reader.read_string(), reader.read_string(), reader.read_string()});
+  }
+  for (auto count = reader.read_u32(); count > 0; --count) {
+    auto username = reader.read_string();
+    auto &account = state.accounts[username];
+    account.funds = reader.read_u64();
+    for (auto items = reader.read_u32(); items > 0; --items) {
+      account.items.push_back(reader.read_string());
+    }
+  }
+  state.auctions.next_id = reader.read_u64();
+  for (auto count = reader.read_u32(); count > 0; --count) {
+    auto id = reader.read_u64();
+    auto &auction = state.auctions.auctions[id];
+    auction.owner = reader.read_string();
+    auction.buyer = reader.read_optional();
+    auction.price = reader.read_u64();
+    auction.item = reader.read_string();
+    auction.expiration_time = TimePoint{std::chrono::duration_cast<
+        Clock::duration>(std::chrono::nanoseconds{
+        static_cast<std::int64_t>(reader.read_u64())})};
+    auction.max_price = reader.read_u64();
+  }
+  return state;
+}
+
+// Sends a message of the SOCK_SEQPACKET socket with up to
+// MAX_FDS_PER_MESSAGE descriptors attached
+static bool send_message(const int socket, std::string_view data,
+                         const int *fds, const std::size_t count) {
+  alignas(cmsghdr) char control[CMSG_SPACE(MAX_FDS_PER_MESSAGE * sizeof(int))];
+  iovec iov{const_cast<char *>(data.data()), data.size()};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  if (count > 0) {
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(count * sizeof(int));
+    auto *cmsg = CMSG_FIRSTHDR(&message);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(count * sizeof(int));
+    std::memcpy(CMSG_DATA(cmsg), fds, count * sizeof(int));
+  }
+  ssize_t sent;
+  do {
+    sent = sendmsg(socket, &message, MSG_NOSIGNAL);
+  } while (sent == -1 && errno == EINTR);
+  return sent == static_cast<ssize_t>(data.size());
+}
+
+// Receives a single message, appends the attached descriptors, returns the
+// size of the message or -1 on failure
+static ssize_t receive_message(const int socket, char *buffer,
+                               const std::size_t size, std::vector<int> &fds) {
+  alignas(cmsghdr) char control[CMSG_SPACE(MAX_FDS_PER_MESSAGE * sizeof(int))];
+  iovec iov{buffer, size};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  ssize_t received;
+  do {
+    received = recvmsg(socket, &message, MSG_CMSG_CLOEXEC);
+  } while (received == -1 && errno == EINTR);
+  for (auto *cmsg = CMSG_FIRSTHDR(&message); received > 0 && cmsg != nullptr;
+       cmsg = CMSG_NXTHDR(&message, cmsg)) {
+    if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+      auto count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+      auto first = fds.size();
+      fds.resize(first + count);
+      std::memcpy(fds.data() + first, CMSG_DATA(cmsg), count * sizeof(int));
+    }
+  }
+  if (message.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+    return -1;
+  }
+  return received;
+}
+
+// The header, then the descriptors in batches and the state in chunks
+static bool send_handoff(const int socket, const std::string &state,
+                         const std::vector<int> &fds) {
+  StateWriter header;
+  header.write_u32(HANDOFF_MAGIC)
+      .write_u32(static_cast<std::uint32_t>(fds.size()))
+      .write_u64(state.size());
+  if (!send_message(socket, header.data(), nullptr, 0)) {
+    return false;
+  }
+  for (std::size_t sent = 0; sent < fds.size();) {
+    auto count = std::min(MAX_FDS_PER_MESSAGE, fds.size() - sent);
+    if (!send_message(socket, "F", fds.data() + sent, count)) {
+      return false;
+    }
+    sent += count;
+  }
+  std::string_view data{state};
+  while (!data.empty()) {
+    auto chunk = data.substr(0, MAX_CHUNK_SIZE);
+    if (!send_message(socket, chunk, nullptr, 0)) {
+      return false;
+    }
+    data.remove_prefix(chunk.size());
+  }
+  return true;
+}
+
+// Returns the state and the descriptors, closes the received descriptors on
+// failure
+static std::optional<std::pair<std::string, std::vector<int>>>
+receive_handoff(const int socket) {
+  std::vector<int> fds;
+  std::string state;
+  std::vector<char> buffer(MAX_CHUNK_SIZE);
+  auto failed = [&fds]() {
+    for (auto fd : fds) {
+      close(fd);
+    }
+    return std::nullopt;
+  };
+  if (receive_message(socket, buffer.data(), buffer.size(), fds) !=
+      static_cast<ssize_t>(HEADER_SIZE)) {
+    return failed();
+  }
+  StateReader header{{buffer.data(), HEADER_SIZE}};
+  if (header.read_u32() != HANDOFF_MAGIC) {
+    return failed();
+  }
+  auto fds_count = header.read_u32();
+  auto state_size = header.read_u64();
+  while (fds.size() < fds_count) {
+    if (receive_message(socket, buffer.data(), buffer.size(), fds) <= 0) {
+      return failed();
+    }
+  }
+  while (state.size() < state_size) {
+    auto received =
+        receive_message(socket, buffer.data(), buffer.size(), fds);
+    if (received <= 0) {
+      return failed();
+    }
+    state.append(buffer.data(), received);
+  }
+  if (fds.size() != fds_count || state.size() != state_size) {
+    return failed();
+  }
+  return std::make_pair(std::move(state), std::move(fds));
+}
+
+static bool set_timeouts(const int socket) {
+  timeval timeout{HANDOFF_TIMEOUT.count(), 0};
+  return setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                    sizeof(timeout)) == 0 &&
+         setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+                    sizeof(timeout)) == 0;
+}
+
+static bool fill_address(const std::string &path, sockaddr_un &address) {
+  address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+    return false;
+  }
+  path.copy(address.sun_path, path.size());
+  return true;
+}
+
+ConnectionId create_handoff_socket(const std::string &path) {
+  sockaddr_un address{};
+  if (!fill_address(path, address)) {
+    spdlog::error("Invalid handoff socket path {}!", path);
+    std::exit(1);
+  }
+  auto handoff_socket = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (handoff_socket == network::INVALID_CONNECTION) {
+    spdlog::error("Couldn't create the handoff socket!");
+    std::exit(1);
+  }
+  // the socket file of the previous server is left behind
+  struct stat path_stat {};
+  if (stat(path.c_str(), &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)) {
+    unlink(path.c_str());
+  }
+  if (bind(handoff_socket, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) == network::SOCKET_ERROR ||
+      listen(handoff_socket, 1) == network::SOCKET_ERROR) {
+    spdlog::error("Couldn't listen for successors on {}: {}!", path,
+                  std::strerror(errno));
+    std::exit(1);
+  }
+  spdlog::info("Waiting for successors on {}!", path);
+  return handoff_socket;
+}
+
+// Pauses everything, hands it over and exits, or resumes on failure
+static void hand_over(const int successor, Database &database,
+                      TasksExecutor &tasks, SessionProcessor &session_proc) {
+  session_proc.pause_ingress();
+  database.auctions.pause_expiry();
+  // the tasks queued so far are executed, then all the workers wait until the
+  // handoff has failed
+  std::promise<void> drained;
+  std::promise<void> failed;
+  tasks.enqueue_exclusive([&drained, resumed = failed.get_future()]() {
+    drained.set_value();
+    resumed.wait();
+    return EgressEvent{};
+  });
+  drained.get_future().wait();
+
+  if (auto released = session_proc.release_ingress()) {
+    HandoffState state{std::move(released.value()),
+                       database.accounts.snapshot(),
+                       database.auctions.snapshot()};
+    std::vector<int> fds;
+    for (auto &listener : state.ingress.listeners) {
+      fds.push_back(listener.server_fd);
+    }
+    for (auto &connection : state.ingress.connections) {
+      fds.push_back(connection.connection);
+    }
+    char reply = 0;
+    if (send_handoff(successor, serialize_state(state), fds) &&
+        recv(successor, &reply, sizeof(reply), 0) == sizeof(reply) &&
+        reply == READY && send(successor, &CONFIRMED, sizeof(CONFIRMED),
+                               MSG_NOSIGNAL) == sizeof(CONFIRMED)) {
+      spdlog::info("Handed {} connections over, exiting!",
+                   state.ingress.connections.size());
+      std::fflush(nullptr);
+      // the other threads are parked, nothing is torn down
+      std::quick_exit(0);
+    }
+    session_proc.resume_ingress(state.ingress.connections);
+  } else {
+    session_proc.resume_ingress({});
+  }
+  database.auctions.resume_expiry();
+  failed.set_value();
+  spdlog::error("Handing over has failed, serving on!");
+}
+
+void serve_successors(const ConnectionId handoff_socket, Database &database,
+                      TasksExecutor &tasks, SessionProcessor &session_proc) {
+  for (;;) {
+    auto successor = accept4(handoff_socket, nullptr, nullptr, SOCK_CLOEXEC);
+    if (successor == network::SOCKET_ERROR) {
+      if (errno != EINTR && errno != ECONNABORTED) {
+        spdlog::error("Waiting for a successor has failed: {}!",
+                      std::strerror(errno));
+      }
+      continue;
+    }
+    spdlog::info("A successor has connected, handing over!");
+    if (set_timeouts(successor)) {
+      hand_over(successor, database, tasks, session_proc);
+    }
+    close(successor);
+  }
+}
+
+bool take_over(const std::string &path, Database &database,
+               SessionProcessor &session_proc) {
+  sockaddr_un address{};
+  if (!fill_address(path, address)) {
+    spdlog::error("Invalid handoff socket path {}!", path);
+    std::exit(1);
+  }
+  auto predecessor = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+  if (predecessor == network::INVALID_CONNECTION ||
+      !set_timeouts(predecessor)) {
+    spdlog::error("Couldn't create a handoff socket!");
+    std::exit(1);
+  }
+  if (connect(predecessor, reinterpret_cast<sockaddr *>(&address),
+              sizeof(address)) == network::SOCKET_ERROR) {
+    if (errno == ENOENT || errno == ECONNREFUSED) {
+      spdlog::info("There is no server to take over from on {}", path);
+      close(predecessor);
+      return false;
+    }
+    spdlog::error("Couldn't connect to {}: {}!", path, std::strerror(errno));
+    std::exit(1);
+  }
+
+  auto received = receive_handoff(predecessor);
+  if (!received.has_value()) {
+    spdlog::error("Receiving the handoff has failed!");
+    std::exit(1);
+  }
+  auto &[data, fds] = received.value();
+  HandoffState state;
+  try {
+    state = deserialize_state(data);
+  } catch (const std::out_of_range &) {
+    spdlog::error("Received a truncated handoff!");
+    std::exit(1);
+  }
+  auto &ingress = state.ingress;
+  if (fds.size() != ingress.listeners.size() + ingress.connections.size()) {
+    spdlog::error("Received a malformed handoff!");
+    std::exit(1);
+  }
+  auto fd = fds.begin();
+  for (auto &listener : ingress.listeners) {
+    listener.server_fd = *fd++;
+  }
+  for (auto &connection : ingress.connections) {
+    connection.connection = *fd++;
+  }
+
+  // the old server serves nothing until it's told to exit, or until it
+  // gives up and carries on, so does this one
+  auto connections = ingress.connections.size();
+  database.accounts.restore(std::move(state.accounts));
+  database.auctions.restore(std::move(state.auctions));
+  session_proc.adopt_ingress(std::move(state.ingress));
+  char reply = 0;
+  if (send(predecessor, &READY, sizeof(READY), MSG_NOSIGNAL) !=
+          sizeof(READY) ||
+      recv(predecessor, &reply, sizeof(reply), 0) != sizeof(reply) ||
+      reply != CONFIRMED) {
+    spdlog::error("The previous server hasn't let go, exiting!");
+    std::exit(1);
+  }
+  close(predecessor);
+  spdlog::info("Took {} connections over from the previous server!",
+               connections);
+  return true;
+}
+} // namespace auction_house::engine
@@ -0,0 +1,56 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#include "line_buffer.h"
+
+namespace auction_house::engine {
+void LineBuffer::append(std::string_view data) {
+  // reclaim the space taken by already consumed lines
+  if (_begin > 0 && _begin >= _data.size() / 2) {
+    _data.erase(0, _begin);
+    _scanned -= _begin;
+    _begin = 0;
+  }
+  _data.append(data);
+}
+
+std::optional<std::string> LineBuffer::next_line() {
+  for (;;) {
+    auto eol = _data.find('\n', _scanned);
+    if (eol == std::string::npos) {
+      _scanned = _data.size();
+      if (pending() > _max_line_length) {
+        // the line can't be served anyway, keep skipping until its end
+        _discarding = true;
+        _data.clear();
+        _begin = _scanned = 0;
+      }
+      return {};
+    }
+
+    auto begin = _begin;
+    _begin = _scanned = eol + 1;
+    if (_discarding || eol - begin > _max_line_length) {
+      _discarding = false;
+      continue;
+    }
+    if (eol > begin && _data[eol - 1] == '\r') {
+      --eol;
+    }
+    return _data.substr(begin, eol - begin);
+  }
+}
+
+std::string LineBuffer::snapshot() const {
+  return (_discarding ? "1" : "0") + _data.substr(_begin);
+}
+
+void LineBuffer::restore(std::string_view snapshot) {
+  _discarding = !snapshot.empty() && snapshot.front() == '1';
+  if (!snapshot.empty()) {
+    snapshot.remove_prefix(1);
+  }
+  _data = snapshot;
+  _begin = _scanned = 0;
+}
+} // namespace auction_house::engine
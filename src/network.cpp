@@ -2,30 +2,72 @@
 // Created by mswiercz on 27.11.2021.
 //
 #include "network.h"
+#include "epoll_reactor.h"
 #include <spdlog/spdlog.h>
 #include <sys/types.h>
-#include <array>
-#include <algorithm>
 #ifndef WIN32
+#include "shm_reactor.h"
+#include "uring_reactor.h"
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 #include <unistd.h>
 #else
 #include <winsock.h>
 #endif
 
-#ifdef WIN32
-#define close(a) closesocket(a)
-using socklen_t = int;
+namespace auction_house::network {
+
+ReactorPtr create_reactor(const Backend backend, const EgressLimit &limit,
+                          const SocketOptions &options) {
+  switch (backend) {
+  case Backend::Epoll:
+    return ReactorPtr{new EpollReactor{limit, options}};
+  case Backend::IoUring:
+#ifndef WIN32
+    if (!UringReactor::supported()) {
+      return nullptr;
+    }
+    return ReactorPtr{new UringReactor{limit, options}};
+#else
+    return nullptr;
+#endif
+  case Backend::SharedMemory:
+#ifndef WIN32
+    return ReactorPtr{new ShmReactor{limit}};
+#else
+    return nullptr;
 #endif
+  }
+  return nullptr;
+}
 
-namespace auction_house::network {
-static fd_set read_fds{};
-static fd_set connected_fds{};
-ConnectionId max_connection_id = INVALID_CONNECTION;
+std::optional<Backend> parse_backend(const std::string &name) {
+  if (name == "epoll") {
+    return Backend::Epoll;
+  }
+  if (name == "io_uring") {
+    return Backend::IoUring;
+  }
+  return {};
+}
+
+std::optional<SlowClientPolicy>
+parse_slow_client_policy(const std::string &name) {
+  if (name == "pause") {
+    return SlowClientPolicy::PauseReading;
+  }
+  if (name == "disconnect") {
+    return SlowClientPolicy::Disconnect;
+  }
+  return {};
+}
 
-ConnectionId init_server_socket(const uint16_t port) {
+ConnectionId create_server_socket(const uint16_t port,
+                                  const SocketOptions &options) {
   #ifdef WIN32
   WSADATA wsaData;
   if (WSAStartup(MAKEWORD(2, 2), &wsaData) != NO_ERROR) {
@@ -46,6 +88,14 @@ ConnectionId init_server_socket(const uint16_t port) {
     spdlog::error("Couldn't reuse address!");
     exit(1);
   }
+  #ifdef SO_REUSEPORT
+  // every ingress reactor binds its own listener to the same port
+  if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEPORT,
+                 reinterpret_cast<char *>(&opt), sizeof(opt)) == SOCKET_ERROR) {
+    spdlog::error("Couldn't reuse port!");
+    exit(1);
+  }
+  #endif
 
   sockaddr_in server_address = {AF_INET, htons(port), INADDR_ANY, {0}};
   if (bind(server_fd, reinterpret_cast<sockaddr *>(&server_address),
@@ -54,15 +104,22 @@ ConnectionId init_server_socket(const uint16_t port) {
     std::exit(1);
   }
 
-  if ((listen(server_fd, MAX_CONNECTIONS)) == -1) {
+  #ifdef TCP_DEFER_ACCEPT
+  if (options.defer_accept.has_value()) {
+    int seconds = options.defer_accept.value();
+    if (setsockopt(server_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &seconds,
+                   sizeof(seconds)) == SOCKET_ERROR) {
+      spdlog::error("Couldn't defer accepting connections!");
+      std::exit(1);
+    }
+  }
+  #endif
+
+  if ((listen(server_fd, options.backlog)) == -1) {
     spdlog::error("Listening on port {} has failed!", port);
     std::exit(1);
   }
 
-  FD_ZERO(&read_fds);
-  FD_ZERO(&connected_fds);
-  FD_SET(server_fd, &connected_fds);
-
   #ifndef WIN32
   char address_buffer[INET_ADDRSTRLEN];
   inet_ntop(AF_INET, &(server_address.sin_addr), address_buffer,
@@ -72,92 +129,60 @@ ConnectionId init_server_socket(const uint16_t port) {
                htons(server_address.sin_port));
   #endif
 
-  max_connection_id = server_fd;
-
   return server_fd;
 }
 
-void close_connection(const ConnectionId connection) {
-  spdlog::info("Closing connection {}!", connection);
-  close(connection);
-  FD_CLR(connection, &connected_fds);
-}
-
-ConnectionId handle_new_connection(const ConnectionId server_fd) {
-  if (FD_ISSET(server_fd, &read_fds)) {
-    sockaddr_in client_address{};
-    socklen_t sin_size = sizeof(sockaddr_in);
-    auto client_fd = accept(
-        server_fd, reinterpret_cast<sockaddr *>(&client_address), &sin_size);
-
-    if (client_fd != SOCKET_ERROR) {
-      #ifndef WIN32
-      char address_buffer[INET_ADDRSTRLEN];
-      inet_ntop(AF_INET, &(client_address.sin_addr), address_buffer,
-                INET_ADDRSTRLEN);
-      spdlog::info("Received new connection from {}:{}",
-                   std::string(address_buffer, std::strlen(address_buffer)),
-                   htons(client_address.sin_port));
-      #endif
-
-      FD_SET(client_fd, &connected_fds);
-      #ifndef WIN32
-      max_connection_id = std::max(max_connection_id, client_fd);
-      #else
-      max_connection_id = max(max_connection_id, client_fd);
-      #endif
-      return client_fd;
-    } else {
-      spdlog::error("Accepting a new connection has failed!");
-    }
+ConnectionId create_unix_server_socket(const std::string &path,
+                                       const SocketOptions &options) {
+  #ifndef WIN32
+  sockaddr_un server_address{};
+  server_address.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(server_address.sun_path)) {
+    spdlog::error("Invalid Unix socket path {}!", path);
+    std::exit(1);
   }
-  return INVALID_CONNECTION;
-}
+  path.copy(server_address.sun_path, path.size());
 
-std::optional<std::string> receive_data(const ConnectionId connection) {
-  std::optional<std::string> result = {};
-  if (FD_ISSET(connection, &read_fds)) {
-    spdlog::debug("Receiving data for connection {}", connection);
-    std::array<char, 1024> buffer;
-    std::string data{};
-    std::size_t n_bytes = 0;
-    auto is_eol = false;
-    do {
-      n_bytes = recv(connection, buffer.data(), buffer.size(), 0);
-      data.append(buffer.data(), n_bytes);
-      is_eol = data.size() > 0 && data.back() == '\n';
-    } while(!is_eol && n_bytes == buffer.size());
-    if (n_bytes == SOCKET_ERROR) {
-      spdlog::error("Something went wrong while reading data for connection {}",
-                    connection);
-    }
-    return {std::move(data)};
+  auto server_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (server_fd == INVALID_CONNECTION) {
+    spdlog::error("Couldn't create a Unix server socket!");
+    std::exit(1);
   }
-  return result;
-}
 
-void wait_for_traffic() {
-  spdlog::debug("Waiting for incoming connections/data!");
-  read_fds = connected_fds;
-  if ((select(max_connection_id + 1, &read_fds, nullptr, nullptr, nullptr)) ==
-      SOCKET_ERROR) {
-    spdlog::error("Waiting for incoming connections/data has failed!");
+  // a socket file left by a previous run would fail the bind
+  struct stat path_stat {};
+  if (stat(path.c_str(), &path_stat) == 0 && S_ISSOCK(path_stat.st_mode)) {
+    unlink(path.c_str());
+  }
+  if (bind(server_fd, reinterpret_cast<sockaddr *>(&server_address),
+           sizeof(server_address)) == SOCKET_ERROR) {
+    spdlog::error("Couldn't bind! Path {}", path);
+    std::exit(1);
   }
+  if ((listen(server_fd, options.backlog)) == -1) {
+    spdlog::error("Listening on path {} has failed!", path);
+    std::exit(1);
+  }
+  spdlog::info("Successfully started the server {}!", path);
+  return server_fd;
+  #else
+  spdlog::error("Unix domain sockets aren't supported! Path {}", path);
+  std::exit(1);
+  #endif
 }
 
-void send_data(ConnectionId connection, std::string &&data) {
-  data.append("\nCMD>>");
-  data.insert(0, "RESP>> ");
-  const auto *data_ptr = data.data();
-  std::size_t n_bytes_to_send = data.size();
-  std::size_t n_sent_bytes = 0;
-  do {
-    n_sent_bytes = send(connection, data.data(), data.size(), 0);
-    if (n_sent_bytes == SOCKET_ERROR) {
-      spdlog::warn("Sending data for connection {} has failed", connection);
-      return;
+bool configure_connection(const ConnectionId connection,
+                          const SocketOptions &options) {
+  if (options.no_delay) {
+    int opt = 1;
+    if (setsockopt(connection, IPPROTO_TCP, TCP_NODELAY,
+                   reinterpret_cast<char *>(&opt),
+                   sizeof(opt)) == SOCKET_ERROR) {
+      spdlog::error("Couldn't disable Nagle's algorithm for connection {}!",
+                    connection);
+      return false;
     }
-    n_bytes_to_send -= n_sent_bytes;
-  } while (n_bytes_to_send > 0);
+  }
+  return true;
 }
-} // namespace auction_house::network
\ No newline at end of file
+} // namespace auction_house::network
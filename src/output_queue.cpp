@@ -0,0 +1,87 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#include "output_queue.h"
+#include <cstring>
+
+namespace auction_house::network {
+void OutputQueue::push(Payload data) {
+  auto view = data.view();
+  _push({view, std::move(data), {}});
+}
+
+void OutputQueue::push_response(Reply &&reply) {
+  if (reply.protocol == Protocol::Binary) {
+    // u32 length of the result code and the text, u8 result code
+    auto length = static_cast<std::uint32_t>(reply.data.size() + 1);
+    std::array<char, 5> header{
+        static_cast<char>(length & 0xff), static_cast<char>(length >> 8 & 0xff),
+        static_cast<char>(length >> 16 & 0xff),
+        static_cast<char>(length >> 24 & 0xff),
+        static_cast<char>(reply.result)};
+    _push_inline({header.data(), header.size()});
+    push(std::move(reply.data));
+    return;
+  }
+  _push({RESPONSE_PREFIX, {}, {}});
+  push(std::move(reply.data));
+  _push({RESPONSE_SUFFIX, {}, {}});
+}
+
+void OutputQueue::_push(Piece &&piece) {
+  if (piece.data.empty()) {
+    return;
+  }
+  _size += piece.data.size();
+  _pieces.push_back(std::move(piece));
+}
+
+void OutputQueue::_push_inline(std::string_view data) {
+  // the view is set once the piece has its place, deque never moves it
+  auto &piece = _pieces.emplace_back();
+  std::memcpy(piece.inline_data.data(), data.data(), data.size());
+  piece.data = {piece.inline_data.data(), data.size()};
+  _size += data.size();
+}
+
+#ifndef WIN32
+std::size_t OutputQueue::gather(iovec *iovecs,
+                                const std::size_t max_iovecs) const {
+  std::size_t count = 0;
+  for (auto it = _pieces.begin(); it != _pieces.end() && count < max_iovecs;
+       ++it, ++count) {
+    auto data = it == _pieces.begin() ? it->data.substr(_offset) : it->data;
+    iovecs[count].iov_base = const_cast<char *>(data.data());
+    iovecs[count].iov_len = data.size();
+  }
+  return count;
+}
+#endif
+
+void OutputQueue::consume(std::size_t n_bytes) {
+  _size -= n_bytes;
+  while (n_bytes > 0) {
+    auto left = _pieces.front().data.size() - _offset;
+    if (n_bytes < left) {
+      _offset += n_bytes;
+      return;
+    }
+    n_bytes -= left;
+    _offset = 0;
+    _pieces.pop_front();
+  }
+}
+
+bool Outbox::push(const ConnectionId connection, Reply &&reply) {
+  std::lock_guard _l{_mutex};
+  _replies.emplace_back(connection, std::move(reply));
+  return _replies.size() == 1;
+}
+
+Outbox::Replies Outbox::take() {
+  Replies replies;
+  std::lock_guard _l{_mutex};
+  replies.swap(_replies);
+  return replies;
+}
+} // namespace auction_house::network
@@ -0,0 +1,14 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#include "payload.h"
+
+namespace auction_house {
+Payload::Payload(std::string data)
+    : _data(std::make_shared<const std::string>(std::move(data))) {}
+
+const std::string &Payload::str() const {
+  static const std::string empty{};
+  return _data ? *_data : empty;
+}
+} // namespace auction_house
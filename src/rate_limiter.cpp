@@ -0,0 +1,111 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#include "rate_limiter.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <vector>
+
+namespace auction_house::engine {
+// Parses "<rate> [<burst>]", a bucket which can't hold a single token would
+// never admit anything
+static std::optional<RateLimit>
+parse_limit(const std::vector<std::string> &words) {
+  if (words.size() < 2 || words.size() > 3) {
+    return {};
+  }
+  try {
+    std::size_t parsed = 0;
+    RateLimit limit{std::stod(words[1], &parsed), 0};
+    if (parsed != words[1].size()) {
+      return {};
+    }
+    limit.burst = std::max(limit.rate, 1.0);
+    if (words.size() == 3) {
+      limit.burst = std::stod(words[2], &parsed);
+      if (parsed != words[2].size()) {
+        return {};
+      }
+    }
+    if (!std::isfinite(limit.rate) || !std::isfinite(limit.burst) ||
+        limit.rate <= 0 || limit.burst < 1) {
+      return {};
+    }
+    return limit;
+  } catch (std::logic_error &) {
+    return {};
+  }
+}
+
+std::optional<RateLimits> parse_rate_limits(std::string_view text) {
+  RateLimits limits;
+  std::istringstream lines{std::string{text}};
+  for (std::string line; std::getline(lines, line);) {
+    line = line.substr(0, line.find('#'));
+    std::istringstream line_stream{line};
+    std::vector<std::string> words;
+    for (std::string word; line_stream >> word;) {
+      words.push_back(std::move(word));
+    }
+    if (words.empty()) {
+      continue;
+    }
+    if (words[0] == "session" || words[0] == "user") {
+      auto limit = parse_limit(words);
+      if (!limit.has_value()) {
+        return {};
+      }
+      (words[0] == "session" ? limits.session : limits.user) = limit;
+    } else if (words[0] == "policy" && words.size() == 2 &&
+               (words[1] == "drop" || words[1] == "reply")) {
+      limits.policy = words[1] == "drop" ? OverLimitPolicy::Drop
+                                         : OverLimitPolicy::Reply;
+    } else {
+      return {};
+    }
+  }
+  return limits;
+}
+
+std::size_t TokenBucket::available(const RateLimit &limit,
+                                   const Clock::time_point now) {
+  if (!_last_refill.has_value()) {
+    _tokens = limit.burst;
+  } else if (now > _last_refill.value()) {
+    std::chrono::duration<double> elapsed = now - _last_refill.value();
+    _tokens += elapsed.count() * limit.rate;
+  }
+  // the burst may have been lowered meanwhile too
+  _tokens = std::min(_tokens, limit.burst);
+  _last_refill = std::max(now, _last_refill.value_or(now));
+  return static_cast<std::size_t>(_tokens);
+}
+
+void RateLimiter::set_limits(const RateLimits &limits) {
+  std::atomic_store(&_limits, std::make_shared<const RateLimits>(limits));
+  std::lock_guard _l{_users_mutex};
+  _users.clear();
+}
+
+std::size_t RateLimiter::admit(const RateLimits &limits, TokenBucket &session,
+                               const std::optional<std::string> &username,
+                               const std::size_t commands,
+                               const TokenBucket::Clock::time_point now) {
+  auto admitted = commands;
+  if (limits.session.has_value()) {
+    admitted = std::min(admitted, session.available(limits.session.value(),
+                                                    now));
+  }
+  if (limits.user.has_value() && username.has_value()) {
+    std::lock_guard _l{_users_mutex};
+    auto &user = _users[username.value()];
+    admitted = std::min(admitted, user.available(limits.user.value(), now));
+    user.take(admitted);
+  }
+  if (limits.session.has_value()) {
+    session.take(admitted);
+  }
+  return admitted;
+}
+} // namespace auction_house::engine
@@ -5,6 +5,10 @@
 #include <mutex>
 
 namespace auction_house::engine {
+SessionId SessionManager::generate_session_id() {
+  return _next_session_id.fetch_add(1, std::memory_order_relaxed);
+}
+
 bool SessionManager::start_session(const SessionId id,
                                    const ConnectionId conn_id) {
   std::unique_lock _l{_mutex};
@@ -71,10 +75,11 @@ std::optional<std::string> SessionManager::get_username(const SessionId id) {
 std::optional<SessionId>
 SessionManager::get_session_id(const std::string &username) {
   std::shared_lock _l{_mutex};
-  if (_logged_users.find(username) == _logged_users.end()) {
+  auto logged_it = _logged_users.find(username);
+  if (logged_it == _logged_users.end()) {
     return {};
   }
-  return _logged_users[username];
+  return logged_it->second;
 }
 
 std::optional<ConnectionId>
@@ -86,4 +91,24 @@ SessionManager::get_connection_id(const SessionId id) {
   }
   return {};
 }
-} // namespace auction_house::engine
\ No newline at end of file
+
+bool SessionManager::restore_session(
+    const SessionId id, const ConnectionId conn_id,
+    const std::optional<std::string> &username) {
+  std::unique_lock _l{_mutex};
+  if (_sessions.find(id) != _sessions.end() ||
+      (username.has_value() &&
+       _logged_users.find(username.value()) != _logged_users.end())) {
+    return false;
+  }
+  _sessions[id] = {conn_id, username};
+  if (username.has_value()) {
+    _logged_users[username.value()] = id;
+  }
+  auto next_id = _next_session_id.load(std::memory_order_relaxed);
+  while (next_id <= id && !_next_session_id.compare_exchange_weak(
+                              next_id, id + 1, std::memory_order_relaxed)) {
+  }
+  return true;
+}
+} // namespace auction_house::engine
@@ -5,33 +5,152 @@
 #include "database.h"
 #include "network.h"
 #include "spdlog/spdlog.h"
-#include "tasks_queue.h"
+#include "tasks_executor.h"
+#include <algorithm>
+#include <mutex>
 #include <thread>
 
 namespace auction_house::engine {
 
-void SessionProcessor::serve_ingress(const uint16_t port) {
-  auto server_socket = network::init_server_socket(port);
+SessionProcessor::SessionProcessor(Database &database, TasksExecutor &tasks,
+                                   std::vector<network::ReactorPtr> &&reactors,
+                                   const SessionTimeouts &timeouts)
+    : _database(database), _tasks(tasks), _timeouts(timeouts) {
+  _ingresses.resize(reactors.size());
+  for (std::size_t i = 0; i < reactors.size(); ++i) {
+    _ingresses[i].reactor = std::move(reactors[i]);
+  }
+}
 
-  for (;;) {
-    network::wait_for_traffic();
+static bool has_listener(const Ingress &ingress, const ListenerKind kind) {
+  for (auto &[_, listener_kind] : ingress.listeners) {
+    if (listener_kind == kind) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void SessionProcessor::serve_ingress(
+    const uint16_t port, const std::optional<uint16_t> binary_port,
+    const std::optional<std::string> &unix_path) {
+  // all listeners share the port, the kernel spreads new connections
+  // between them
+  for (auto &ingress : _ingresses) {
+    if (!has_listener(ingress, ListenerKind::Text)) {
+      ingress.listeners[ingress.reactor->init_server_socket(port)] =
+          ListenerKind::Text;
+    }
+    if (binary_port.has_value() &&
+        !has_listener(ingress, ListenerKind::Binary)) {
+      ingress.listeners[ingress.reactor->init_server_socket(
+          binary_port.value())] = ListenerKind::Binary;
+    }
+  }
+  auto has_local = std::any_of(
+      _ingresses.begin(), _ingresses.end(), [](const Ingress &ingress) {
+        return has_listener(ingress, ListenerKind::Local);
+      });
+  if (unix_path.has_value() && !has_local) {
+    auto &ingress = _ingresses.front();
+    ingress.listeners[ingress.reactor->init_unix_server_socket(
+        unix_path.value())] = ListenerKind::Local;
+  }
+
+  std::vector<std::thread> threads;
+  for (std::size_t i = 1; i < _ingresses.size(); ++i) {
+    threads.emplace_back([this, i]() { _serve_reactor(_ingresses[i]); });
+  }
+  if (_shm_ingress) {
+    threads.emplace_back([this]() { _serve_reactor(*_shm_ingress); });
+  }
+  _serve_reactor(_ingresses.front());
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+}
+
+void SessionProcessor::add_shm_ingress(network::ReactorPtr &&reactor,
+                                       const std::string &path) {
+  _shm_ingress = std::make_unique<Ingress>();
+  _shm_ingress->reactor = std::move(reactor);
+  // shared memory clients speak the binary protocol
+  _shm_ingress->listeners[_shm_ingress->reactor->init_unix_server_socket(
+      path)] = ListenerKind::Binary;
+}
+
+void SessionProcessor::send_data(const ConnectionId connection_id,
+                                 Payload data, const ResultCode result) {
+  std::shared_lock _l{_owners_mutex};
+  auto owner_it = _owners.find(connection_id);
+  if (owner_it == _owners.end()) {
+    spdlog::debug("Dropping data for closed connection {}", connection_id);
+    return;
+  }
+  auto &owner = owner_it->second;
+  owner.reactor->send_data(connection_id,
+                           {std::move(data), result, owner.protocol});
+}
 
-    _scan_connections();
+void SessionProcessor::set_rate_limits(const RateLimits &limits) {
+  _rate_limiter.set_limits(limits);
+}
 
-    auto new_connection = network::handle_new_connection(server_socket);
-    if (new_connection != network::INVALID_CONNECTION) {
-      if (!_create_new_session(new_connection)) {
-        network::close_connection(new_connection);
+void SessionProcessor::_serve_reactor(Ingress &ingress) {
+  // the timers are checked at least once per tick even if nothing happens
+  std::optional<std::chrono::milliseconds> tick;
+  if (_timeouts.idle.has_value() || _timeouts.login.has_value()) {
+    tick = std::chrono::duration_cast<std::chrono::milliseconds>(
+        ingress.idle_timers.tick());
+  }
+  for (;;) {
+    auto ready = ingress.reactor->wait_for_traffic(tick);
+    if (_pause_requested) {
+      // the traffic is served by the next owner of the connections, or
+      // reported again once they are resumed
+      _park();
+      continue;
+    }
+    for (auto connection_id : ready) {
+      auto listener_it = ingress.listeners.find(connection_id);
+      if (listener_it == ingress.listeners.end()) {
+        _serve_connection(ingress, connection_id);
+        continue;
+      }
+      auto protocol = listener_it->second == ListenerKind::Binary
+                          ? Protocol::Binary
+                          : Protocol::Text;
+      for (auto new_connection :
+           ingress.reactor->handle_new_connections(connection_id)) {
+        if (!_create_new_session(ingress, new_connection, protocol)) {
+          ingress.reactor->close_connection(new_connection);
+        }
       }
     }
+    _reap_expired(ingress);
   }
 }
 
-bool SessionProcessor::_create_new_session(const ConnectionId connection_id) {
-  auto session_id = _next_session_id++;
+bool SessionProcessor::_create_new_session(Ingress &ingress,
+                                           const ConnectionId connection_id,
+                                           const Protocol protocol) {
+  auto session_id = _database.sessions.generate_session_id();
   if (_database.sessions.start_session(session_id, connection_id)) {
-    _connections.push_back({connection_id, session_id});
-    _queue.enqueue(create_command_task({{}, session_id, "HELP"}, _database));
+    ingress.connections.insert_or_assign(
+        connection_id,
+        Connection{session_id, protocol, LineBuffer{}, FrameBuffer{},
+                   TokenBucket{}, {}});
+    {
+      std::unique_lock _l{_owners_mutex};
+      _owners[connection_id] = {ingress.reactor.get(), protocol};
+    }
+    _start_timers(ingress, connection_id, false);
+    // machines don't need the welcome banner
+    if (protocol == Protocol::Text) {
+      _tasks.enqueue(create_command_task({{}, session_id, "HELP"}, _database),
+                     session_id);
+    }
     spdlog::debug("Started new session {} for connection {}", session_id,
                   connection_id);
     return true;
@@ -41,49 +160,381 @@ bool SessionProcessor::_create_new_session(const ConnectionId connection_id) {
   return false;
 }
 
-void SessionProcessor::_end_connection(const ConnectionId connection_id,
+void SessionProcessor::_start_timers(Ingress &ingress,
+                                     const ConnectionId connection_id,
+                                     const bool logged_in) {
+  if (_timeouts.idle.has_value()) {
+    ingress.idle_timers.schedule(connection_id, _timeouts.idle.value());
+  }
+  if (_timeouts.login.has_value() && !logged_in) {
+    ingress.login_timers.schedule(connection_id, _timeouts.login.value());
+  }
+}
+
+void SessionProcessor::_end_connection(Ingress &ingress,
+                                       const ConnectionId connection_id,
                                        const SessionId session_id) {
   spdlog::info("Closing session {}!", session_id);
+  ingress.idle_timers.cancel(connection_id);
+  ingress.login_timers.cancel(connection_id);
   if (!_database.sessions.end_session(session_id)) {
     spdlog::error("Couldn't end session {} for connection {}!", session_id,
                   connection_id);
   }
-  network::close_connection(connection_id);
+  {
+    // the descriptor can be reused by any reactor once it's closed
+    std::unique_lock _l{_owners_mutex};
+    _owners.erase(connection_id);
+    ingress.reactor->close_connection(connection_id);
+  }
 }
 
-void SessionProcessor::_serve_user_data(std::string &&data,
-                                        const SessionId session_id) {
-  if (data.back() == '\n') {
-    data.pop_back();
+void SessionProcessor::_reap_expired(Ingress &ingress) {
+  auto now = TimingWheel::Clock::now();
+  for (auto connection_id : ingress.idle_timers.advance(now)) {
+    auto connection_it = ingress.connections.find(connection_id);
+    if (connection_it == ingress.connections.end()) {
+      continue;
+    }
+    spdlog::info("Connection {} has been idle for too long!", connection_id);
+    _end_connection(ingress, connection_id, connection_it->second.session_id);
+    ingress.connections.erase(connection_it);
+  }
+  for (auto connection_id : ingress.login_timers.advance(now)) {
+    auto connection_it = ingress.connections.find(connection_id);
+    if (connection_it == ingress.connections.end()) {
+      continue;
+    }
+    auto session_id = connection_it->second.session_id;
+    if (_database.sessions.get_username(session_id).has_value()) {
+      continue;
+    }
+    spdlog::info("Connection {} hasn't logged in on time!", connection_id);
+    _end_connection(ingress, connection_id, session_id);
+    ingress.connections.erase(connection_it);
   }
-  auto username = _database.sessions.get_username(session_id);
-  spdlog::debug("Creating new task for session: {}, "
-                "username: {}, received data size {}!",
-                session_id, username.value_or(""), data.size());
-  _queue.enqueue(
-      create_command_task({username, session_id, std::move(data)}, _database));
 }
 
-void SessionProcessor::_scan_connections() {
-  for (auto connection_it = _connections.begin();
-       connection_it != _connections.end();) {
-    spdlog::debug(
-        "Checking if there are data to receive for connection {} session {}!",
-        connection_it->connection, connection_it->session_id);
+void SessionProcessor::_serve_user_data(Connection &connection) {
+  std::vector<std::string> commands;
+  if (connection.protocol == Protocol::Binary) {
+    while (auto frame = connection.frames.next_frame()) {
+      commands.push_back(std::move(frame.value()));
+    }
+  } else {
+    while (auto line = connection.input.next_line()) {
+      commands.push_back(std::move(line.value()));
+    }
+  }
+  if (!commands.empty()) {
+    enqueue_commands(connection, commands);
+  }
+}
 
-    auto user_data = network::receive_data(connection_it->connection);
+void SessionProcessor::enqueue_commands(Connection &connection,
+                                        std::vector<std::string> &commands) {
+  auto limits = _rate_limiter.limits();
+  auto admitted = commands.size();
+  if (limits->session.has_value() || limits->user.has_value()) {
+    // the user is looked up once per batch, a pipelined LOGIN counts against
+    // the user from the next batch on
+    std::optional<std::string> username;
+    if (limits->user.has_value()) {
+      username = _database.sessions.get_username(connection.session_id);
+    }
+    admitted = _rate_limiter.admit(*limits, connection.commands, username,
+                                   commands.size());
+  }
+  // the rejected commands in a row get a single reply, a flood doesn't queue
+  // a task per line. It's queued, so it keeps the order of the commands.
+  std::size_t rejected = 0;
+  auto reply_rejected = [this, &connection, &limits, &rejected] {
+    if (rejected == 0) {
+      return;
+    }
+    spdlog::debug("Session {} is over the rate limit, rejected {} commands!",
+                  connection.session_id, rejected);
+    if (limits->policy == OverLimitPolicy::Reply) {
+      static const Payload reply{"Too many commands, slow down!"};
+      _tasks.enqueue(create_reply_task({connection.session_id, reply,
+                                        ResultCode::RateLimited}),
+                     connection.session_id);
+    }
+    rejected = 0;
+  };
+  // the commands are parsed here, but the username is resolved when a task is
+  // executed, a pipelined LOGIN affects the following lines
+  for (std::size_t i = 0; i < commands.size(); ++i) {
+    spdlog::debug("Creating new task for session: {}, received data size {}!",
+                  connection.session_id, commands[i].size());
+    Request request{IngressEvent{{}, connection.session_id,
+                                 std::move(commands[i]), connection.protocol}};
+    if (i >= admitted || connection.rejected_batch) {
+      _reject_command(connection, request);
+      ++rejected;
+      continue;
+    }
+    reply_rejected();
+    if (!_batch_command(connection, request)) {
+      _tasks.enqueue(create_command_task(std::move(request), _database),
+                     connection.session_id);
+    }
+  }
+  reply_rejected();
+}
+
+void SessionProcessor::_reject_command(Connection &connection,
+                                       const Request &request) {
+  auto &command = request.command.get();
+  auto ends = std::holds_alternative<commands::Exec>(command) ||
+              std::holds_alternative<commands::Discard>(command);
+  if (connection.batch.has_value()) {
+    connection.batch.reset();
+    connection.rejected_batch = !ends;
+  } else if (connection.rejected_batch) {
+    connection.rejected_batch = !ends;
+  } else {
+    connection.rejected_batch =
+        std::holds_alternative<commands::Multi>(command);
+  }
+}
 
-    if (user_data.has_value()) {
-      auto &data = user_data.value();
-      if (data.empty()) {
-        _end_connection(connection_it->connection, connection_it->session_id);
-        connection_it = _connections.erase(connection_it);
-        continue; // go to next connection
-      } else {
-        _serve_user_data(std::move(data), connection_it->session_id);
+bool SessionProcessor::_batch_command(Connection &connection,
+                                      Request &request) {
+  auto &command = request.command.get();
+  auto starts = !connection.batch.has_value();
+  if (starts) {
+    auto multi = std::get_if<commands::Multi>(&command);
+    if (multi == nullptr) {
+      return false;
+    }
+    connection.batch = Batch{multi->atomic, {}, {}};
+  } else if (std::holds_alternative<commands::Exec>(command)) {
+    _tasks.enqueue(create_batch_task(std::move(connection.batch->requests),
+                                     connection.session_id,
+                                     connection.batch->atomic, _database),
+                   connection.session_id);
+    connection.batch.reset();
+    return true;
+  } else if (std::holds_alternative<commands::Discard>(command)) {
+    connection.batch.reset();
+    _tasks.enqueue(create_reply_task({connection.session_id,
+                                      "The batch has been discarded!"}),
+                   connection.session_id);
+    return true;
+  } else if (connection.batch->requests.size() == MAX_BATCH_COMMANDS) {
+    connection.batch.reset();
+    _tasks.enqueue(
+        create_reply_task({connection.session_id,
+                           "The batch is too long, it has been discarded!",
+                           ResultCode::InvalidArgument}),
+        connection.session_id);
+    return true;
+  }
+  // kept as received, another process parses the batch again after a handoff
+  auto &data = request.event.data;
+  auto &input = connection.batch->input;
+  if (connection.protocol == Protocol::Binary) {
+    input += frame_request(data);
+  } else {
+    input.append(data).push_back('\n');
+  }
+  if (starts) {
+    return true;
+  }
+  connection.batch->requests.push_back(std::move(request));
+  return true;
+}
+
+void SessionProcessor::_restore_batch(Connection &connection,
+                                      const std::string &input) {
+  std::vector<std::string> commands;
+  if (connection.protocol == Protocol::Binary) {
+    FrameBuffer frames;
+    frames.append(input);
+    while (auto frame = frames.next_frame()) {
+      commands.push_back(std::move(frame.value()));
+    }
+  } else {
+    LineBuffer lines;
+    lines.append(input);
+    while (auto line = lines.next_line()) {
+      commands.push_back(std::move(line.value()));
+    }
+  }
+  // the batch starts with MULTI and has no EXEC, nothing is queued
+  for (auto &command : commands) {
+    Request request{IngressEvent{{}, connection.session_id,
+                                 std::move(command), connection.protocol}};
+    _batch_command(connection, request);
+  }
+}
+
+void SessionProcessor::_serve_connection(Ingress &ingress,
+                                         const ConnectionId connection_id) {
+  auto connection_it = ingress.connections.find(connection_id);
+  if (connection_it == ingress.connections.end()) {
+    spdlog::warn("Received traffic for unknown connection {}!", connection_id);
+    return;
+  }
+  auto &connection = connection_it->second;
+  spdlog::debug("Receiving data for connection {} session {}!", connection_id,
+                connection.session_id);
+
+  auto user_data = ingress.reactor->receive_data(connection_id);
+  if (!user_data.data.empty()) {
+    if (_timeouts.idle.has_value()) {
+      ingress.idle_timers.schedule(connection_id, _timeouts.idle.value());
+    }
+    if (connection.protocol == Protocol::Binary) {
+      connection.frames.append(user_data.data);
+    } else {
+      connection.input.append(user_data.data);
+    }
+    _serve_user_data(connection);
+  }
+  if (user_data.hung_up) {
+    _end_connection(ingress, connection_id, connection.session_id);
+    ingress.connections.erase(connection_it);
+  }
+}
+
+void SessionProcessor::pause_ingress() {
+  std::unique_lock l{_pause_mutex};
+  _pause_requested = true;
+  auto threads = _ingresses.size();
+  for (auto &ingress : _ingresses) {
+    ingress.reactor->wake_up();
+  }
+  if (_shm_ingress) {
+    _shm_ingress->reactor->wake_up();
+    ++threads;
+  }
+  _pause_cv.wait(l, [this, threads]() { return _parked == threads; });
+}
+
+void SessionProcessor::_park() {
+  std::unique_lock l{_pause_mutex};
+  ++_parked;
+  _pause_cv.notify_all();
+  _pause_cv.wait(l, [this]() { return !_pause_requested; });
+  --_parked;
+}
+
+std::optional<HandedIngress> SessionProcessor::release_ingress() {
+  // the ingress threads are parked, their state can be touched safely
+  HandedIngress handed;
+  for (auto &ingress : _ingresses) {
+    for (auto &[server_fd, kind] : ingress.listeners) {
+      handed.listeners.push_back({server_fd, kind});
+    }
+    for (auto &[connection_id, connection] : ingress.connections) {
+      auto output = ingress.reactor->release_connection(connection_id);
+      if (!output.has_value()) {
+        spdlog::error("Couldn't release connection {}!", connection_id);
+        _serve_again(handed.connections);
+        return {};
       }
+      handed.connections.push_back(
+          {connection_id, connection.session_id, connection.protocol,
+           _database.sessions.get_username(connection.session_id),
+           connection.protocol == Protocol::Binary
+               ? connection.frames.snapshot()
+               : connection.input.snapshot(),
+           std::move(output.value()),
+           connection.batch.has_value() ? connection.batch->input
+                                        : std::string{}});
+    }
+  }
+  return handed;
+}
+
+Ingress *SessionProcessor::_find_ingress(const network::Reactor *reactor) {
+  for (auto &ingress : _ingresses) {
+    if (ingress.reactor.get() == reactor) {
+      return &ingress;
+    }
+  }
+  return nullptr;
+}
+
+void SessionProcessor::resume_ingress(
+    const std::vector<HandedConnection> &released) {
+  _serve_again(released);
+  {
+    std::lock_guard _l{_pause_mutex};
+    _pause_requested = false;
+  }
+  _pause_cv.notify_all();
+}
+
+void SessionProcessor::_serve_again(
+    const std::vector<HandedConnection> &released) {
+  for (auto &handed : released) {
+    network::Reactor *reactor = nullptr;
+    {
+      std::shared_lock _l{_owners_mutex};
+      auto owner_it = _owners.find(handed.connection);
+      if (owner_it != _owners.end()) {
+        reactor = owner_it->second.reactor;
+      }
+    }
+    auto *ingress = _find_ingress(reactor);
+    if (ingress != nullptr &&
+        !reactor->adopt_connection(handed.connection, handed.output)) {
+      // the connection can't be served anymore, neither can its session
+      _end_connection(*ingress, handed.connection, handed.session_id);
+      ingress->connections.erase(handed.connection);
+    }
+  }
+}
+
+void SessionProcessor::adopt_ingress(HandedIngress &&handed) {
+  // every kind of listeners is spread on its own
+  std::unordered_map<ListenerKind, std::size_t> next_ingress;
+  for (auto &[server_fd, kind] : handed.listeners) {
+    auto &ingress = kind == ListenerKind::Local
+                        ? _ingresses.front()
+                        : _ingresses[next_ingress[kind]++ % _ingresses.size()];
+    if (!ingress.reactor->adopt_server_socket(server_fd)) {
+      spdlog::error("Couldn't serve an inherited listener {}!", server_fd);
+      std::exit(1);
+    }
+    ingress.listeners[server_fd] = kind;
+  }
+
+  std::size_t next = 0;
+  for (auto &connection : handed.connections) {
+    auto &ingress = _ingresses[next++ % _ingresses.size()];
+    auto connection_id = connection.connection;
+    if (!_database.sessions.restore_session(
+            connection.session_id, connection_id, connection.username)) {
+      spdlog::error("Couldn't restore session {} of connection {}!",
+                    connection.session_id, connection_id);
+      ingress.reactor->close_connection(connection_id);
+      continue;
+    }
+    if (!ingress.reactor->adopt_connection(connection_id, connection.output)) {
+      _database.sessions.end_session(connection.session_id);
+      ingress.reactor->close_connection(connection_id);
+      continue;
+    }
+    Connection state{connection.session_id, connection.protocol, LineBuffer{},
+                     FrameBuffer{}, TokenBucket{}, {}};
+    if (connection.protocol == Protocol::Binary) {
+      state.frames.restore(connection.input);
+    } else {
+      state.input.restore(connection.input);
+    }
+    _restore_batch(state, connection.batch);
+    ingress.connections.insert_or_assign(connection_id, std::move(state));
+    {
+      std::unique_lock _l{_owners_mutex};
+      _owners[connection_id] = {ingress.reactor.get(), connection.protocol};
     }
-    ++connection_it;
+    _start_timers(ingress, connection_id, connection.username.has_value());
+    spdlog::debug("Restored session {} for connection {}",
+                  connection.session_id, connection_id);
   }
 }
-} // namespace auction_house::engine
\ No newline at end of file
+} // namespace auction_house::engine
@@ -0,0 +1,350 @@
+//
+// Created by mswiercz on 29.11.2021.
+//
+#include "shm_reactor.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <spdlog/spdlog.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace auction_house::network {
+// Kinds of the registered descriptors, kept in the upper half of the epoll
+// user data
+enum class Source : std::uint32_t { Listener, Socket, Notification, Wakeup };
+
+static std::uint64_t encode(const Source source, const int fd) {
+  return (static_cast<std::uint64_t>(source) << 32) |
+         static_cast<std::uint32_t>(fd);
+}
+
+static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+  _mm_pause();
+#endif
+}
+
+static bool watch(const int epoll_fd, const int fd, const std::uint32_t events,
+                  const Source source) {
+  epoll_event event{};
+  event.events = events;
+  event.data.u64 = encode(source, fd);
+  return epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != SOCKET_ERROR;
+}
+
+ConnectionId ShmReactor::init_server_socket(const uint16_t port) {
+  spdlog::error("Shared memory clients can't connect through port {}!", port);
+  std::exit(1);
+}
+
+ConnectionId ShmReactor::init_unix_server_socket(const std::string &path) {
+  if (_epoll_fd == INVALID_CONNECTION) {
+    _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    _wakeup_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (_epoll_fd == INVALID_CONNECTION || _wakeup_fd == INVALID_CONNECTION ||
+        !watch(_epoll_fd, _wakeup_fd, EPOLLIN, Source::Wakeup)) {
+      spdlog::error("Couldn't create an epoll instance!");
+      std::exit(1);
+    }
+  }
+  auto server_fd = create_unix_server_socket(path, {});
+  auto flags = fcntl(server_fd, F_GETFL, 0);
+  if (flags == -1 || fcntl(server_fd, F_SETFL, flags | O_NONBLOCK) == -1 ||
+      !watch(_epoll_fd, server_fd, EPOLLIN, Source::Listener)) {
+    spdlog::error("Couldn't register the server socket!");
+    std::exit(1);
+  }
+  return server_fd;
+}
+
+void ShmReactor::close_connection(const ConnectionId connection) {
+  spdlog::info("Closing connection {}!", connection);
+  auto connection_it = _connections.find(connection);
+  if (connection_it != _connections.end()) {
+    // the client shares the notification descriptor, closing it doesn't
+    // remove it from the epoll set
+    epoll_ctl(_epoll_fd, EPOLL_CTL_DEL,
+              connection_it->second.channel->server_event(), nullptr);
+    _connections.erase(connection_it);
+  }
+  close(connection);
+}
+
+std::vector<ConnectionId>
+ShmReactor::handle_new_connections(const ConnectionId server_fd) {
+  std::vector<ConnectionId> accepted;
+  while (accepted.size() < MAX_ACCEPTS) {
+    auto client_fd =
+        accept4(server_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (client_fd == SOCKET_ERROR) {
+      if (errno == EINTR || errno == ECONNABORTED) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        spdlog::error("Accepting a new connection has failed: {}!",
+                      std::strerror(errno));
+      }
+      break;
+    }
+    auto channel = ShmChannel::create(RING_CAPACITY);
+    if (!channel || !send_channel(client_fd, *channel) ||
+        !watch(_epoll_fd, client_fd, EPOLLRDHUP | EPOLLET, Source::Socket) ||
+        !watch(_epoll_fd, channel->server_event(), EPOLLIN,
+               Source::Notification)) {
+      spdlog::error("Couldn't set up a shared memory channel for {}!",
+                    client_fd);
+      if (channel) {
+        epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, channel->server_event(), nullptr);
+      }
+      close(client_fd);
+      continue;
+    }
+    spdlog::info("Received new shared memory connection {}", client_fd);
+    _connections[client_fd].channel = std::move(channel);
+    accepted.push_back(client_fd);
+  }
+  return accepted;
+}
+
+ReceivedData ShmReactor::receive_data(const ConnectionId connection) {
+  ReceivedData result{};
+  auto connection_it = _connections.find(connection);
+  if (connection_it == _connections.end()) {
+    return result;
+  }
+  auto &state = connection_it->second;
+  auto &requests = state.channel->requests();
+  // never more than the capacity, the client may write the ring meanwhile
+  result.data.resize(requests.readable());
+  result.data.resize(requests.read(result.data.data(), result.data.size()));
+  if (!result.data.empty() && requests.producer_waiting()) {
+    state.channel->notify_client();
+  }
+  _check_channel(connection, state);
+  result.hung_up = state.hung_up;
+  return result;
+}
+
+void ShmReactor::_take_outgoing() {
+  if (!_pending_replies.exchange(false)) {
+    return;
+  }
+  std::vector<ConnectionId> touched;
+  for (auto &[connection, reply] : _outbox.take()) {
+    auto connection_it = _connections.find(connection);
+    if (connection_it == _connections.end()) {
+      spdlog::debug("Dropping data for closed connection {}", connection);
+      continue;
+    }
+    connection_it->second.output.push_response(std::move(reply));
+    touched.push_back(connection);
+  }
+  for (auto connection : touched) {
+    auto connection_it = _connections.find(connection);
+    if (connection_it != _connections.end()) {
+      _flush(connection_it->second);
+      _check_channel(connection, connection_it->second);
+      _enforce_limit(connection, connection_it->second);
+    }
+  }
+}
+
+void ShmReactor::_check_channel(const ConnectionId connection,
+                                Connection &state) {
+  if (state.hung_up || !state.channel->corrupted()) {
+    return;
+  }
+  spdlog::warn("Connection {} has corrupted its shared memory rings, "
+               "hanging it up!",
+               connection);
+  shutdown(connection, SHUT_RDWR);
+  state.output = OutputQueue{};
+  state.hung_up = true;
+}
+
+void ShmReactor::_flush(Connection &state) {
+  auto &replies = state.channel->replies();
+  auto written = false;
+  while (!state.output.empty()) {
+    auto piece = state.output.front();
+    auto size = replies.write(piece);
+    state.output.consume(size);
+    written = written || size > 0;
+    if (size < piece.size()) {
+      break; // the ring is full, the client notifies once it reads
+    }
+  }
+  if (written && replies.consumer_waiting()) {
+    state.channel->notify_client();
+  }
+  if (state.paused && state.output.size() <= _limit.max_pending_bytes / 2) {
+    state.paused = false;
+  }
+}
+
+void ShmReactor::_enforce_limit(const ConnectionId connection,
+                                Connection &state) {
+  if (state.paused || state.hung_up ||
+      state.output.size() <= _limit.max_pending_bytes) {
+    return;
+  }
+  if (_limit.policy == SlowClientPolicy::PauseReading) {
+    state.paused = true;
+    auto count = ++_paused_count;
+    spdlog::warn("Connection {} doesn't read its replies, {} bytes pending, "
+                 "pausing it! Paused {} times so far.",
+                 connection, state.output.size(), count);
+    return;
+  }
+  auto count = ++_disconnected_count;
+  spdlog::warn("Connection {} doesn't read its replies, {} bytes pending, "
+               "disconnecting it! Disconnected {} times so far.",
+               connection, state.output.size(), count);
+  shutdown(connection, SHUT_RDWR);
+  state.output = OutputQueue{};
+  state.hung_up = true;
+}
+
+void ShmReactor::_collect_ready(std::vector<ConnectionId> &ready) {
+  for (auto &[connection, state] : _connections) {
+    auto readable = !state.paused && state.channel->requests().readable() > 0;
+    _check_channel(connection, state);
+    if (state.hung_up || readable) {
+      ready.push_back(connection);
+    }
+  }
+}
+
+bool ShmReactor::_poll(std::vector<ConnectionId> &ready, const int timeout_ms) {
+  auto n_events =
+      epoll_wait(_epoll_fd, _events.data(), _events.size(), timeout_ms);
+  if (n_events == SOCKET_ERROR) {
+    if (errno != EINTR) {
+      spdlog::error("Waiting for incoming connections/data has failed!");
+    }
+    return false;
+  }
+  for (auto i = 0; i < n_events; ++i) {
+    auto source = static_cast<Source>(_events[i].data.u64 >> 32);
+    auto fd = static_cast<int>(_events[i].data.u64 & 0xffffffff);
+    switch (source) {
+    case Source::Listener:
+      ready.push_back(fd);
+      break;
+    case Source::Wakeup:
+    case Source::Notification:
+      ShmChannel::drain(fd);
+      break;
+    case Source::Socket: {
+      auto connection_it = _connections.find(fd);
+      if (connection_it != _connections.end()) {
+        connection_it->second.hung_up = true;
+      }
+      break;
+    }
+    }
+  }
+  _next_poll = std::chrono::steady_clock::now() + POLL_INTERVAL;
+  return true;
+}
+
+bool ShmReactor::_prepare_sleep() {
+  _sleeping.store(true);
+  auto can_sleep = !_pending_replies.load();
+  for (auto &[connection, state] : _connections) {
+    if (!state.paused && !state.channel->requests().prepare_consumer_wait()) {
+      can_sleep = false;
+    }
+    if (!state.output.empty() &&
+        !state.channel->replies().prepare_producer_wait()) {
+      can_sleep = false;
+    }
+    // a corrupted connection is hung up before sleeping
+    if (!state.hung_up && state.channel->corrupted()) {
+      can_sleep = false;
+    }
+  }
+  return can_sleep;
+}
+
+void ShmReactor::_finish_sleep() {
+  _sleeping.store(false);
+  for (auto &[connection, state] : _connections) {
+    state.channel->requests().finish_consumer_wait();
+    state.channel->replies().finish_producer_wait();
+  }
+}
+
+std::vector<ConnectionId> ShmReactor::wait_for_traffic(
+    const std::optional<std::chrono::milliseconds> timeout) {
+  std::vector<ConnectionId> ready{};
+  for (unsigned spin = 0; spin < _spin_count && ready.empty(); ++spin) {
+    _take_outgoing();
+    for (auto &[connection, state] : _connections) {
+      if (!state.output.empty()) {
+        _flush(state);
+      }
+    }
+    _collect_ready(ready);
+    if (std::chrono::steady_clock::now() >= _next_poll) {
+      _poll(ready, 0);
+    }
+    cpu_relax();
+  }
+  if (ready.empty()) {
+    if (_prepare_sleep()) {
+      _poll(ready,
+            timeout.has_value() ? static_cast<int>(timeout->count()) : -1);
+    }
+    _finish_sleep();
+    _take_outgoing();
+    for (auto &[connection, state] : _connections) {
+      if (!state.output.empty()) {
+        _flush(state);
+      }
+    }
+    _collect_ready(ready);
+  }
+  std::sort(ready.begin(), ready.end());
+  ready.erase(std::unique(ready.begin(), ready.end()), ready.end());
+  return ready;
+}
+
+void ShmReactor::send_data(ConnectionId connection, Reply reply) {
+  _outbox.push(connection, std::move(reply));
+  _pending_replies.store(true);
+  if (_sleeping.load()) {
+    wake_up();
+  }
+}
+
+void ShmReactor::wake_up() {
+  // keeps the reactor from falling asleep if it's still spinning
+  _pending_replies.store(true);
+  std::uint64_t value = 1;
+  if (write(_wakeup_fd, &value, sizeof(value)) == SOCKET_ERROR) {
+    spdlog::error("Couldn't wake up the shared memory reactor!");
+  }
+}
+
+EgressStats ShmReactor::egress_stats() const {
+  return {_paused_count.load(std::memory_order_relaxed),
+          _disconnected_count.load(std::memory_order_relaxed)};
+}
+
+ShmReactor::~ShmReactor() {
+  _connections.clear();
+  if (_wakeup_fd != INVALID_CONNECTION) {
+    close(_wakeup_fd);
+  }
+  if (_epoll_fd != INVALID_CONNECTION) {
+    close(_epoll_fd);
+  }
+}
+} // namespace auction_house::network
@@ -0,0 +1,272 @@
+//
+// Created by mswiercz on 29.11.2021.
+//
+#include "shm_transport.h"
+#include "binary_protocol.h"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <spdlog/spdlog.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <system_error>
+#include <thread>
+#include <unistd.h>
+
+namespace auction_house::network {
+constexpr unsigned SPIN_COUNT = 4096;
+constexpr auto CHANNEL_FDS = 3;
+
+static std::size_t segment_size(const std::uint32_t capacity) {
+  return sizeof(ShmLayout) + 2 * static_cast<std::size_t>(capacity);
+}
+
+ShmChannel::ShmChannel(const int memfd, const int server_event,
+                       const int client_event, void *memory,
+                       const std::size_t size, const std::uint32_t capacity)
+    : _memfd(memfd), _server_event(server_event), _client_event(client_event),
+      _memory(memory), _size(size),
+      _requests(static_cast<ShmLayout *>(memory)->requests,
+                static_cast<char *>(memory) + sizeof(ShmLayout), capacity),
+      _replies(static_cast<ShmLayout *>(memory)->replies,
+               static_cast<char *>(memory) + sizeof(ShmLayout) + capacity,
+               capacity) {}
+
+std::unique_ptr<ShmChannel> ShmChannel::create(const std::uint32_t capacity) {
+  auto memfd = memfd_create("auction_house", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  auto server_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  auto client_event = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  auto size = segment_size(capacity);
+  void *memory = MAP_FAILED;
+  if (memfd != -1 && server_event != -1 && client_event != -1 &&
+      ftruncate(memfd, static_cast<off_t>(size)) == 0 &&
+      fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) ==
+          0) {
+    memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+  }
+  if (memory == MAP_FAILED) {
+    spdlog::error("Couldn't create a shared memory segment: {}!",
+                  std::strerror(errno));
+    for (auto fd : {memfd, server_event, client_event}) {
+      if (fd != -1) {
+        close(fd);
+      }
+    }
+    return nullptr;
+  }
+  // a fresh segment is zeroed, the rings start empty
+  auto *layout = new (memory) ShmLayout{};
+  layout->magic = SHM_MAGIC;
+  layout->capacity = capacity;
+  return std::unique_ptr<ShmChannel>{new ShmChannel{
+      memfd, server_event, client_event, memory, size, capacity}};
+}
+
+std::unique_ptr<ShmChannel> ShmChannel::map(const int memfd,
+                                            const int server_event,
+                                            const int client_event) {
+  struct stat memfd_stat {};
+  void *memory = MAP_FAILED;
+  if (fstat(memfd, &memfd_stat) == 0 &&
+      static_cast<std::size_t>(memfd_stat.st_size) >= sizeof(ShmLayout)) {
+    memory = mmap(nullptr, memfd_stat.st_size, PROT_READ | PROT_WRITE,
+                  MAP_SHARED, memfd, 0);
+  }
+  if (memory != MAP_FAILED) {
+    auto *layout = static_cast<ShmLayout *>(memory);
+    auto capacity = layout->capacity;
+    if (layout->magic == SHM_MAGIC && capacity > 0 &&
+        (capacity & (capacity - 1)) == 0 &&
+        segment_size(capacity) <=
+            static_cast<std::size_t>(memfd_stat.st_size)) {
+      return std::unique_ptr<ShmChannel>{
+          new ShmChannel{memfd, server_event, client_event, memory,
+                         static_cast<std::size_t>(memfd_stat.st_size),
+                         capacity}};
+    }
+    munmap(memory, memfd_stat.st_size);
+  }
+  for (auto fd : {memfd, server_event, client_event}) {
+    close(fd);
+  }
+  return nullptr;
+}
+
+ShmChannel::~ShmChannel() {
+  munmap(_memory, _size);
+  close(_memfd);
+  close(_server_event);
+  close(_client_event);
+}
+
+unsigned spin_count() {
+  static const unsigned count =
+      std::thread::hardware_concurrency() > 1 ? SPIN_COUNT : 0;
+  return count;
+}
+
+static void notify(const int event) {
+  std::uint64_t value = 1;
+  if (write(event, &value, sizeof(value)) == -1 && errno != EAGAIN) {
+    spdlog::error("Couldn't notify the other side of a channel!");
+  }
+}
+
+void ShmChannel::notify_server() const { notify(_server_event); }
+
+void ShmChannel::notify_client() const { notify(_client_event); }
+
+void ShmChannel::drain(const int event) {
+  std::uint64_t value;
+  while (read(event, &value, sizeof(value)) > 0) {
+  }
+}
+
+bool send_channel(const int socket, const ShmChannel &channel) {
+  std::array<int, CHANNEL_FDS> fds{channel.memfd(), channel.server_event(),
+                                   channel.client_event()};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+  char magic = 'M';
+  iovec iov{&magic, sizeof(magic)};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  auto *cmsg = CMSG_FIRSTHDR(&message);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+  std::memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(fds));
+  return sendmsg(socket, &message, MSG_NOSIGNAL) == sizeof(magic);
+}
+
+// Receives the channel's descriptors from the server
+static ShmChannelPtr receive_channel(const int socket) {
+  std::array<int, CHANNEL_FDS> fds{};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+  char magic;
+  iovec iov{&magic, sizeof(magic)};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  if (recvmsg(socket, &message, MSG_CMSG_CLOEXEC) != sizeof(magic)) {
+    return nullptr;
+  }
+  auto *cmsg = CMSG_FIRSTHDR(&message);
+  if (cmsg == nullptr || cmsg->cmsg_level != SOL_SOCKET ||
+      cmsg->cmsg_type != SCM_RIGHTS ||
+      cmsg->cmsg_len != CMSG_LEN(sizeof(fds))) {
+    return nullptr;
+  }
+  std::memcpy(fds.data(), CMSG_DATA(cmsg), sizeof(fds));
+  return ShmChannel::map(fds[0], fds[1], fds[2]);
+}
+
+static std::system_error system_error(const std::string &what) {
+  return std::system_error{errno, std::generic_category(), what};
+}
+
+ShmClient::ShmClient(const std::string &path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    throw std::system_error{std::make_error_code(std::errc::invalid_argument),
+                            "Invalid shared memory socket path"};
+  }
+  path.copy(address.sun_path, path.size());
+  _socket = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (_socket == -1) {
+    throw system_error("Couldn't create a socket");
+  }
+  if (connect(_socket, reinterpret_cast<sockaddr *>(&address),
+              sizeof(address)) == -1) {
+    auto error = system_error("Couldn't connect to " + path);
+    close(_socket);
+    throw error;
+  }
+  _channel = receive_channel(_socket);
+  if (!_channel) {
+    close(_socket);
+    throw std::system_error{std::make_error_code(std::errc::protocol_error),
+                            "Invalid shared memory handshake"};
+  }
+}
+
+ShmClient::~ShmClient() {
+  _channel.reset();
+  close(_socket);
+}
+
+void ShmClient::send(std::string_view frame) {
+  auto &requests = _channel->requests();
+  unsigned spins = 0;
+  while (!frame.empty()) {
+    auto written = requests.write(frame);
+    frame.remove_prefix(written);
+    if (written > 0) {
+      if (requests.consumer_waiting()) {
+        _channel->notify_server();
+      }
+      spins = 0;
+    } else if (++spins > spin_count() && requests.prepare_producer_wait()) {
+      _wait();
+      requests.finish_producer_wait();
+      spins = 0;
+    }
+  }
+}
+
+std::pair<ResultCode, std::string> ShmClient::receive() {
+  auto &replies = _channel->replies();
+  std::array<char, 4096> buffer{};
+  unsigned spins = 0;
+  for (;;) {
+    // the length in the header covers the result code and the text
+    if (_received.size() >= engine::REPLY_HEADER_SIZE) {
+      engine::FrameReader reader{_received};
+      auto length = static_cast<std::size_t>(reader.read_u32());
+      auto result = static_cast<ResultCode>(reader.read_u8());
+      if (length > 0 && _received.size() >= sizeof(std::uint32_t) + length) {
+        auto text = _received.substr(engine::REPLY_HEADER_SIZE, length - 1);
+        _received.erase(0, sizeof(std::uint32_t) + length);
+        return {result, std::move(text)};
+      }
+    }
+    auto received = replies.read(buffer.data(), buffer.size());
+    if (received > 0) {
+      _received.append(buffer.data(), received);
+      if (replies.producer_waiting()) {
+        _channel->notify_server();
+      }
+      spins = 0;
+    } else if (++spins > spin_count() && replies.prepare_consumer_wait()) {
+      _wait();
+      replies.finish_consumer_wait();
+      spins = 0;
+    }
+  }
+}
+
+void ShmClient::_wait() {
+  std::array<pollfd, 2> fds{{{_channel->client_event(), POLLIN, 0},
+                             {_socket, POLLRDHUP, 0}}};
+  while (poll(fds.data(), fds.size(), -1) == -1) {
+    if (errno != EINTR) {
+      throw system_error("Waiting for the server has failed");
+    }
+  }
+  if (fds[1].revents != 0) {
+    throw std::system_error{std::make_error_code(std::errc::connection_reset),
+                            "The server has hung up"};
+  }
+  ShmChannel::drain(_channel->client_event());
+}
+} // namespace auction_house::network
@@ -0,0 +1,98 @@
+//
+// Created by mswiercz on 29.11.2021.
+//
+#include "spsc_ring.h"
+#include <algorithm>
+#include <cstring>
+
+namespace auction_house::network {
+SpscRing::SpscRing(RingHeader &header, char *data, const std::size_t capacity)
+    : _header(header), _data(data), _capacity(capacity),
+      _head(header.head.load(std::memory_order_acquire)),
+      _tail(header.tail.load(std::memory_order_acquire)) {}
+
+std::size_t SpscRing::write(std::string_view data) {
+  auto size = std::min(data.size(), writable());
+  auto offset = static_cast<std::size_t>(_tail & (_capacity - 1));
+  auto first = std::min(size, _capacity - offset);
+  std::memcpy(_data + offset, data.data(), first);
+  std::memcpy(_data, data.data() + first, size - first);
+  _tail += size;
+  _header.tail.store(_tail, std::memory_order_release);
+  return size;
+}
+
+std::size_t SpscRing::read(char *buffer, const std::size_t size) {
+  auto available = std::min(size, readable());
+  auto offset = static_cast<std::size_t>(_head & (_capacity - 1));
+  auto first = std::min(available, _capacity - offset);
+  std::memcpy(buffer, _data + offset, first);
+  std::memcpy(buffer + first, _data, available - first);
+  _head += available;
+  _header.head.store(_head, std::memory_order_release);
+  return available;
+}
+
+// The positions only grow and wrap around together, their difference is the
+// number of bytes in the ring whatever their values are
+
+std::size_t SpscRing::readable() const {
+  auto readable = _header.tail.load(std::memory_order_acquire) - _head;
+  if (_corrupted || readable > _capacity) {
+    _corrupted = true;
+    return 0;
+  }
+  return static_cast<std::size_t>(readable);
+}
+
+std::size_t SpscRing::writable() const {
+  auto used = _tail - _header.head.load(std::memory_order_acquire);
+  if (_corrupted || used > _capacity) {
+    _corrupted = true;
+    return 0;
+  }
+  return _capacity - static_cast<std::size_t>(used);
+}
+
+// The announcement and the check of the other side's position are separated
+// by full fences on both sides, so either the waiting side sees the new data
+// or the other side sees the announcement
+
+bool SpscRing::prepare_consumer_wait() {
+  _header.consumer_waiting.store(1, std::memory_order_seq_cst);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (readable() > 0) {
+    finish_consumer_wait();
+    return false;
+  }
+  return true;
+}
+
+void SpscRing::finish_consumer_wait() {
+  _header.consumer_waiting.store(0, std::memory_order_relaxed);
+}
+
+bool SpscRing::consumer_waiting() const {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return _header.consumer_waiting.load(std::memory_order_relaxed) != 0;
+}
+
+bool SpscRing::prepare_producer_wait() {
+  _header.producer_waiting.store(1, std::memory_order_seq_cst);
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (writable() > 0) {
+    finish_producer_wait();
+    return false;
+  }
+  return true;
+}
+
+void SpscRing::finish_producer_wait() {
+  _header.producer_waiting.store(0, std::memory_order_relaxed);
+}
+
+bool SpscRing::producer_waiting() const {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  return _header.producer_waiting.load(std::memory_order_relaxed) != 0;
+}
+} // namespace auction_house::network
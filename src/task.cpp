@@ -0,0 +1,54 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#include "task.h"
+
+namespace auction_house::engine {
+Task Task::ready(EgressEvent &&event) {
+  Task task{[event = std::move(event)]() mutable { return std::move(event); }};
+  task._ready = true;
+  return task;
+}
+
+Task::Task(Task &&other) noexcept
+    : _operations(other._operations), _ready(other._ready) {
+  if (_operations != nullptr) {
+    _operations->move(other._storage, _storage);
+    other._operations = nullptr;
+  }
+  other._ready = false;
+}
+
+Task &Task::operator=(Task &&other) noexcept {
+  if (this != &other) {
+    _reset();
+    _operations = other._operations;
+    _ready = other._ready;
+    if (_operations != nullptr) {
+      _operations->move(other._storage, _storage);
+      other._operations = nullptr;
+    }
+    other._ready = false;
+  }
+  return *this;
+}
+
+Task::~Task() { _reset(); }
+
+EgressEvent Task::get() {
+  // the function is destroyed even if it throws
+  struct Reset {
+    Task &task;
+    ~Reset() { task._reset(); }
+  } reset{*this};
+  return _operations->run(_storage);
+}
+
+void Task::_reset() {
+  if (_operations != nullptr) {
+    _operations->destroy(_storage);
+    _operations = nullptr;
+  }
+  _ready = false;
+}
+} // namespace auction_house::engine
@@ -3,25 +3,159 @@
 //
 #include "tasks.h"
 #include "auction_processor.h"
+#include "binary_protocol.h"
 #include "command.h"
 #include "database.h"
+#include "tasks_executor.h"
+#include <algorithm>
+#include <memory>
+#include <spdlog/spdlog.h>
+#include <type_traits>
+#include <variant>
 
 namespace auction_house::engine {
+Request::Request(IngressEvent &&event)
+    : event(std::move(event)),
+      command(this->event.protocol == Protocol::Binary
+                  ? Command::decode(this->event)
+                  : Command::parse(this->event)) {}
+
+Request::Request(Request &&other) noexcept
+    : Request(std::move(other), other.event.data) {}
+
+// The data is viewed before it's moved, a short one moves to another address
+Request::Request(Request &&other, const std::string_view data) noexcept
+    : event(std::move(other.event)), command(std::move(other.command)) {
+  command.rebase(data, event.data.data());
+}
+
+static_assert(sizeof(Request) + sizeof(Database *) <= Task::INLINE_SIZE,
+              "A command task has to keep its request inline");
+
 Task create_command_task(IngressEvent &&event, Database &database) {
-  return std::async(
-      std::launch::deferred,
-      [&database](IngressEvent event) {
-        return Command::parse(std::move(event))->execute(database);
-      },
-      std::move(event));
+  // parsed by the calling thread, the tasks processor only executes commands
+  return create_command_task(Request{std::move(event)}, database);
+}
+
+Task create_command_task(Request &&request, Database &database) {
+  if (!request.command.valid()) {
+    // a wrong command doesn't touch the database, it's answered right away
+    return create_reply_task(request.command.execute(request.event, database));
+  }
+  return [&database, request = std::move(request)]() mutable {
+    // tasks of a session are executed in order, so the username reflects all
+    // the commands sent before
+    request.event.username =
+        database.sessions.get_username(request.event.session_id);
+    return request.command.execute(request.event, database);
+  };
 }
 
-Task create_auction_task(Auction &&auction, Database &database) {
-  return std::async(
-      std::launch::deferred,
-      [&database](Auction auction) {
-        return process_auction(database, std::move(auction));
+// Commands which change nothing but the account of the user
+static bool is_account_command(const Command &command) {
+  return std::visit(
+      [](const auto &parsed) {
+        using Type = std::decay_t<decltype(parsed)>;
+        return std::is_same_v<Type, commands::DepositFunds> ||
+               std::is_same_v<Type, commands::DepositItem> ||
+               std::is_same_v<Type, commands::DepositMany> ||
+               std::is_same_v<Type, commands::WithdrawFunds> ||
+               std::is_same_v<Type, commands::WithdrawItem> ||
+               std::is_same_v<Type, commands::ShowFunds> ||
+               std::is_same_v<Type, commands::ShowItems>;
       },
-      std::move(auction));
+      command.get());
+}
+
+static EgressEvent execute_batch(std::vector<Request> &requests,
+                                 const SessionId session_id, const bool atomic,
+                                 Database &database) {
+  auto username = database.sessions.get_username(session_id);
+  // an atomic batch has account commands only, no one else touches the
+  // account while it's executed
+  std::optional<UserAccount> account;
+  if (atomic && username.has_value()) {
+    account = database.accounts.get_account(username.value());
+  }
+  // binary clients get the reply frames of the commands, some of them are
+  // typed
+  auto binary = requests.front().event.protocol == Protocol::Binary;
+  std::string data;
+  auto append = [&data, binary](std::string_view reply,
+                                const ResultCode result) {
+    if (binary) {
+      data += frame_reply(static_cast<std::uint8_t>(result), reply);
+    } else {
+      data.append(data.empty() ? "" : "\n").append(reply);
+    }
+  };
+  auto result = ResultCode::Ok;
+  for (auto &request : requests) {
+    request.event.username = username;
+    auto reply = request.command.execute(request.event, database);
+    append(reply.data.view(), reply.result);
+    if (reply.result == ResultCode::Ok) {
+      auto &command = request.command.get();
+      if (std::holds_alternative<commands::Login>(command) ||
+          std::holds_alternative<commands::Logout>(command)) {
+        username = database.sessions.get_username(session_id);
+      }
+      continue;
+    }
+    if (result == ResultCode::Ok) {
+      result = reply.result;
+    }
+    if (atomic) {
+      if (username.has_value()) {
+        database.accounts.restore_account(username.value(),
+                                          std::move(account));
+      }
+      append("The batch has been rolled back!", result);
+      break;
+    }
+  }
+  spdlog::info("user {}, session {}, executed a batch of {} commands, "
+               "result: {}",
+               username.value_or(""), session_id, requests.size(),
+               static_cast<int>(result));
+  return {session_id, std::move(data), result};
+}
+
+Task create_batch_task(std::vector<Request> &&requests,
+                       const SessionId session_id, const bool atomic,
+                       Database &database) {
+  if (requests.empty()) {
+    return create_reply_task({session_id, "The batch is empty!"});
+  }
+  if (atomic && !std::all_of(requests.begin(), requests.end(),
+                             [](const Request &request) {
+                               return is_account_command(request.command);
+                             })) {
+    return create_reply_task(
+        {session_id, "Only account commands can be executed atomically!",
+         ResultCode::InvalidArgument});
+  }
+  return [&database, session_id, atomic,
+          requests = std::move(requests)]() mutable {
+    return execute_batch(requests, session_id, atomic, database);
+  };
+}
+
+Task create_settlement_task(ExpiredAuctions &&auctions,
+                            Database &database, TasksExecutor &tasks) {
+  return [&database, &tasks, auctions = std::move(auctions)]() mutable {
+    for (auto &auction : auctions) {
+      auto event = process_auction(database, std::move(auction));
+      if (event.session_id.has_value()) {
+        auto session_id = event.session_id;
+        tasks.enqueue(create_reply_task(std::move(event)), session_id);
+      }
+    }
+    return EgressEvent{};
+  };
+}
+
+Task create_reply_task(EgressEvent &&event) {
+  return Task::ready(std::move(event));
 }
 } // namespace auction_house::engine
\ No newline at end of file
@@ -0,0 +1,74 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#include "tasks_executor.h"
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+
+namespace auction_house::engine {
+// An exclusive task shared by the barriers queued to every worker
+class Exclusive {
+public:
+  Exclusive(Task &&task, const std::size_t workers)
+      : _task(std::move(task)), _remaining(workers) {}
+
+  // The last worker to arrive runs the task, the others return an empty
+  // event once it's done
+  EgressEvent arrive() {
+    std::unique_lock l{_mutex};
+    if (--_remaining > 0) {
+      _cv.wait(l, [this] { return _done; });
+      return {};
+    }
+    l.unlock();
+    // the others are released even if the task throws
+    struct Release {
+      Exclusive &exclusive;
+      ~Release() {
+        {
+          std::lock_guard _l{exclusive._mutex};
+          exclusive._done = true;
+        }
+        exclusive._cv.notify_all();
+      }
+    } release{*this};
+    return _task.get();
+  }
+
+private:
+  Task _task;
+  std::size_t _remaining;
+  bool _done = false;
+  std::mutex _mutex;
+  std::condition_variable _cv;
+};
+
+TasksExecutor::TasksExecutor(const std::size_t workers)
+    : _queues(std::max<std::size_t>(workers, 1)) {}
+
+void TasksExecutor::enqueue(Task &&task,
+                            const std::optional<SessionId> session) {
+  auto &queue = session.has_value() ? _queues[session.value() % _queues.size()]
+                                    : _queues.front();
+  queue.enqueue(std::move(task), session);
+}
+
+void TasksExecutor::enqueue_exclusive(Task &&task) {
+  if (_queues.size() == 1) {
+    _queues.front().enqueue_barrier(std::move(task));
+    return;
+  }
+  auto exclusive = std::make_shared<Exclusive>(std::move(task), _queues.size());
+  // two exclusive tasks queued in a different order to two workers would
+  // wait for each other forever
+  std::lock_guard _l{_exclusive_mutex};
+  for (auto &queue : _queues) {
+    queue.enqueue_barrier([exclusive] { return exclusive->arrive(); });
+  }
+}
+
+Task TasksExecutor::pop(const std::size_t worker) {
+  return _queues[worker].pop();
+}
+} // namespace auction_house::engine
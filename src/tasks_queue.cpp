@@ -2,21 +2,65 @@
 // Created by mswiercz on 22.11.2021.
 //
 #include "tasks_queue.h"
+#include <algorithm>
 
 namespace auction_house::engine {
-void TasksQueue::enqueue(Task&& task) {
+void TasksQueue::enqueue(Task &&task, const std::optional<SessionId> session) {
   {
-    std::lock_guard _l {_mutex};
-    _queue.push_back(std::move(task));
+    std::lock_guard _l{_mutex};
+    auto &tasks = _sessions[session];
+    if (tasks.empty()) {
+      _turns.push_back(session);
+    }
+    tasks.push_back({std::move(task), _sequence++});
+    ++_size;
+  }
+  _cv.notify_one();
+}
+
+void TasksQueue::enqueue_barrier(Task &&task) {
+  {
+    std::lock_guard _l{_mutex};
+    _barriers.push_back({std::move(task), _sequence++, _size});
   }
   _cv.notify_one();
 }
 
 Task TasksQueue::pop() {
   std::unique_lock l{_mutex};
-  _cv.wait(l, [this]{return !this->_queue.empty();});
-  auto task = std::move(_queue.front());
-  _queue.pop_front();
-  return task;
+  _cv.wait(l, [this] {
+    return !_turns.empty() ||
+           (!_barriers.empty() && _barriers.front().remaining == 0);
+  });
+  if (!_barriers.empty() && _barriers.front().remaining == 0) {
+    auto task = std::move(_barriers.front().task);
+    _barriers.pop_front();
+    return task;
+  }
+
+  // while a barrier waits, only the tasks queued before it can be popped
+  auto turn = _turns.begin();
+  if (!_barriers.empty()) {
+    turn = std::find_if(_turns.begin(), _turns.end(), [this](const Key &key) {
+      return _sessions[key].front().sequence < _barriers.front().sequence;
+    });
+  }
+  auto session = *turn;
+  _turns.erase(turn);
+  auto tasks_it = _sessions.find(session);
+  auto entry = std::move(tasks_it->second.front());
+  tasks_it->second.pop_front();
+  if (tasks_it->second.empty()) {
+    _sessions.erase(tasks_it);
+  } else {
+    _turns.push_back(session);
+  }
+  --_size;
+  for (auto &barrier : _barriers) {
+    if (barrier.sequence > entry.sequence) {
+      --barrier.remaining;
+    }
+  }
+  return std::move(entry.task);
 }
-}
\ No newline at end of file
+} // namespace auction_house::engine
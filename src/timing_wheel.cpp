@@ -0,0 +1,81 @@
+//
+// Created by mswiercz on 28.11.2021.
+//
+#include "timing_wheel.h"
+#include <algorithm>
+
+namespace auction_house::engine {
+TimingWheel::TimingWheel(const Clock::duration tick, const std::size_t slots,
+                         const Clock::time_point start)
+    : _tick(tick), _start(start), _slots(std::max<std::size_t>(slots, 1)) {}
+
+void TimingWheel::schedule(const ConnectionId connection,
+                           const Clock::duration timeout,
+                           const Clock::time_point now) {
+  // rounded up, a timer never expires too early
+  auto elapsed = std::max(now - _start + timeout, Clock::duration::zero());
+  auto deadline =
+      static_cast<std::uint64_t>((elapsed + _tick - Clock::duration{1}) / _tick);
+  // the current tick's slot has already been visited
+  deadline = std::max(deadline, _current + 1);
+  auto slot = deadline % _slots.size();
+
+  auto timer_it = _timers.find(connection);
+  if (timer_it == _timers.end()) {
+    auto &list = _slots[slot];
+    auto position = list.insert(list.end(), connection);
+    _timers.emplace(connection, Timer{deadline, slot, position});
+    return;
+  }
+  // restarted timers are moved between the slots without reallocating
+  auto &timer = timer_it->second;
+  if (timer.slot != slot) {
+    _slots[slot].splice(_slots[slot].end(), _slots[timer.slot],
+                        timer.position);
+    timer.slot = slot;
+  }
+  timer.deadline = deadline;
+}
+
+void TimingWheel::cancel(const ConnectionId connection) {
+  auto timer_it = _timers.find(connection);
+  if (timer_it == _timers.end()) {
+    return;
+  }
+  _slots[timer_it->second.slot].erase(timer_it->second.position);
+  _timers.erase(timer_it);
+}
+
+std::vector<ConnectionId> TimingWheel::advance(const Clock::time_point now) {
+  std::vector<ConnectionId> expired;
+  auto target = _ticks(now);
+  if (target <= _current) {
+    return expired;
+  }
+  // after a full turn every slot has been visited, timers of the later turns
+  // are left in place
+  auto steps = std::min<std::uint64_t>(target - _current, _slots.size());
+  for (std::uint64_t step = 1; step <= steps; ++step) {
+    auto &slot = _slots[(_current + step) % _slots.size()];
+    for (auto it = slot.begin(); it != slot.end();) {
+      auto timer_it = _timers.find(*it);
+      if (timer_it->second.deadline > target) {
+        ++it;
+        continue;
+      }
+      expired.push_back(*it);
+      _timers.erase(timer_it);
+      it = slot.erase(it);
+    }
+  }
+  _current = target;
+  return expired;
+}
+
+std::uint64_t TimingWheel::_ticks(const Clock::time_point now) const {
+  if (now < _start) {
+    return 0;
+  }
+  return static_cast<std::uint64_t>((now - _start) / _tick);
+}
+} // namespace auction_house::engine
@@ -0,0 +1,584 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#include "uring_reactor.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <spdlog/spdlog.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/utsname.h>
+#include <unistd.h>
+
+namespace auction_house::network {
+constexpr auto OPERATION_SHIFT = 56;
+constexpr std::uint64_t PAYLOAD_MASK =
+    (std::uint64_t{1} << OPERATION_SHIFT) - 1;
+constexpr std::uint64_t GENERATION_SHIFT = 32;
+constexpr std::uint64_t GENERATION_MASK = 0xffffff;
+constexpr std::uint16_t BUFFER_GROUP = 0;
+
+// Identifies a connection in the completions
+static std::uint64_t tag(const ConnectionId connection,
+                         const std::uint32_t generation) {
+  return ((generation & GENERATION_MASK) << GENERATION_SHIFT) |
+         static_cast<std::uint32_t>(connection);
+}
+
+template <typename Operation>
+static std::uint64_t encode(const Operation operation,
+                            const std::uint64_t payload) {
+  return (static_cast<std::uint64_t>(operation) << OPERATION_SHIFT) |
+         (payload & PAYLOAD_MASK);
+}
+
+static int io_uring_setup(unsigned entries, io_uring_params *params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int ring_fd, unsigned to_submit,
+                          unsigned min_complete, unsigned flags,
+                          io_uring_getevents_arg *arg = nullptr) {
+  if (arg != nullptr) {
+    flags |= IORING_ENTER_EXT_ARG;
+  }
+  return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit,
+                                  min_complete, flags, arg,
+                                  arg != nullptr ? sizeof(*arg) : 0));
+}
+
+static int io_uring_register(int ring_fd, unsigned opcode, void *arg,
+                             unsigned nr_args) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args));
+}
+
+// The multishot flags can't be probed, they are told by the kernel release
+static bool has_release(const int major, const int minor) {
+  utsname name{};
+  int release_major = 0;
+  int release_minor = 0;
+  if (uname(&name) != 0 ||
+      std::sscanf(name.release, "%d.%d", &release_major, &release_minor) !=
+          2) {
+    return false;
+  }
+  return release_major > major ||
+         (release_major == major && release_minor >= minor);
+}
+
+// Sets a small ring up to check its features and operations
+static bool probe_kernel() {
+  constexpr std::array OPERATIONS{
+      IORING_OP_ACCEPT, IORING_OP_RECV,            IORING_OP_SENDMSG,
+      IORING_OP_READ,   IORING_OP_PROVIDE_BUFFERS, IORING_OP_ASYNC_CANCEL};
+  io_uring_params params{};
+  auto ring_fd = io_uring_setup(1, &params);
+  if (ring_fd < 0) {
+    spdlog::error("Couldn't setup io_uring: {}!", std::strerror(errno));
+    return false;
+  }
+  constexpr unsigned PROBED_OPERATIONS = 256;
+  std::vector<char> buffer(sizeof(io_uring_probe) +
+                           PROBED_OPERATIONS * sizeof(io_uring_probe_op));
+  auto *probe = reinterpret_cast<io_uring_probe *>(buffer.data());
+  auto probed = io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe,
+                                  PROBED_OPERATIONS) == 0;
+  close(ring_fd);
+  auto supported =
+      probed && (params.features & IORING_FEAT_SINGLE_MMAP) &&
+      (params.features & IORING_FEAT_EXT_ARG) &&
+      (params.features & IORING_FEAT_CQE_SKIP) && has_release(6, 0) &&
+      std::all_of(OPERATIONS.begin(), OPERATIONS.end(), [probe](auto op) {
+        return op < probe->ops_len &&
+               (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+      });
+  if (!supported) {
+    spdlog::error("The kernel is too old for the io_uring backend!");
+  }
+  return supported;
+}
+
+bool UringReactor::supported() {
+  static const bool supported = probe_kernel();
+  return supported;
+}
+
+void UringReactor::_setup_ring() {
+  io_uring_params params{};
+  params.flags = IORING_SETUP_CQSIZE;
+  params.cq_entries = RING_ENTRIES * 4;
+  _ring_fd = io_uring_setup(RING_ENTRIES, &params);
+  // the features have been checked by supported()
+  if (_ring_fd < 0) {
+    spdlog::error("Couldn't setup io_uring: {}!", std::strerror(errno));
+    std::exit(1);
+  }
+
+  _sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  _cq_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+  _sq_size = _cq_size = std::max(_sq_size, _cq_size);
+  _sq_ptr = mmap(nullptr, _sq_size, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+  _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+  _sqes = static_cast<io_uring_sqe *>(
+      mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+           MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES));
+  if (_sq_ptr == MAP_FAILED || _sqes == MAP_FAILED) {
+    spdlog::error("Couldn't map the io_uring rings!");
+    std::exit(1);
+  }
+  _cq_ptr = _sq_ptr; // single mmap
+
+  auto *sq = static_cast<char *>(_sq_ptr);
+  _sq_head = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+  _sq_tail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+  _sq_mask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+  _sq_array = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+  auto *cq = static_cast<char *>(_cq_ptr);
+  _cq_head = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+  _cq_tail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+  _cq_mask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+  _cqes = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+
+  // provided buffers, the kernel picks one for every received chunk
+  _buffers = static_cast<char *>(
+      mmap(nullptr, BUFFERS_COUNT * BUFFER_SIZE, PROT_READ | PROT_WRITE,
+           MAP_ANONYMOUS | MAP_PRIVATE, -1, 0));
+  if (_buffers == MAP_FAILED) {
+    spdlog::error("Couldn't allocate io_uring buffers!");
+    std::exit(1);
+  }
+  _provide_buffers(0, BUFFERS_COUNT);
+
+  _wakeup_fd = eventfd(0, EFD_CLOEXEC);
+  if (_wakeup_fd == INVALID_CONNECTION) {
+    spdlog::error("Couldn't create a wakeup descriptor!");
+    std::exit(1);
+  }
+  _arm_wakeup();
+}
+
+io_uring_sqe *UringReactor::_get_sqe() {
+  auto head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+  auto tail = *_sq_tail;
+  if (tail - head >= RING_ENTRIES) {
+    _submit(0); // the kernel consumes the entries while submitting
+  }
+  auto index = tail & *_sq_mask;
+  auto *sqe = &_sqes[index];
+  std::memset(sqe, 0, sizeof(io_uring_sqe));
+  _sq_array[index] = index;
+  __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+  ++_to_submit;
+  return sqe;
+}
+
+void UringReactor::_submit(
+    unsigned min_complete,
+    const std::optional<std::chrono::milliseconds> timeout) {
+  auto flags = min_complete > 0 ? IORING_ENTER_GETEVENTS : 0u;
+  __kernel_timespec timespec{};
+  io_uring_getevents_arg arg{};
+  if (timeout.has_value()) {
+    timespec.tv_sec = timeout->count() / 1000;
+    timespec.tv_nsec = timeout->count() % 1000 * 1000000;
+    arg.ts = reinterpret_cast<std::uint64_t>(&timespec);
+  }
+  for (;;) {
+    auto submitted =
+        io_uring_enter(_ring_fd, _to_submit, min_complete, flags,
+                       timeout.has_value() && min_complete > 0 ? &arg
+                                                               : nullptr);
+    if (submitted >= 0) {
+      _to_submit -= std::min<unsigned>(_to_submit, submitted);
+      return;
+    }
+    if (errno == EINTR || errno == ETIME) {
+      return;
+    }
+    if (errno != EAGAIN && errno != EBUSY) {
+      spdlog::error("Submitting io_uring requests has failed: {}!",
+                    std::strerror(errno));
+      return;
+    }
+    // completion queue is overflown, let the caller reap completions first
+    if (min_complete == 0) {
+      return;
+    }
+    min_complete = 0;
+    flags = 0;
+  }
+}
+
+void UringReactor::_arm_accept(const ConnectionId server_fd) {
+  auto *sqe = _get_sqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = server_fd;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = encode(Operation::Accept, server_fd);
+}
+
+void UringReactor::_arm_recv(const ConnectionId connection) {
+  auto *sqe = _get_sqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = connection;
+  sqe->ioprio = IORING_RECV_MULTISHOT;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = BUFFER_GROUP;
+  auto &state = *_connections.at(connection);
+  sqe->user_data = encode(Operation::Recv, tag(connection, state.generation));
+  state.receiving = true;
+}
+
+void UringReactor::_arm_wakeup() {
+  auto *sqe = _get_sqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = _wakeup_fd;
+  sqe->addr = reinterpret_cast<std::uint64_t>(&_wakeup_value);
+  sqe->len = sizeof(_wakeup_value);
+  sqe->user_data = encode(Operation::Wakeup, 0);
+}
+
+void UringReactor::_arm_send(const ConnectionId connection,
+                             Connection &state) {
+  state.message = {};
+  state.message.msg_iov = state.iovecs.data();
+  state.message.msg_iovlen =
+      state.output.gather(state.iovecs.data(), state.iovecs.size());
+  state.sending = true;
+  auto *sqe = _get_sqe();
+  sqe->opcode = IORING_OP_SENDMSG;
+  sqe->fd = connection;
+  sqe->addr = reinterpret_cast<std::uint64_t>(&state.message);
+  sqe->len = 1;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = encode(Operation::Send, tag(connection, state.generation));
+}
+
+void UringReactor::_provide_buffers(const std::uint16_t first_id,
+                                    const std::uint16_t count) {
+  auto *sqe = _get_sqe();
+  sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+  sqe->fd = count;
+  sqe->addr =
+      reinterpret_cast<std::uint64_t>(_buffers + first_id * BUFFER_SIZE);
+  sqe->len = BUFFER_SIZE;
+  sqe->off = first_id;
+  sqe->buf_group = BUFFER_GROUP;
+  // only failures are reported
+  sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+  sqe->user_data = encode(Operation::ProvideBuffers, first_id);
+}
+
+ConnectionId UringReactor::init_server_socket(const uint16_t port) {
+  return _add_listener(create_server_socket(port, _options));
+}
+
+ConnectionId UringReactor::init_unix_server_socket(const std::string &path) {
+  auto server_fd = create_unix_server_socket(path, _options);
+  _local_listeners.insert(server_fd);
+  return _add_listener(server_fd);
+}
+
+ConnectionId UringReactor::_add_listener(const ConnectionId server_fd) {
+  if (_ring_fd == INVALID_CONNECTION) {
+    _setup_ring();
+  }
+  _accepted[server_fd];
+  _arm_accept(server_fd);
+  return server_fd;
+}
+
+void UringReactor::close_connection(const ConnectionId connection) {
+  spdlog::info("Closing connection {}!", connection);
+  // in-flight requests keep a reference to the socket, shutting it down
+  // terminates the multishot recv
+  shutdown(connection, SHUT_RDWR);
+  close(connection);
+  auto connection_it = _connections.find(connection);
+  if (connection_it == _connections.end()) {
+    return;
+  }
+  auto &state = connection_it->second;
+  if (state->sending) {
+    // the kernel may still read the output queue
+    _closing[tag(connection, state->generation)] = std::move(state);
+  }
+  _connections.erase(connection_it);
+}
+
+std::vector<ConnectionId>
+UringReactor::handle_new_connections(const ConnectionId server_fd) {
+  std::vector<ConnectionId> connections;
+  auto accepted_it = _accepted.find(server_fd);
+  if (accepted_it == _accepted.end()) {
+    return connections;
+  }
+  // the multishot accept has already drained the listener
+  auto &accepted = accepted_it->second;
+  auto tcp = _local_listeners.count(server_fd) == 0;
+  while (!accepted.empty() && connections.size() < MAX_ACCEPTS) {
+    auto client_fd = accepted.front();
+    accepted.pop_front();
+    if (tcp && !configure_connection(client_fd, _options)) {
+      close(client_fd);
+      continue;
+    }
+    spdlog::info("Received new connection {}", client_fd);
+    auto state = std::make_unique<Connection>();
+    state->generation = _next_generation++;
+    _connections[client_fd] = std::move(state);
+    _arm_recv(client_fd);
+    connections.push_back(client_fd);
+  }
+  return connections;
+}
+
+ReceivedData UringReactor::receive_data(const ConnectionId connection) {
+  auto connection_it = _connections.find(connection);
+  if (connection_it == _connections.end()) {
+    return {};
+  }
+  return std::exchange(connection_it->second->received, {});
+}
+
+void UringReactor::_take_outgoing() {
+  std::vector<ConnectionId> touched;
+  for (auto &[connection, reply] : _outbox.take()) {
+    auto connection_it = _connections.find(connection);
+    if (connection_it == _connections.end()) {
+      spdlog::debug("Dropping data for closed connection {}", connection);
+      continue;
+    }
+    connection_it->second->output.push_response(std::move(reply));
+    touched.push_back(connection);
+  }
+  // all replies queued for a connection go out in one send
+  for (auto connection : touched) {
+    auto &state = *_connections.at(connection);
+    if (!state.sending && !state.output.empty()) {
+      _arm_send(connection, state);
+    }
+    _enforce_limit(connection, state);
+  }
+}
+
+void UringReactor::_enforce_limit(const ConnectionId connection,
+                                  Connection &state) {
+  if (state.paused || state.disconnected ||
+      state.output.size() <= _limit.max_pending_bytes) {
+    return;
+  }
+  switch (_limit.policy) {
+  case SlowClientPolicy::PauseReading: {
+    state.paused = true;
+    spdlog::warn("Connection {} has {} bytes waiting, pausing reading ({} "
+                 "paused so far)",
+                 connection, state.output.size(), ++_paused_count);
+    // the multishot recv is stopped, it is armed again on resume
+    auto *sqe = _get_sqe();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = encode(Operation::Recv, tag(connection, state.generation));
+    sqe->user_data = encode(Operation::Cancel, 0);
+    state.cancelling = true;
+    break;
+  }
+  case SlowClientPolicy::Disconnect:
+    // the in-flight send fails and drops the output, the session is ended when
+    // the recv reports the hang up
+    spdlog::warn("Connection {} has {} bytes waiting, disconnecting ({} "
+                 "disconnected so far)",
+                 connection, state.output.size(), ++_disconnected_count);
+    state.disconnected = true;
+    shutdown(connection, SHUT_RDWR);
+    break;
+  }
+}
+
+void UringReactor::_handle_completion(const io_uring_cqe &cqe,
+                                      std::vector<ConnectionId> &ready) {
+  auto operation = static_cast<Operation>(cqe.user_data >> OPERATION_SHIFT);
+  auto payload = cqe.user_data & PAYLOAD_MASK;
+  auto has_more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+  switch (operation) {
+  case Operation::Accept: {
+    auto server_fd = static_cast<ConnectionId>(payload);
+    if (cqe.res >= 0) {
+      _accepted[server_fd].push_back(cqe.res);
+    } else {
+      spdlog::error("Accepting a new connection has failed!");
+    }
+    if (!has_more) {
+      _arm_accept(server_fd);
+    }
+    break;
+  }
+  case Operation::Recv: {
+    auto connection = static_cast<ConnectionId>(payload & 0xffffffff);
+    auto connection_it = _connections.find(connection);
+    if (connection_it == _connections.end() ||
+        tag(connection, connection_it->second->generation) != payload) {
+      // the connection has been already closed
+      if (cqe.res > 0) {
+        _provide_buffers(cqe.flags >> IORING_CQE_BUFFER_SHIFT, 1);
+      }
+      break;
+    }
+    auto &state = *connection_it->second;
+    if (!has_more) {
+      state.receiving = false;
+    }
+    if (cqe.res == -ENOBUFS) {
+      // all buffers are in use, the recv is re-armed once they are given back
+      if (!state.paused) {
+        _starved.push_back(connection);
+      }
+      break;
+    }
+    if (cqe.res == -ECANCELED && state.cancelling) {
+      state.cancelling = false;
+      if (!state.paused) {
+        _arm_recv(connection); // resumed before the cancellation completed
+      }
+      break;
+    }
+    auto &received = state.received;
+    if (cqe.res > 0) {
+      auto buffer_id = static_cast<std::uint16_t>(cqe.flags >>
+                                                  IORING_CQE_BUFFER_SHIFT);
+      received.data.append(_buffers + buffer_id * BUFFER_SIZE, cqe.res);
+      _provide_buffers(buffer_id, 1);
+      if (!has_more && !state.paused) {
+        _arm_recv(connection);
+      }
+    } else {
+      if (cqe.res < 0 && cqe.res != -ECANCELED) {
+        spdlog::error(
+            "Something went wrong while reading data for connection {}",
+            connection);
+      }
+      received.hung_up = true;
+    }
+    if (!state.paused) {
+      ready.push_back(connection);
+    }
+    break;
+  }
+  case Operation::Send: {
+    auto connection = static_cast<ConnectionId>(payload & 0xffffffff);
+    auto connection_it = _connections.find(connection);
+    if (connection_it == _connections.end() ||
+        tag(connection, connection_it->second->generation) != payload) {
+      _closing.erase(payload); // the connection has been already closed
+      break;
+    }
+    auto &state = *connection_it->second;
+    state.sending = false;
+    if (cqe.res < 0) {
+      spdlog::warn("Sending data for connection {} has failed", connection);
+      state.output = {};
+    } else {
+      state.output.consume(cqe.res);
+    }
+    if (!state.output.empty()) {
+      _arm_send(connection, state); // short write or new replies
+    }
+    if (state.paused && state.output.size() <= _limit.max_pending_bytes / 2) {
+      spdlog::info("Connection {} has drained its output, resuming reading",
+                   connection);
+      state.paused = false;
+      if (!state.receiving) {
+        _arm_recv(connection);
+      }
+      ready.push_back(connection); // serves what has been received meanwhile
+    }
+    break;
+  }
+  case Operation::Wakeup:
+    _arm_wakeup();
+    break;
+  case Operation::Cancel:
+    break; // the recv might have already finished, nothing to do
+  case Operation::ProvideBuffers:
+    spdlog::error("Couldn't give back io_uring buffer {}: {}!", payload,
+                  std::strerror(-cqe.res));
+    break;
+  }
+}
+
+std::vector<ConnectionId> UringReactor::wait_for_traffic(
+    const std::optional<std::chrono::milliseconds> timeout) {
+  spdlog::debug("Waiting for incoming connections/data!");
+  std::vector<ConnectionId> ready{};
+
+  _take_outgoing();
+  for (auto connection : _starved) {
+    if (_connections.find(connection) != _connections.end()) {
+      _arm_recv(connection);
+    }
+  }
+  _starved.clear();
+
+  // don't block while there are accepted connections left to hand over
+  auto accepted_left = std::any_of(
+      _accepted.begin(), _accepted.end(),
+      [](const auto &accepted) { return !accepted.second.empty(); });
+  _submit(accepted_left ? 0 : 1, timeout);
+
+  auto head = *_cq_head;
+  auto tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+  for (; head != tail; ++head) {
+    auto cqe = _cqes[head & *_cq_mask];
+    // releasing the entry before handling it, handlers may submit new ones
+    __atomic_store_n(_cq_head, head + 1, __ATOMIC_RELEASE);
+    _handle_completion(cqe, ready);
+  }
+
+  for (auto &[server_fd, accepted] : _accepted) {
+    if (!accepted.empty()) {
+      ready.push_back(server_fd);
+    }
+  }
+  // a connection may have completed several chunks in one batch
+  std::sort(ready.begin(), ready.end());
+  ready.erase(std::unique(ready.begin(), ready.end()), ready.end());
+  return ready;
+}
+
+void UringReactor::send_data(ConnectionId connection, Reply reply) {
+  // the ingress thread is woken up once per batch of replies
+  if (_outbox.push(connection, std::move(reply))) {
+    wake_up();
+  }
+}
+
+void UringReactor::wake_up() {
+  std::uint64_t value = 1;
+  if (write(_wakeup_fd, &value, sizeof(value)) == SOCKET_ERROR) {
+    spdlog::error("Couldn't wake up the io_uring reactor!");
+  }
+}
+
+EgressStats UringReactor::egress_stats() const {
+  return {_paused_count.load(std::memory_order_relaxed),
+          _disconnected_count.load(std::memory_order_relaxed)};
+}
+
+UringReactor::~UringReactor() {
+  if (_ring_fd != INVALID_CONNECTION) {
+    close(_ring_fd);
+    munmap(_sq_ptr, _sq_size);
+    munmap(_sqes, _sqes_size);
+    munmap(_buffers, BUFFERS_COUNT * BUFFER_SIZE);
+  }
+  if (_wakeup_fd != INVALID_CONNECTION) {
+    close(_wakeup_fd);
+  }
+}
+} // namespace auction_house::network
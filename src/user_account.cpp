@@ -61,4 +61,35 @@ std::string Accounts::get_items(const std::string &username) {
                            return a.append(b);
                          });
 }
-} // namespace auction_house::engine
\ No newline at end of file
+
+std::optional<UserAccount>
+Accounts::get_account(const std::string &username) {
+  std::lock_guard _l(_mutex);
+  auto account = _accounts.find(username);
+  if (account == _accounts.end()) {
+    return {};
+  }
+  return account->second;
+}
+
+void Accounts::restore_account(const std::string &username,
+                               std::optional<UserAccount> &&account) {
+  std::lock_guard _l(_mutex);
+  if (account.has_value()) {
+    _accounts[username] = std::move(account.value());
+  } else {
+    _accounts.erase(username);
+  }
+}
+
+std::unordered_map<std::string, UserAccount> Accounts::snapshot() {
+  std::lock_guard _l(_mutex);
+  return _accounts;
+}
+
+void Accounts::restore(
+    std::unordered_map<std::string, UserAccount> &&accounts) {
+  std::lock_guard _l(_mutex);
+  _accounts = std::move(accounts);
+}
+} // namespace auction_house::engine
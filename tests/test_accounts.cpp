@@ -156,4 +156,25 @@ TEST_CASE("Error cases", "[Accounts]") {
         !accounts.deposit_funds(user, std::numeric_limits<FundsType>::max()));
     REQUIRE(accounts.get_funds(user) == 10);
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Restore an account of a user", "[Accounts]") {
+  Accounts accounts;
+  std::string user{"user"};
+  REQUIRE_FALSE(accounts.get_account(user).has_value());
+  accounts.deposit_funds(user, 10);
+  accounts.deposit_item(user, "item");
+  auto account = accounts.get_account(user);
+  REQUIRE(account.has_value());
+
+  accounts.withdraw_funds(user, 5);
+  accounts.withdraw_item(user, "item");
+  accounts.deposit_funds("other", 3);
+  accounts.restore_account(user, std::move(account));
+  REQUIRE(accounts.get_funds(user) == 10);
+  REQUIRE(accounts.get_items(user) == "item");
+  REQUIRE(accounts.get_funds("other") == 3);
+
+  accounts.restore_account(user, {});
+  REQUIRE_FALSE(accounts.get_account(user).has_value());
+}
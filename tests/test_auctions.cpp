@@ -155,6 +155,71 @@ TEST_CASE("Single thread Auction lists manipulations", "[Auctions]") {
   }
 }
 
+TEST_CASE("Add and bid auctions in bulk", "[Auctions]") {
+  AuctionList auctions;
+  auto expiration = Clock::now() + std::chrono::seconds(60);
+  REQUIRE(auctions.add_auction({"owner", {}, 100, "item_0", expiration}));
+
+  std::vector<Auction> added{{"owner", {}, 10, "item_1", expiration},
+                             {"other", {}, 20, "item_2", expiration}};
+  auto ids = auctions.add_auctions(std::move(added));
+  REQUIRE(ids == std::vector<std::optional<AuctionId>>{1, 2});
+
+  auto results =
+      auctions.bid_items({{0, 50}, {1, 15}, {2, 30}, {1, 15}, {3, 5}}, "other");
+  REQUIRE(results == std::vector<BidResult>{
+                         BidResult::TooLowPrice, BidResult::Successful,
+                         BidResult::OwnerBid, BidResult::TooLowPrice,
+                         BidResult::DoesNotExist});
+  REQUIRE_THAT(auctions.get_printable_list(),
+               Catch::Matchers::Contains(std::vector<std::string>{
+                   "ID: 1; ITEM: item_1; OWNER: owner; PRICE: 15; BUYER: "
+                   "other"}));
+}
+
+TEST_CASE("Bid up to a maximum price", "[Auctions]") {
+  AuctionList auctions;
+  auto expiration = Clock::now() + std::chrono::seconds(60);
+  REQUIRE(auctions.add_auction({"owner", {}, 100, "item", expiration}));
+  auto listed_for = [&auctions](const std::string &price_and_buyer) {
+    return auctions.get_printable_list() ==
+           std::vector<std::string>{
+               "ID: 0; ITEM: item; OWNER: owner; PRICE: " + price_and_buyer};
+  };
+
+  REQUIRE(auctions.bid_item_max(0, 100, "first") == BidResult::TooLowPrice);
+  REQUIRE(auctions.bid_item_max(0, 500, "owner") == BidResult::OwnerBid);
+  REQUIRE(auctions.bid_item_max(5, 500, "first") == BidResult::DoesNotExist);
+
+  // the price is the lowest one that wins
+  REQUIRE(auctions.bid_item_max(0, 500, "first") == BidResult::Successful);
+  REQUIRE(listed_for("101; BUYER: first"));
+
+  SECTION("Lower bids are outbid right away") {
+    REQUIRE(auctions.bid_item(0, 200, "second") == BidResult::TooLowPrice);
+    REQUIRE(listed_for("201; BUYER: first"));
+    REQUIRE(auctions.bid_item_max(0, 300, "second") == BidResult::TooLowPrice);
+    REQUIRE(listed_for("301; BUYER: first"));
+    // the earlier maximum wins a tie
+    REQUIRE(auctions.bid_item_max(0, 500, "second") == BidResult::TooLowPrice);
+    REQUIRE(listed_for("500; BUYER: first"));
+  }
+
+  SECTION("A higher maximum wins one step above the other one") {
+    REQUIRE(auctions.bid_item_max(0, 800, "second") == BidResult::Successful);
+    REQUIRE(listed_for("501; BUYER: second"));
+    REQUIRE(auctions.bid_item(0, 1000, "first") == BidResult::Successful);
+    REQUIRE(listed_for("1000; BUYER: first"));
+  }
+
+  SECTION("The winner changes the maximum without raising the price") {
+    REQUIRE(auctions.bid_item_max(0, 150, "first") == BidResult::Successful);
+    REQUIRE(listed_for("101; BUYER: first"));
+    REQUIRE(auctions.bid_item_max(0, 151, "second") == BidResult::Successful);
+    REQUIRE(listed_for("151; BUYER: second"));
+  }
+}
+
 TEST_CASE("Multi-thread auction lists manipulations", "[Auctions]") {
   AuctionList auctions;
 
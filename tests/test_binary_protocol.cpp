@@ -0,0 +1,281 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#include "binary_protocol.h"
+#include "command.h"
+#include "connection_id.h"
+#include "database.h"
+#include "tasks.h"
+#include <catch2/catch.hpp>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace auction_house;
+using namespace auction_house::engine;
+
+static std::vector<std::string> read_frames(FrameBuffer &buffer) {
+  std::vector<std::string> frames;
+  while (auto frame = buffer.next_frame()) {
+    frames.push_back(std::move(frame.value()));
+  }
+  return frames;
+}
+
+// Splits a batch reply into the result codes and bodies of its frames
+static std::vector<std::pair<std::uint8_t, std::string>>
+read_replies(std::string_view data) {
+  std::vector<std::pair<std::uint8_t, std::string>> replies;
+  while (!data.empty()) {
+    FrameReader header{data.substr(0, REPLY_HEADER_SIZE)};
+    auto length = header.read_u32();
+    auto result = header.read_u8();
+    replies.emplace_back(result,
+                         data.substr(REPLY_HEADER_SIZE, length - 1));
+    data.remove_prefix(REPLY_HEADER_SIZE + length - 1);
+  }
+  return replies;
+}
+
+// Returns the frame without its header, as the frame buffer does
+static std::string body(const FrameWriter &writer) {
+  return writer.frame().substr(REQUEST_HEADER_SIZE);
+}
+
+TEST_CASE("Split received data into frames", "[BinaryProtocol]") {
+  auto login = FrameWriter{Opcode::Login}.write_string("username").frame();
+  auto bid = FrameWriter{Opcode::Bid}.write_u64(1).write_u64(300).frame();
+  REQUIRE(login.size() == 2 + 1 + 1 + 8);
+  REQUIRE(bid.size() == 2 + 1 + 8 + 8);
+
+  SECTION("Pipelined frames in one packet") {
+    FrameBuffer buffer;
+    buffer.append(login + bid);
+    REQUIRE(read_frames(buffer) ==
+            std::vector<std::string>{login.substr(2), bid.substr(2)});
+    REQUIRE(buffer.pending() == 0);
+  }
+
+  SECTION("Frame split across packets") {
+    FrameBuffer buffer;
+    for (auto c : login) {
+      REQUIRE(read_frames(buffer).empty());
+      buffer.append(std::string(1, c));
+    }
+    REQUIRE(read_frames(buffer) == std::vector<std::string>{login.substr(2)});
+  }
+
+  SECTION("Skip too long frames") {
+    FrameBuffer buffer{8};
+    auto sell = FrameWriter{Opcode::Sell}
+                    .write_string("item")
+                    .write_u64(10)
+                    .write_u32(60)
+                    .frame();
+    auto logout = FrameWriter{Opcode::Logout}.frame();
+    buffer.append(sell.substr(0, 5));
+    REQUIRE(read_frames(buffer).empty());
+    buffer.append(sell.substr(5) + logout);
+    REQUIRE(read_frames(buffer) == std::vector<std::string>{logout.substr(2)});
+  }
+}
+
+TEST_CASE("Read frame arguments", "[BinaryProtocol]") {
+  auto frame = body(FrameWriter{Opcode::Sell}
+                        .write_string("item")
+                        .write_u64(0x0102030405060708)
+                        .write_u32(300));
+  FrameReader reader{frame};
+  REQUIRE(reader.read_u8() == static_cast<std::uint8_t>(Opcode::Sell));
+  REQUIRE(reader.read_string() == "item");
+  REQUIRE(reader.read_u64() == 0x0102030405060708);
+  REQUIRE_FALSE(reader.done());
+  REQUIRE(reader.read_u32() == 300);
+  REQUIRE(reader.done());
+  REQUIRE_THROWS_AS(reader.read_u8(), std::out_of_range);
+}
+
+TEST_CASE("Execute binary commands", "[BinaryProtocol]") {
+  Accounts accounts;
+  AuctionList auctions;
+  SessionManager sessions;
+  Database database{accounts, auctions, sessions};
+
+  const SessionId session_id = 1;
+  const ConnectionId connection_id = 1;
+  sessions.start_session(session_id, connection_id);
+  IngressEvent event{{}, session_id, "", Protocol::Binary};
+
+  SECTION("Login") {
+    event.data = body(FrameWriter{Opcode::Login}.write_string("user"));
+    auto egress_event = Command::decode(event).execute(event, database);
+    REQUIRE(egress_event.result == ResultCode::Ok);
+    REQUIRE(egress_event.data == "Welcome user!");
+  }
+
+  SECTION("Commands of logged in users") {
+    sessions.login(session_id, "user");
+    event.username = "user";
+
+    SECTION("Deposit and withdraw funds") {
+      auto deposit = event;
+      deposit.data = body(FrameWriter{Opcode::DepositFunds}.write_u64(100));
+      REQUIRE(Command::decode(deposit).execute(deposit, database).result ==
+              ResultCode::Ok);
+      REQUIRE(accounts.get_funds("user") == 100);
+
+      event.data = body(FrameWriter{Opcode::WithdrawFunds}.write_u64(200));
+      auto egress_event = Command::decode(event).execute(event, database);
+      REQUIRE(egress_event.result == ResultCode::InsufficientFunds);
+      REQUIRE(accounts.get_funds("user") == 100);
+    }
+
+    SECTION("Sell and bid") {
+      accounts.deposit_item("user", "item");
+      accounts.deposit_funds("user", 10);
+      auto sell = event;
+      sell.data = body(FrameWriter{Opcode::Sell}
+                           .write_string("item")
+                           .write_u64(50)
+                           .write_u32(60));
+      REQUIRE(Command::decode(sell).execute(sell, database).result ==
+              ResultCode::Ok);
+
+      event.data = body(FrameWriter{Opcode::Bid}.write_u64(0).write_u64(60));
+      auto egress_event = Command::decode(event).execute(event, database);
+      REQUIRE(egress_event.result == ResultCode::OwnerBid);
+      event.data =
+          body(FrameWriter{Opcode::BidMax}.write_u64(0).write_u64(60));
+      egress_event = Command::decode(event).execute(event, database);
+      REQUIRE(egress_event.result == ResultCode::OwnerBid);
+    }
+
+    SECTION("Bulk sell and bid") {
+      event.data = body(FrameWriter{Opcode::DepositMany}
+                            .write_string("item")
+                            .write_string("other"));
+      REQUIRE(Command::decode(event).execute(event, database).result ==
+              ResultCode::Ok);
+      accounts.deposit_funds("user", 10);
+      auto sell = event;
+      sell.data = body(FrameWriter{Opcode::SellMany}
+                           .write_u64(50)
+                           .write_u32(60)
+                           .write_string("item")
+                           .write_string("other"));
+      auto egress_event = Command::decode(sell).execute(sell, database);
+      REQUIRE(egress_event.result == ResultCode::Ok);
+      REQUIRE(egress_event.data == "Auctioned off 2 of 2 items:\n"
+                                   "item: auction 0\n"
+                                   "other: auction 1");
+
+      event.data = body(FrameWriter{Opcode::BidMany}
+                            .write_u64(1)
+                            .write_u64(60)
+                            .write_u64(7)
+                            .write_u64(60));
+      egress_event = Command::decode(event).execute(event, database);
+      REQUIRE(egress_event.result == ResultCode::OwnerBid);
+      REQUIRE(egress_event.data == "Winning 0 of 2 auctions:\n"
+                                   "1: you are the seller\n"
+                                   "7: no such auction");
+    }
+
+    SECTION("The SHOW commands reply with typed fields") {
+      accounts.deposit_funds("user", 70);
+      accounts.deposit_item("user", "item");
+      accounts.deposit_item("user", "other");
+      auto sell = event;
+      sell.data = body(FrameWriter{Opcode::Sell}
+                           .write_string("item")
+                           .write_u64(50)
+                           .write_u32(60));
+      REQUIRE(Command::decode(sell).execute(sell, database).result ==
+              ResultCode::Ok);
+
+      event.data = body(FrameWriter{Opcode::ShowFunds});
+      auto funds = Command::decode(event).execute(event, database);
+      FrameReader funds_reader{funds.data.view()};
+      REQUIRE(funds_reader.read_u64() == accounts.get_funds("user"));
+      REQUIRE(funds_reader.done());
+
+      event.data = body(FrameWriter{Opcode::ShowItems});
+      auto items = Command::decode(event).execute(event, database);
+      FrameReader items_reader{items.data.view()};
+      REQUIRE(items_reader.read_u32() == 1);
+      REQUIRE(items_reader.read_long_string() == "other");
+      REQUIRE(items_reader.done());
+
+      event.data = body(FrameWriter{Opcode::ShowSales});
+      auto sales = Command::decode(event).execute(event, database);
+      FrameReader sales_reader{sales.data.view()};
+      REQUIRE(sales_reader.read_u32() == 1);
+      REQUIRE(sales_reader.read_u64() == 0);
+      REQUIRE(sales_reader.read_long_string() == "item");
+      REQUIRE(sales_reader.read_long_string() == "user");
+      REQUIRE(sales_reader.read_u64() == 50);
+      REQUIRE(sales_reader.read_long_string().empty());
+      auto left = sales_reader.read_u32();
+      REQUIRE(left > 0);
+      REQUIRE(left <= 60);
+      REQUIRE(sales_reader.done());
+    }
+
+    SECTION("Item names are validated like in the text protocol") {
+      event.data =
+          body(FrameWriter{Opcode::DepositItem}.write_string("two words"));
+      auto egress_event = Command::decode(event).execute(event, database);
+      REQUIRE(egress_event.result == ResultCode::WrongCommand);
+    }
+  }
+
+  SECTION("Not logged in") {
+    event.data = body(FrameWriter{Opcode::ShowFunds});
+    auto egress_event = Command::decode(event).execute(event, database);
+    REQUIRE(egress_event.result == ResultCode::NotLoggedIn);
+  }
+
+  SECTION("Malformed frames") {
+    // empty, unknown opcode, missing and excessive arguments
+    event.data = GENERATE(std::string{}, std::string{"\x7f"},
+                          body(FrameWriter{Opcode::Bid}.write_u64(1)),
+                          body(FrameWriter{Opcode::BidMany}),
+                          body(FrameWriter{Opcode::BidMany}.write_u32(1)),
+                          body(FrameWriter{Opcode::Logout}.write_u32(1)));
+    auto egress_event = Command::decode(event).execute(event, database);
+    REQUIRE(egress_event.result == ResultCode::WrongCommand);
+  }
+}
+
+TEST_CASE("Reply to a binary batch with a frame per command",
+          "[BinaryProtocol]") {
+  Accounts accounts;
+  AuctionList auctions;
+  SessionManager sessions;
+  Database database{accounts, auctions, sessions};
+  const SessionId session_id = 1;
+  sessions.start_session(session_id, 1);
+  sessions.login(session_id, "user");
+
+  std::vector<Request> requests;
+  for (auto &writer : {FrameWriter{Opcode::DepositFunds}.write_u64(100),
+                       FrameWriter{Opcode::WithdrawFunds}.write_u64(200),
+                       FrameWriter{Opcode::ShowFunds}}) {
+    requests.emplace_back(
+        IngressEvent{"user", session_id, body(writer), Protocol::Binary});
+  }
+  auto egress_event =
+      create_batch_task(std::move(requests), session_id, true, database)
+          .get();
+  REQUIRE(egress_event.result == ResultCode::InsufficientFunds);
+
+  // the replies of the executed commands and the note of the rollback
+  auto replies = read_replies(egress_event.data.view());
+  REQUIRE(replies.size() == 3);
+  REQUIRE(replies[0].first == static_cast<std::uint8_t>(ResultCode::Ok));
+  REQUIRE(replies[0].second == "Successful deposition of funds: 100!");
+  REQUIRE(replies[1].first ==
+          static_cast<std::uint8_t>(ResultCode::InsufficientFunds));
+  REQUIRE(replies[2].second == "The batch has been rolled back!");
+  REQUIRE(accounts.get_funds("user") == 0);
+}
@@ -0,0 +1,93 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#include "char_scan.h"
+#include <catch2/catch.hpp>
+#include <cctype>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace auction_house::engine;
+
+// The classes as the "C" locale has them
+static bool in_class(const unsigned char c, const CharClass char_class) {
+  switch (char_class) {
+  case CharClass::Space:
+    return std::isspace(c);
+  case CharClass::Word:
+    return std::isalnum(c) || c == '_';
+  default:
+    return std::isdigit(c);
+  }
+}
+
+static std::size_t find_reference(std::string_view text,
+                                  const CharClass char_class,
+                                  const bool in) {
+  for (std::size_t i = 0; i < text.size(); ++i) {
+    if (in_class(text[i], char_class) == in) {
+      return i;
+    }
+  }
+  return text.size();
+}
+
+TEST_CASE("Scan classes of characters", "[CharScan]") {
+  auto kernel = GENERATE(ScanKernel::Scalar, ScanKernel::Sse42,
+                         ScanKernel::Avx2);
+  if (!supports_kernel(kernel)) {
+    REQUIRE_FALSE(set_scan_kernel(kernel));
+    return;
+  }
+  auto previous = scan_kernel();
+  REQUIRE(set_scan_kernel(kernel));
+  INFO("kernel: " << static_cast<int>(kernel));
+
+  SECTION("Words and numbers of commands") {
+    REQUIRE(skip_spaces("  \t LOGIN user") == 4);
+    REQUIRE(find_space("LOGIN user") == 5);
+    REQUIRE(find_space("LOGIN") == 5);
+    REQUIRE(skip_spaces("") == 0);
+    REQUIRE(all_word_chars("user_01"));
+    REQUIRE_FALSE(all_word_chars("user-01"));
+    REQUIRE_FALSE(all_word_chars("us\xC4\x85r"));
+    REQUIRE(all_digits("0123456789"));
+    REQUIRE_FALSE(all_digits("12a"));
+    std::string bulk(100, '7');
+    REQUIRE(all_digits(bulk));
+    bulk[70] = '/';
+    REQUIRE_FALSE(all_digits(bulk));
+    REQUIRE(find_class(bulk, CharClass::Digit, false) == 70);
+  }
+
+  SECTION("Every byte at every position agrees with the C locale") {
+    // the texts end at a page boundary, a read past them would fault
+    constexpr std::size_t PAGE = 4096;
+    std::vector<char> buffer(3 * PAGE);
+    auto middle = reinterpret_cast<std::uintptr_t>(buffer.data() + 2 * PAGE);
+    auto end = reinterpret_cast<char *>(middle & ~(PAGE - 1));
+    std::mt19937 random{42};
+    const std::string alphabet{" \t\n\v\f\r_09azAZ/:@[`{\x80\xff\x01"};
+    for (std::size_t size = 0; size <= 70; ++size) {
+      for (int round = 0; round < 20; ++round) {
+        auto text = end - size;
+        for (std::size_t i = 0; i < size; ++i) {
+          text[i] = round % 2 == 0
+                        ? alphabet[random() % alphabet.size()]
+                        : static_cast<char>(random() % 256);
+        }
+        std::string_view view{text, size};
+        for (auto char_class :
+             {CharClass::Space, CharClass::Word, CharClass::Digit}) {
+          for (auto in : {true, false}) {
+            REQUIRE(find_class(view, char_class, in) ==
+                    find_reference(view, char_class, in));
+          }
+        }
+      }
+    }
+  }
+
+  set_scan_kernel(previous);
+}
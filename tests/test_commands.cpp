@@ -4,11 +4,17 @@
 #include "command.h"
 #include "connection_id.h"
 #include "database.h"
+#include "tasks.h"
+#include <algorithm>
 #include <catch2/catch.hpp>
+#include <regex>
 #include <spdlog/spdlog.h>
+#include <string>
+#include <vector>
 
 using namespace auction_house::engine;
 using auction_house::ConnectionId;
+using auction_house::ResultCode;
 using Catch::Matchers::Contains;
 using Catch::Matchers::UnorderedEquals;
 
@@ -26,7 +32,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
   SECTION("Login and logout") {
     SECTION("Successfully login a user") {
       event.data = "LOGIN username";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "Welcome username!");
       REQUIRE(sessions.get_username(session_id).value() == "username");
@@ -37,7 +43,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
       sessions.start_session(2, 2);
       sessions.login(2, "username");
       event.data = "LOGIN username";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "Couldn't login as username!");
       REQUIRE(!sessions.get_username(session_id).has_value());
@@ -48,7 +54,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
       sessions.login(session_id, "username");
       event.username = "username";
       event.data = "LOGOUT";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "Good bay, username!");
       REQUIRE(!sessions.get_username(session_id).has_value());
@@ -57,7 +63,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
 
     SECTION("Fail at logging out a user") {
       event.data = "LOGOUT";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "You are not logged in!");
       REQUIRE(!sessions.get_username(session_id).has_value());
@@ -66,14 +72,14 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
 
   SECTION("Fail at parsing an unknown command") {
     event.data = "LOGOUT 1 ? whatIs it!!";
-    auto egress_event = Command::parse(std::move(event))->execute(database);
+    auto egress_event = Command::parse(event).execute(event, database);
     REQUIRE(egress_event.session_id == session_id);
     REQUIRE(egress_event.data == "WRONG COMMAND: LOGOUT 1 ? whatIs it!!");
   }
 
   SECTION("Show help") {
     event.data = "HELP";
-    auto egress_event = Command::parse(std::move(event))->execute(database);
+    auto egress_event = Command::parse(event).execute(event, database);
     REQUIRE(egress_event.session_id == session_id);
     REQUIRE(egress_event.data ==
             "Welcome, available commands:\n"
@@ -82,13 +88,21 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
             "\tLOGOUT\n"
             "\tDEPOSIT FUNDS <amount>\n"
             "\tDEPOSIT ITEM <item>\n"
-            "\tWITHDRAWS FUNDS <amount>\n"
-            "\tWITHDRAWS FUNDS <item>\n"
+            "\tWITHDRAW FUNDS <amount>\n"
+            "\tWITHDRAW ITEM <item>\n"
             "\tSELL <item> <starting-price> [<expiration-time>]\n"
             "\tBID <auction-id> <new-price>\n"
             "\tSHOW FUNDS\n"
             "\tSHOW ITEMS\n"
-            "\tSHOW SALES");
+            "\tSHOW SALES\n"
+            "\tMULTI\n"
+            "\tMULTI ATOMIC\n"
+            "\tEXEC\n"
+            "\tDISCARD\n"
+            "\tSELL MANY <starting-price> <expiration-time> <item>...\n"
+            "\tBID MANY <auction-id>:<new-price>...\n"
+            "\tDEPOSIT MANY <item>...\n"
+          "\tBID <auction-id> MAX <max-price>");
   }
 
   SECTION("Funds deposits") {
@@ -96,7 +110,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
       sessions.login(session_id, "username");
       event.username = "username";
       event.data = "DEPOSIT FUNDS 100";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "Successful deposition of funds: 100!");
       REQUIRE(accounts.get_funds("username") == 100);
@@ -104,7 +118,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
 
     SECTION("Try to deposit funds, without being logged in") {
       event.data = "DEPOSIT FUNDS 100";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "You are not logged in!");
       REQUIRE(accounts.get_funds("username") == 0);
@@ -114,7 +128,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
       sessions.login(session_id, "username");
       event.username = "username";
       event.data = "DEPOSIT FUNDS invalid100";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "WRONG COMMAND: DEPOSIT FUNDS invalid100");
       REQUIRE(accounts.get_funds("username") == 0);
@@ -127,7 +141,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
           "DEPOSIT FUNDS "
           "1000000000000000000000000000000000000000000000000000000000000"
           "000000000000000000000";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data ==
               "Deposition of funds has failed! Invalid amount!");
@@ -140,7 +154,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
       sessions.login(session_id, "username");
       event.username = "username";
       event.data = "DEPOSIT ITEM my_pretty_item";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data ==
               "Successful deposition of item: my_pretty_item!");
@@ -149,7 +163,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
 
     SECTION("Try to deposit an item, without being logged in") {
       event.data = "DEPOSIT ITEM my_pretty_item";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "You are not logged in!");
       REQUIRE(accounts.get_items("username").empty());
@@ -162,7 +176,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
       accounts.deposit_funds("username", 1000);
       event.username = "username";
       event.data = "WITHDRAW FUNDS 100";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "Successfully withdrawn: 100!");
       REQUIRE(accounts.get_funds("username") == 900);
@@ -170,7 +184,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
 
     SECTION("Try to withdraw funds, without being logged in") {
       event.data = "WITHDRAW FUNDS 100";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "You are not logged in!");
       REQUIRE(accounts.get_funds("username") == 0);
@@ -181,7 +195,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
       accounts.deposit_funds("username", 1000);
       event.username = "username";
       event.data = "WITHDRAW FUNDS invalid100";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "WRONG COMMAND: WITHDRAW FUNDS invalid100");
       REQUIRE(accounts.get_funds("username") == 1000);
@@ -195,7 +209,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
           "WITHDRAW FUNDS "
           "1000000000000000000000000000000000000000000000000000000000000"
           "000000000000000000000";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data ==
               "Withdrawal of funds has failed! Invalid amount!");
@@ -208,7 +222,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
       event.username = "username";
       event.data = "WITHDRAW FUNDS "
                    "2000";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data ==
               "Withdrawal of funds has failed! Insufficient funds!");
@@ -223,7 +237,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
       accounts.deposit_item("username", "my_ugly_item");
       event.username = "username";
       event.data = "WITHDRAW ITEM my_ugly_item";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data ==
               "Successfully withdrawn item: my_ugly_item!");
@@ -232,7 +246,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
 
     SECTION("Try to withdraw an item, without being logged in") {
       event.data = "WITHDRAW ITEM my_pretty_item";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "You are not logged in!");
       REQUIRE(accounts.get_items("username").empty());
@@ -242,7 +256,7 @@ TEST_CASE("Test execution of user account related commands", "[Commands]") {
       sessions.login(session_id, "username");
       accounts.deposit_item("username", "my_pretty_item");
       event.data = "DEPOSIT ITEM my_ugly_item";
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == session_id);
       REQUIRE(egress_event.data == "You are not logged in!");
       REQUIRE(accounts.get_items("username") == "my_pretty_item");
@@ -279,7 +293,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
 
   SECTION("Successfully put an item into sale - default expiration time") {
     event_0.data = "SELL item_0 100 1";
-    auto egress_event = Command::parse(std::move(event_0))->execute(database);
+    auto egress_event = Command::parse(event_0).execute(event_0, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(egress_event.data == "Your item item_0 is being auctioned off!");
     REQUIRE(accounts.get_items(username_0) == "item_1\nitem_0");
@@ -291,9 +305,19 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
             {{"ID: 0; ITEM: item_0; OWNER: username_0; PRICE: 100; BUYER: "}}));
   }
 
+  SECTION("Put an item into sale without an expiration time") {
+    event_0.data = "SELL item_0 100";
+    auto egress_event = Command::parse(event_0).execute(event_0, database);
+    REQUIRE(egress_event.session_id == user_0_sess_id);
+    REQUIRE(egress_event.data == "Your item item_0 is being auctioned off!");
+    REQUIRE(accounts.get_funds(username_0) == 999);
+    REQUIRE(auctions.snapshot().auctions.at(0).expiration_time >
+            Clock::now() + std::chrono::seconds{299});
+  }
+
   SECTION("Successfully put an item into sale") {
     event_0.data = "SELL item_0 100 1";
-    auto egress_event = Command::parse(std::move(event_0))->execute(database);
+    auto egress_event = Command::parse(event_0).execute(event_0, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(egress_event.data == "Your item item_0 is being auctioned off!");
     REQUIRE(accounts.get_funds(username_0) == 999); // charge for selling an
@@ -305,7 +329,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
 
     SECTION("Then successfully bid it by other user") {
       event_1.data = "BID 0 200";
-      auto egress_event = Command::parse(std::move(event_1))->execute(database);
+      auto egress_event = Command::parse(event_1).execute(event_1, database);
       REQUIRE(egress_event.session_id == user_1_sess_id);
       REQUIRE(egress_event.data == "You are winning the auction 0!");
       REQUIRE(accounts.get_funds(username_1) == 1000);
@@ -323,8 +347,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
         accounts.deposit_funds(username_2, 1000);
 
         IngressEvent event_2 = {username_2, user_2_sess_id, "BID 0 400"};
-        auto egress_event =
-            Command::parse(std::move(event_2))->execute(database);
+        auto egress_event = Command::parse(event_2).execute(event_2, database);
         REQUIRE(egress_event.session_id == user_2_sess_id);
         REQUIRE(egress_event.data == "You are winning the auction 0!");
         REQUIRE(accounts.get_funds(username_1) == 1000);
@@ -340,7 +363,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
 
     SECTION("Then fail the bid due too low offer") {
       event_1.data = "BID 0 100";
-      auto egress_event = Command::parse(std::move(event_1))->execute(database);
+      auto egress_event = Command::parse(event_1).execute(event_1, database);
       REQUIRE(egress_event.session_id == user_1_sess_id);
       REQUIRE(egress_event.data == "Your offer for the auction 0 was too low!");
       REQUIRE(accounts.get_funds(username_1) == 1000);
@@ -352,7 +375,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
 
     SECTION("Then fail the bid due to lack of an auction") {
       event_1.data = "BID 1 200";
-      auto egress_event = Command::parse(std::move(event_1))->execute(database);
+      auto egress_event = Command::parse(event_1).execute(event_1, database);
       REQUIRE(egress_event.session_id == user_1_sess_id);
       REQUIRE(egress_event.data == "There is no such auction!");
       REQUIRE(accounts.get_funds(username_1) == 1000);
@@ -368,7 +391,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
                      "100000000000000000000000000000000000000000000000000000000"
                      "000000000000000000000000000000000000000000000000000000000"
                      "0000000000000000000000000 200";
-      auto egress_event = Command::parse(std::move(event_1))->execute(database);
+      auto egress_event = Command::parse(event_1).execute(event_1, database);
       REQUIRE(egress_event.session_id == user_1_sess_id);
       REQUIRE(egress_event.data == "The bid arguments are invalid!");
       REQUIRE(accounts.get_funds(username_1) == 1000);
@@ -385,7 +408,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
           "10000000000000000000000000000000000000000000000000000000000000000000"
           "00000000000000000000000000000000000000000000000000000000000000000000"
           "0000000000000000000000000";
-      auto egress_event = Command::parse(std::move(event_1))->execute(database);
+      auto egress_event = Command::parse(event_1).execute(event_1, database);
       REQUIRE(egress_event.session_id == user_1_sess_id);
       REQUIRE(egress_event.data == "The bid arguments are invalid!");
       REQUIRE(accounts.get_funds(username_1) == 1000);
@@ -398,7 +421,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
     SECTION("Try to bid an item when not being logged in") {
       event_1.username = {};
       event_1.data = "BID 0 10000";
-      auto egress_event = Command::parse(std::move(event_1))->execute(database);
+      auto egress_event = Command::parse(event_1).execute(event_1, database);
       REQUIRE(egress_event.session_id == user_1_sess_id);
       REQUIRE(egress_event.data == "You are not logged in!");
       REQUIRE(accounts.get_funds(username_1) == 1000);
@@ -410,7 +433,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
 
     SECTION("Try to bid as a seller of the item") {
       IngressEvent event{username_0, user_0_sess_id, "BID 0 200"};
-      auto egress_event = Command::parse(std::move(event))->execute(database);
+      auto egress_event = Command::parse(event).execute(event, database);
       REQUIRE(egress_event.session_id == user_0_sess_id);
       REQUIRE(egress_event.data ==
               "You can't bid on the auction 0, you are the seller!");
@@ -426,7 +449,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
           "fee") {
     REQUIRE(accounts.withdraw_funds(username_0, 1000)); // set balance to 0
     event_0.data = "SELL item_0 100 1";
-    auto egress_event = Command::parse(std::move(event_0))->execute(database);
+    auto egress_event = Command::parse(event_0).execute(event_0, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(egress_event.data ==
             "You can't sell your item, you don't have funds to cover the fee!");
@@ -437,7 +460,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
 
   SECTION("Fail at putting an item into sale - no such item!") {
     event_0.data = "SELL item_3 100 1";
-    auto egress_event = Command::parse(std::move(event_0))->execute(database);
+    auto egress_event = Command::parse(event_0).execute(event_0, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(egress_event.data ==
             "You can't sell your item, there is no item_3!");
@@ -452,7 +475,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
         "1000000000000000000000000000000000000000000000000000000000000000000000"
         "0000000000000000000000000000000000000000000000000000000000000000000000"
         "000000000000000000000000000000000000000000000000 1";
-    auto egress_event = Command::parse(std::move(event_0))->execute(database);
+    auto egress_event = Command::parse(event_0).execute(event_0, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(egress_event.data == "You can't sell your item, invalid argument!");
     REQUIRE(accounts.get_funds(username_0) == 1000);
@@ -466,7 +489,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
         "1000000000000000000000000000000000000000000000000000000000000000000000"
         "0000000000000000000000000000000000000000000000000000000000000000000000"
         "000000000000000000000000000000000000000000000000";
-    auto egress_event = Command::parse(std::move(event_0))->execute(database);
+    auto egress_event = Command::parse(event_0).execute(event_0, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(egress_event.data == "You can't sell your item, invalid argument!");
     REQUIRE(accounts.get_funds(username_0) == 1000);
@@ -477,7 +500,7 @@ TEST_CASE("Test execution of auction commands", "[Commands]") {
   SECTION("Fail at putting an item into sale - when a user is not logged in!") {
     event_0.username = {};
     event_0.data = "SELL item_1 100";
-    auto egress_event = Command::parse(std::move(event_0))->execute(database);
+    auto egress_event = Command::parse(event_0).execute(event_0, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(egress_event.data == "You are not logged in!");
     REQUIRE(auctions.get_printable_list().empty());
@@ -518,7 +541,7 @@ TEST_CASE("Test execution of show commands", "[Commands]") {
 
   SECTION("Show user's items") {
     IngressEvent event = {username_0, user_0_sess_id, "SHOW ITEMS"};
-    auto egress_event = Command::parse(std::move(event))->execute(database);
+    auto egress_event = Command::parse(event).execute(event, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(accounts.get_items(username_0) == "item_0\nitem_1\nitem_0");
     REQUIRE(egress_event.data == "Your items:\nitem_0\nitem_1\nitem_0");
@@ -526,14 +549,14 @@ TEST_CASE("Test execution of show commands", "[Commands]") {
 
   SECTION("Fail at showing user's items when no logged in") {
     IngressEvent event = {{}, user_0_sess_id, "SHOW ITEMS"};
-    auto egress_event = Command::parse(std::move(event))->execute(database);
+    auto egress_event = Command::parse(event).execute(event, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(egress_event.data == "You are not logged in!");
   }
 
   SECTION("Show user's funds") {
     IngressEvent event = {username_0, user_0_sess_id, "SHOW FUNDS"};
-    auto egress_event = Command::parse(std::move(event))->execute(database);
+    auto egress_event = Command::parse(event).execute(event, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(accounts.get_funds(username_0) == 1000);
     REQUIRE(egress_event.data == "Your funds: 1000");
@@ -541,14 +564,14 @@ TEST_CASE("Test execution of show commands", "[Commands]") {
 
   SECTION("Fail at showing user's funds when no logged in") {
     IngressEvent event = {{}, user_0_sess_id, "SHOW FUNDS"};
-    auto egress_event = Command::parse(std::move(event))->execute(database);
+    auto egress_event = Command::parse(event).execute(event, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(egress_event.data == "You are not logged in!");
   }
 
   SECTION("Show sales") {
     IngressEvent event = {username_0, user_0_sess_id, "SHOW SALES"};
-    auto egress_event = Command::parse(std::move(event))->execute(database);
+    auto egress_event = Command::parse(event).execute(event, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE_THAT(
         egress_event.data,
@@ -573,8 +596,296 @@ TEST_CASE("Test execution of show commands", "[Commands]") {
 
   SECTION("Fail at showing sales when no logged in") {
     IngressEvent event = {{}, user_0_sess_id, "SHOW SALES"};
-    auto egress_event = Command::parse(std::move(event))->execute(database);
+    auto egress_event = Command::parse(event).execute(event, database);
     REQUIRE(egress_event.session_id == user_0_sess_id);
     REQUIRE(egress_event.data == "You are not logged in!");
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Parse the grammar of the text protocol", "[Commands]") {
+  Accounts accounts;
+  AuctionList auctions;
+  SessionManager sessions;
+  Database database{accounts, auctions, sessions};
+  const SessionId session_id = 1;
+  sessions.start_session(session_id, 1);
+
+  // the grammar the commands used to be matched with
+  const std::vector<std::regex> grammar{
+      std::regex{R"(\s*(HELP)\s*)", std::regex::icase},
+      std::regex{R"(\s*(LOGIN)\s+(\w+)\s*)", std::regex::icase},
+      std::regex{R"(\s*(LOGOUT)\s*)", std::regex::icase},
+      std::regex{R"(\s*(DEPOSIT)\s+(FUNDS)\s+(\d+)\s*)", std::regex::icase},
+      std::regex{R"(\s*(DEPOSIT)\s+(ITEM)\s+(\w+)\s*)", std::regex::icase},
+      std::regex{R"(\s*(WITHDRAW)\s+(FUNDS)\s+(\d+)\s*)", std::regex::icase},
+      std::regex{R"(\s*(WITHDRAW)\s+(ITEM)\s+(\w+)\s*)", std::regex::icase},
+      std::regex{R"(\s*(SELL)\s+(\w+)\s+(\d+)\s*(\d+)?\s*)",
+                 std::regex::icase},
+      std::regex{R"(\s*(BID)\s+(\d+)\s+(\d+)\s*)", std::regex::icase},
+      std::regex{R"(\s*(SHOW)\s+(FUNDS)\s*)", std::regex::icase},
+      std::regex{R"(\s*(SHOW)\s+(ITEMS)\s*)", std::regex::icase},
+      std::regex{R"(\s*(SHOW)\s+(SALES)\s*)", std::regex::icase}};
+  const std::vector<std::string> lines{
+      "HELP", " help ", "\tHeLp\t", "HELP me", "HELPS", "",
+      " ", "LOGIN user_1", "login\t user", "LOGIN", "LOGIN user name",
+      "LOGIN user!", "LOGOUT", "LOGOUT now", "DEPOSIT FUNDS 10",
+      "deposit funds 0010", "DEPOSIT FUNDS -1", "DEPOSIT FUNDS 1.5",
+      "DEPOSIT ITEM item", "DEPOSIT ITEM", "DEPOSIT item x", "DEPOSIT",
+      "DEPOSITFUNDS 1", "WITHDRAW FUNDS 1", "WITHDRAWS FUNDS 1",
+      "WITHDRAW ITEM item_2", "WITHDRAW ITEM item 2", "SELL item 100",
+      "SELL item 100 20", " sell  item  100  20 ", "SELL item", "SELL 1 1",
+      "SELL item 100 20 1", "SELL item 10x", "SELL item 100 x", "SELL MANY 10",
+      "SELL MANY 10 20", "BID 1 20",
+      "BID 1", "BID x 20", "BID 1 20 3", "SHOW FUNDS", "show items",
+      "SHOW SALES", "SHOW", "SHOW FUNDS ITEMS", "SHOW ALL", "SHOWFUNDS",
+      "\vSHOW\fSALES\r", "LOGIN \xC4\x85", "BID 1\x002"};
+
+  for (auto &line : lines) {
+    auto in_grammar = std::any_of(
+        grammar.begin(), grammar.end(),
+        [&line](const std::regex &command) {
+          return std::regex_match(line, command);
+        });
+    IngressEvent event{{}, session_id, line};
+    auto egress_event = Command::parse(event).execute(event, database);
+    INFO("line: " << line);
+    REQUIRE((egress_event.result != ResultCode::WrongCommand) == in_grammar);
+  }
+}
+
+TEST_CASE("Parse typed arguments of the commands", "[Commands]") {
+  Accounts accounts;
+  AuctionList auctions;
+  SessionManager sessions;
+  Database database{accounts, auctions, sessions};
+  const SessionId session_id = 1;
+  const std::string username = "username";
+  sessions.start_session(session_id, 1);
+  sessions.login(session_id, username);
+
+  SECTION("Numbers and names are parsed into the command") {
+    IngressEvent event{username, session_id, "sell item 0100 60"};
+    auto command = Command::parse(event);
+    auto &sell = std::get<commands::Sell>(command.get());
+    REQUIRE(sell.item == "item");
+    REQUIRE(sell.price == std::optional<FundsType>{100});
+    REQUIRE(sell.expiration_time == std::optional<int>{60});
+  }
+
+  SECTION("Numbers which don't fit are invalid arguments") {
+    IngressEvent event{username, session_id,
+                       "DEPOSIT FUNDS 18446744073709551616"};
+    auto command = Command::parse(event);
+    REQUIRE_FALSE(std::get<commands::DepositFunds>(command.get()).amount);
+    auto egress_event = command.execute(event, database);
+    REQUIRE(egress_event.result == ResultCode::InvalidArgument);
+    REQUIRE(accounts.get_funds(username) == 0);
+
+    IngressEvent sell{username, session_id, "SELL item 100 2147483648"};
+    REQUIRE(Command::parse(sell).execute(sell, database).result ==
+            ResultCode::InvalidArgument);
+  }
+
+  SECTION("Arguments of the commands of users which aren't logged in aren't "
+          "checked") {
+    IngressEvent event{{}, session_id, "BID 18446744073709551616 1"};
+    auto egress_event = Command::parse(event).execute(event, database);
+    REQUIRE(egress_event.result == ResultCode::NotLoggedIn);
+  }
+}
+
+TEST_CASE("Parse commands before they are queued", "[Commands]") {
+  Accounts accounts;
+  AuctionList auctions;
+  SessionManager sessions;
+  Database database{accounts, auctions, sessions};
+  const SessionId session_id = 1;
+  sessions.start_session(session_id, 1);
+
+  SECTION("A wrong command is answered right away") {
+    auto task = create_command_task({{}, session_id, "LOGIN"}, database);
+    REQUIRE(task.is_ready());
+    REQUIRE(task.get().result == ResultCode::WrongCommand);
+  }
+
+  SECTION("A valid command is executed by the task") {
+    // short lines are stored inside the string, the event is moved
+    auto task = create_command_task({{}, session_id, "LOGIN bob"}, database);
+    REQUIRE_FALSE(task.is_ready());
+    REQUIRE_FALSE(sessions.get_username(session_id).has_value());
+    REQUIRE(task.get().data == "Welcome bob!");
+    REQUIRE(sessions.get_username(session_id) == "bob");
+  }
+
+  SECTION("A moved request views its own data") {
+    // a short line moves to the other string
+    Request request{{{}, session_id, "SELL vase 5"}};
+    Request moved{std::move(request)};
+    request.event.data.assign("SELL lamp 5");
+    auto &sell = std::get<commands::Sell>(moved.command.get());
+    REQUIRE(sell.item == "vase");
+    REQUIRE(sell.item.data() == moved.event.data.data() + 5);
+  }
+}
+
+TEST_CASE("Execute batches of commands", "[Commands]") {
+  Accounts accounts;
+  AuctionList auctions;
+  SessionManager sessions;
+  Database database{accounts, auctions, sessions};
+  const SessionId session_id = 1;
+  const std::string username = "username";
+  sessions.start_session(session_id, 1);
+
+  auto batch = [session_id](std::vector<std::string> lines) {
+    std::vector<Request> requests;
+    for (auto &line : lines) {
+      requests.emplace_back(IngressEvent{{}, session_id, std::move(line)});
+    }
+    return requests;
+  };
+
+  SECTION("Parse the batch commands") {
+    IngressEvent multi{{}, session_id, "multi  atomic"};
+    REQUIRE(std::get<commands::Multi>(Command::parse(multi).get()).atomic);
+    IngressEvent plain{{}, session_id, "MULTI"};
+    REQUIRE_FALSE(
+        std::get<commands::Multi>(Command::parse(plain).get()).atomic);
+    IngressEvent exec{{}, session_id, "EXEC"};
+    REQUIRE(Command::parse(exec).execute(exec, database).data ==
+            "There is no batch to execute!");
+  }
+
+  SECTION("The commands are executed in order with a single reply") {
+    auto task = create_batch_task(
+        batch({"LOGIN username", "DEPOSIT FUNDS 100", "WITHDRAW FUNDS 200",
+               "SHOW FUNDS"}),
+        session_id, false, database);
+    auto egress_event = task.get();
+    REQUIRE(egress_event.session_id == session_id);
+    REQUIRE(egress_event.data == "Welcome username!\n"
+                                 "Successful deposition of funds: 100!\n"
+                                 "Withdrawal of funds has failed! "
+                                 "Insufficient funds!\n"
+                                 "Your funds: 100");
+    REQUIRE(egress_event.result == ResultCode::InsufficientFunds);
+  }
+
+  SECTION("An atomic batch is rolled back when a command fails") {
+    sessions.login(session_id, username);
+    accounts.deposit_funds(username, 10);
+    auto egress_event =
+        create_batch_task(batch({"DEPOSIT FUNDS 100", "DEPOSIT ITEM item",
+                                 "WITHDRAW ITEM other"}),
+                          session_id, true, database)
+            .get();
+    REQUIRE(egress_event.result == ResultCode::NoSuchItem);
+    REQUIRE_THAT(egress_event.data,
+                 Contains("The batch has been rolled back!"));
+    REQUIRE(accounts.get_funds(username) == 10);
+    REQUIRE(accounts.get_items(username).empty());
+
+    egress_event = create_batch_task(batch({"DEPOSIT FUNDS 100",
+                                            "WITHDRAW FUNDS 50"}),
+                                     session_id, true, database)
+                       .get();
+    REQUIRE(egress_event.result == ResultCode::Ok);
+    REQUIRE(accounts.get_funds(username) == 60);
+  }
+
+  SECTION("An atomic batch holds account commands only") {
+    auto task = create_batch_task(batch({"DEPOSIT FUNDS 100", "BID 0 10"}),
+                                  session_id, true, database);
+    REQUIRE(task.is_ready());
+    REQUIRE(task.get().result == ResultCode::InvalidArgument);
+  }
+}
+
+TEST_CASE("Execute bulk commands", "[Commands]") {
+  Accounts accounts;
+  AuctionList auctions;
+  SessionManager sessions;
+  Database database{accounts, auctions, sessions};
+  const SessionId session_id = 1;
+  const std::string username = "username";
+  sessions.start_session(session_id, 1);
+  sessions.login(session_id, username);
+  IngressEvent event{username, session_id, ""};
+
+  event.data = "DEPOSIT MANY item_0 item_1  item_2 item_0";
+  auto egress_event = Command::parse(event).execute(event, database);
+  REQUIRE(egress_event.data == "Successful deposition of 4 items!");
+  REQUIRE(accounts.get_items(username) == "item_0\nitem_1\nitem_2\nitem_0");
+
+  SECTION("Sell many items, every one gets its result") {
+    accounts.deposit_funds(username, 2);
+    event.data = "sell many 100 60 item_0 item_3 item_1 item_2";
+    egress_event = Command::parse(event).execute(event, database);
+    REQUIRE(egress_event.data == "Auctioned off 2 of 4 items:\n"
+                                 "item_0: auction 0\n"
+                                 "item_3: no such item\n"
+                                 "item_1: auction 1\n"
+                                 "item_2: insufficient funds");
+    REQUIRE(egress_event.result == ResultCode::NoSuchItem);
+    REQUIRE(accounts.get_items(username) == "item_2\nitem_0");
+    REQUIRE(accounts.get_funds(username) == 0);
+    REQUIRE(auctions.get_printable_list().size() == 2);
+  }
+
+  SECTION("An item named MANY is sold with SELL") {
+    accounts.deposit_funds(username, 2);
+    accounts.deposit_item(username, "MANY");
+    accounts.deposit_item(username, "MANY");
+    for (std::string line : {"SELL MANY 10", "SELL MANY 10 20"}) {
+      event.data = line;
+      INFO("line: " << line);
+      egress_event = Command::parse(event).execute(event, database);
+      REQUIRE(egress_event.data == "Your item MANY is being auctioned off!");
+    }
+    REQUIRE(auctions.get_printable_list().size() == 2);
+  }
+
+  SECTION("Bid many auctions") {
+    REQUIRE(auctions.add_auction({"seller", {}, 100, "item", Clock::now()}));
+    REQUIRE(auctions.add_auction({"seller", {}, 100, "item", Clock::now()}));
+    event.data = "BID MANY 0:150 1:50 5:10";
+    egress_event = Command::parse(event).execute(event, database);
+    REQUIRE(egress_event.data == "Winning 1 of 3 auctions:\n"
+                                 "0: winning\n"
+                                 "1: too low price\n"
+                                 "5: no such auction");
+    REQUIRE(egress_event.result == ResultCode::TooLowPrice);
+  }
+
+  SECTION("Bid up to a maximum price") {
+    REQUIRE(auctions.add_auction({"seller", {}, 100, "item", Clock::now()}));
+    event.data = "bid 0 max 500";
+    egress_event = Command::parse(event).execute(event, database);
+    REQUIRE(egress_event.data == "You are winning the auction 0!");
+    IngressEvent other{std::string{"other"}, 2, "BID 0 300"};
+    egress_event = Command::parse(other).execute(other, database);
+    REQUIRE(egress_event.data == "Your offer for the auction 0 was too low!");
+    REQUIRE(auctions.get_printable_list() ==
+            std::vector<std::string>{"ID: 0; ITEM: item; OWNER: seller; "
+                                     "PRICE: 301; BUYER: username"});
+  }
+
+  SECTION("Malformed and invalid arguments") {
+    for (std::string line : {"SELL MANY 100 60 item!", "SELL MANY 100 item",
+                             "BID MANY", "BID MANY 1:", "BID MANY 1:2 3",
+                             "DEPOSIT MANY item-1", "DEPOSIT MANY",
+                             "BID 0 MAX", "BID 0 MAX x", "BID 0 MIN 5",
+                             "BID MAX 5", "BID 0 MAX 5 6"}) {
+      event.data = line;
+      INFO("line: " << line);
+      REQUIRE(Command::parse(event).execute(event, database).result ==
+              ResultCode::WrongCommand);
+    }
+    event.data = "SELL MANY 100 2147483648 item_0";
+    REQUIRE(Command::parse(event).execute(event, database).result ==
+            ResultCode::InvalidArgument);
+    event.data = "BID MANY 0:1 18446744073709551616:1";
+    REQUIRE(Command::parse(event).execute(event, database).result ==
+            ResultCode::InvalidArgument);
+  }
+}
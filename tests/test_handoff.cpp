@@ -0,0 +1,125 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#include "binary_protocol.h"
+#include "handoff.h"
+#include "network.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <catch2/catch.hpp>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace auction_house;
+using namespace auction_house::engine;
+using namespace auction_house::network;
+
+static bool contains(const std::vector<ConnectionId> &ready,
+                     const ConnectionId connection) {
+  return std::find(ready.begin(), ready.end(), connection) != ready.end();
+}
+
+static int connect_to(const ConnectionId server) {
+  sockaddr_in address{};
+  socklen_t length = sizeof(address);
+  getsockname(server, reinterpret_cast<sockaddr *>(&address), &length);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  auto client = socket(AF_INET, SOCK_STREAM, 0);
+  REQUIRE(connect(client, reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)) == 0);
+  return client;
+}
+
+TEST_CASE("Serialize the handoff state", "[Handoff]") {
+  HandoffState state;
+  state.ingress.listeners = {{3, ListenerKind::Text},
+                             {4, ListenerKind::Local}};
+  state.ingress.connections.push_back(
+      {5, 7, Protocol::Text, std::string{"user"}, "0SHOW", "RESP>> ",
+       "MULTI\nSHOW FUNDS\n"});
+  state.ingress.connections.push_back(
+      {6, 9, Protocol::Binary, {}, std::string(8, '\0'), "", ""});
+  state.accounts["user"] = {100, {"item", "other item"}};
+  auto expiration = Clock::now() + std::chrono::seconds{30};
+  state.auctions.auctions[2] = {"user", "buyer", 20, "item", expiration, 50};
+  state.auctions.next_id = 3;
+
+  auto data = serialize_state(state);
+  auto restored = deserialize_state(data);
+  REQUIRE(restored.ingress.listeners.size() == 2);
+  REQUIRE(restored.ingress.listeners[0].server_fd == INVALID_CONNECTION);
+  REQUIRE(restored.ingress.listeners[1].kind == ListenerKind::Local);
+  REQUIRE(restored.ingress.connections.size() == 2);
+  auto &connection = restored.ingress.connections.front();
+  REQUIRE(connection.connection == INVALID_CONNECTION);
+  REQUIRE(connection.session_id == 7);
+  REQUIRE(connection.username == std::optional<std::string>{"user"});
+  REQUIRE(connection.input == "0SHOW");
+  REQUIRE(connection.output == "RESP>> ");
+  REQUIRE(connection.batch == "MULTI\nSHOW FUNDS\n");
+  REQUIRE(restored.ingress.connections.back().protocol == Protocol::Binary);
+  REQUIRE_FALSE(restored.ingress.connections.back().username.has_value());
+  REQUIRE(restored.accounts["user"].funds == 100);
+  REQUIRE(restored.accounts["user"].items ==
+          std::list<std::string>{"item", "other item"});
+  REQUIRE(restored.auctions.next_id == 3);
+  auto &auction = restored.auctions.auctions.at(2);
+  REQUIRE(auction.buyer == std::optional<std::string>{"buyer"});
+  REQUIRE(auction.price == 20);
+  REQUIRE(auction.expiration_time == expiration);
+  REQUIRE(auction.max_price == 50);
+
+  REQUIRE_THROWS_AS(deserialize_state(data.substr(0, data.size() - 1)),
+                    std::out_of_range);
+}
+
+TEST_CASE("Hand connections over to another reactor", "[Handoff]") {
+  auto previous = create_reactor(Backend::Epoll);
+  auto server = previous->init_server_socket(0);
+  auto client = connect_to(server);
+  while (!contains(previous->wait_for_traffic(), server)) {
+  }
+  auto connections = previous->handle_new_connections(server);
+  REQUIRE(connections.size() == 1);
+  auto connection = connections.front();
+
+  // the client doesn't read, most of the reply is left in the output queue
+  std::string reply(8 << 20, 'x');
+  previous->send_data(connection, {reply, ResultCode::Ok, Protocol::Binary});
+  auto output = previous->release_connection(connection);
+  REQUIRE(output.has_value());
+  REQUIRE_FALSE(output->empty());
+  REQUIRE_FALSE(previous->release_connection(connection).has_value());
+
+  auto next = create_reactor(Backend::Epoll);
+  REQUIRE(next->adopt_server_socket(server));
+  REQUIRE(next->adopt_connection(connection, output.value()));
+  // every byte arrives once and in order
+  std::string received;
+  std::vector<char> buffer(64 * 1024);
+  while (received.size() < REPLY_HEADER_SIZE + reply.size()) {
+    next->wait_for_traffic(std::chrono::milliseconds{1});
+    auto n_bytes = recv(client, buffer.data(), buffer.size(), MSG_DONTWAIT);
+    if (n_bytes > 0) {
+      received.append(buffer.data(), n_bytes);
+    }
+  }
+  REQUIRE(received.substr(REPLY_HEADER_SIZE) == reply);
+
+  // the adopted connection and listener are served as the own ones
+  REQUIRE(send(client, "HELP\n", 5, 0) == 5);
+  while (!contains(next->wait_for_traffic(), connection)) {
+  }
+  REQUIRE(next->receive_data(connection).data == "HELP\n");
+  auto other_client = connect_to(server);
+  while (!contains(next->wait_for_traffic(), server)) {
+  }
+  REQUIRE(next->handle_new_connections(server).size() == 1);
+
+  close(other_client);
+  close(client);
+  next->close_connection(connection);
+  close(server);
+}
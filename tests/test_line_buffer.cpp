@@ -0,0 +1,110 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#include "line_buffer.h"
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+using namespace auction_house::engine;
+
+static std::vector<std::string> read_lines(LineBuffer &buffer) {
+  std::vector<std::string> lines;
+  while (auto line = buffer.next_line()) {
+    lines.push_back(std::move(line.value()));
+  }
+  return lines;
+}
+
+TEST_CASE("Split received data into lines", "[LineBuffer]") {
+  LineBuffer buffer;
+
+  SECTION("Single line") {
+    buffer.append("LOGIN username\n");
+    REQUIRE(read_lines(buffer) == std::vector<std::string>{"LOGIN username"});
+    REQUIRE(buffer.pending() == 0);
+  }
+
+  SECTION("Pipelined lines in one packet") {
+    buffer.append("BID 1 10\nBID 2 20\nSHOW FUNDS\n");
+    REQUIRE(read_lines(buffer) ==
+            std::vector<std::string>{"BID 1 10", "BID 2 20", "SHOW FUNDS"});
+  }
+
+  SECTION("Line split across packets") {
+    buffer.append("DEPOSIT FU");
+    REQUIRE(read_lines(buffer).empty());
+    REQUIRE(buffer.pending() == 10);
+    buffer.append("NDS 100");
+    REQUIRE(read_lines(buffer).empty());
+    buffer.append("\nSHOW");
+    REQUIRE(read_lines(buffer) ==
+            std::vector<std::string>{"DEPOSIT FUNDS 100"});
+    buffer.append(" FUNDS\n");
+    REQUIRE(read_lines(buffer) == std::vector<std::string>{"SHOW FUNDS"});
+    REQUIRE(buffer.pending() == 0);
+  }
+
+  SECTION("Telnet line endings and empty lines") {
+    buffer.append("HELP\r\n\r\n\nLOGOUT\r");
+    REQUIRE(read_lines(buffer) == std::vector<std::string>{"HELP", "", ""});
+    buffer.append("\n");
+    REQUIRE(read_lines(buffer) == std::vector<std::string>{"LOGOUT"});
+  }
+
+  SECTION("Many small packets") {
+    std::string data{"SELL item 10 20\n"};
+    for (auto i = 0; i < 100; ++i) {
+      for (auto c : data) {
+        buffer.append(std::string(1, c));
+      }
+    }
+    auto lines = read_lines(buffer);
+    REQUIRE(lines.size() == 100);
+    REQUIRE(lines.back() == "SELL item 10 20");
+  }
+}
+
+TEST_CASE("Drop too long lines", "[LineBuffer]") {
+  LineBuffer buffer{8};
+
+  SECTION("Complete line in one packet") {
+    buffer.append("0123456789\nHELP\n");
+    REQUIRE(read_lines(buffer) == std::vector<std::string>{"HELP"});
+  }
+
+  SECTION("Line split across packets") {
+    buffer.append("0123456789");
+    REQUIRE(read_lines(buffer).empty());
+    REQUIRE(buffer.pending() == 0);
+    buffer.append("0123456789");
+    REQUIRE(read_lines(buffer).empty());
+    buffer.append("\nHELP\n");
+    REQUIRE(read_lines(buffer) == std::vector<std::string>{"HELP"});
+  }
+
+  SECTION("Line at the limit") {
+    buffer.append("01234567\n");
+    REQUIRE(read_lines(buffer) == std::vector<std::string>{"01234567"});
+  }
+
+  SECTION("Keep skipping after a restore") {
+    buffer.append("0123456789");
+    REQUIRE(read_lines(buffer).empty());
+    LineBuffer restored{8};
+    restored.restore(buffer.snapshot());
+    restored.append("0123\nHELP\n");
+    REQUIRE(read_lines(restored) == std::vector<std::string>{"HELP"});
+  }
+}
+
+TEST_CASE("Restore a partial line", "[LineBuffer]") {
+  LineBuffer buffer;
+  buffer.append("HELP\nSHOW FU");
+  REQUIRE(read_lines(buffer) == std::vector<std::string>{"HELP"});
+  LineBuffer restored;
+  restored.restore(buffer.snapshot());
+  REQUIRE(restored.pending() == 7);
+  restored.append("NDS\n");
+  REQUIRE(read_lines(restored) == std::vector<std::string>{"SHOW FUNDS"});
+}
@@ -0,0 +1,261 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#include "network.h"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace auction_house;
+using namespace auction_house::network;
+
+constexpr auto REPLIES = 64;
+constexpr auto REPLY_SIZE = 64 * 1024;
+constexpr auto MAX_PENDING_BYTES = 256 * 1024;
+
+static bool contains(const std::vector<ConnectionId> &ready,
+                     const ConnectionId connection) {
+  return std::find(ready.begin(), ready.end(), connection) != ready.end();
+}
+
+// The io_uring backend is tested only if the kernel supports it
+static std::vector<Backend> backends() {
+  std::vector<Backend> backends{Backend::Epoll};
+  if (create_reactor(Backend::IoUring)) {
+    backends.push_back(Backend::IoUring);
+  }
+  return backends;
+}
+
+// Connects a client to the reactor, returns the client socket and the
+// connection seen by the reactor
+static std::pair<int, ConnectionId> connect_client(Reactor &reactor,
+                                                   const ConnectionId server) {
+  sockaddr_in address{};
+  socklen_t length = sizeof(address);
+  getsockname(server, reinterpret_cast<sockaddr *>(&address), &length);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  auto client = socket(AF_INET, SOCK_STREAM, 0);
+  int buffer_size = 32 * 1024;
+  setsockopt(client, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+  REQUIRE(connect(client, reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)) == 0);
+
+  while (!contains(reactor.wait_for_traffic(), server)) {
+  }
+  auto connections = reactor.handle_new_connections(server);
+  REQUIRE(connections.size() == 1);
+  auto connection = connections.front();
+  // keeps the kernel from absorbing the whole burst
+  buffer_size = 16 * 1024;
+  setsockopt(connection, SOL_SOCKET, SO_SNDBUF, &buffer_size,
+             sizeof(buffer_size));
+  return {client, connection};
+}
+
+TEST_CASE("Stop waiting for traffic after the timeout", "[Network]") {
+  auto backend = GENERATE(from_range(backends()));
+  auto reactor = create_reactor(backend);
+  auto server = reactor->init_server_socket(0);
+  REQUIRE(reactor->wait_for_traffic(std::chrono::milliseconds{10}).empty());
+  close(server);
+}
+
+TEST_CASE("Accept a reconnect storm", "[Network]") {
+  constexpr auto CLIENTS = 400;
+  auto backend = GENERATE(from_range(backends()));
+  SocketOptions options{};
+  options.no_delay = true;
+  auto reactor = create_reactor(backend, {}, options);
+  auto server = reactor->init_server_socket(0);
+  sockaddr_in address{};
+  socklen_t length = sizeof(address);
+  getsockname(server, reinterpret_cast<sockaddr *>(&address), &length);
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+  // all clients connect before the reactor gets a chance to accept any
+  std::vector<int> clients;
+  for (auto i = 0; i < CLIENTS; ++i) {
+    clients.push_back(socket(AF_INET, SOCK_STREAM, 0));
+    REQUIRE(connect(clients.back(), reinterpret_cast<sockaddr *>(&address),
+                    sizeof(address)) == 0);
+  }
+
+  std::vector<ConnectionId> accepted;
+  auto wakeups = 0;
+  while (accepted.size() < CLIENTS) {
+    if (contains(reactor->wait_for_traffic(std::chrono::seconds{1}), server)) {
+      auto connections = reactor->handle_new_connections(server);
+      REQUIRE(connections.size() <= MAX_ACCEPTS);
+      accepted.insert(accepted.end(), connections.begin(), connections.end());
+      ++wakeups;
+    }
+  }
+  REQUIRE(accepted.size() == CLIENTS);
+  // the listener is drained in batches instead of one client per wakeup
+  REQUIRE(wakeups <= CLIENTS / MAX_ACCEPTS + 2);
+
+  int no_delay = 0;
+  length = sizeof(no_delay);
+  getsockopt(accepted.front(), IPPROTO_TCP, TCP_NODELAY, &no_delay, &length);
+  REQUIRE(no_delay != 0);
+
+  for (auto connection : accepted) {
+    reactor->close_connection(connection);
+  }
+  for (auto client : clients) {
+    close(client);
+  }
+  close(server);
+}
+
+TEST_CASE("Serve local connections", "[Network]") {
+  constexpr auto PATH = "/tmp/auction_house_test.sock";
+  auto backend = GENERATE(from_range(backends()));
+  SocketOptions options{};
+  options.no_delay = true; // doesn't apply to local connections
+  auto reactor = create_reactor(backend, {}, options);
+  auto server = reactor->init_unix_server_socket(PATH);
+
+  auto client = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, PATH);
+  REQUIRE(connect(client, reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)) == 0);
+  while (!contains(reactor->wait_for_traffic(), server)) {
+  }
+  auto connections = reactor->handle_new_connections(server);
+  REQUIRE(connections.size() == 1);
+  auto connection = connections.front();
+
+  REQUIRE(send(client, "HELP\n", 5, 0) == 5);
+  while (!contains(reactor->wait_for_traffic(), connection)) {
+  }
+  REQUIRE(reactor->receive_data(connection).data == "HELP\n");
+
+  reactor->send_data(connection, {"Hello"});
+  reactor->wait_for_traffic(std::chrono::milliseconds{10});
+  std::string reply(64, '\0');
+  reply.resize(recv(client, reply.data(), reply.size(), 0));
+  REQUIRE(reply == "RESP>> Hello\nCMD>>");
+
+  reactor->close_connection(connection);
+  close(client);
+  close(server);
+  unlink(PATH);
+}
+
+TEST_CASE("Read a fast sender in chunks", "[Network]") {
+  constexpr auto PATH = "/tmp/auction_house_test.sock";
+  constexpr auto SIZE = 4 * MAX_READ_BYTES;
+  auto reactor = create_reactor(Backend::Epoll);
+  auto server = reactor->init_unix_server_socket(PATH);
+  auto client = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, PATH);
+  REQUIRE(connect(client, reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)) == 0);
+  while (!contains(reactor->wait_for_traffic(), server)) {
+  }
+  auto connection = reactor->handle_new_connections(server).front();
+
+  std::thread sender{[client, SIZE] {
+    std::string data(SIZE, 'x');
+    for (std::size_t sent = 0; sent < data.size();) {
+      sent += send(client, data.data() + sent, data.size() - sent, 0);
+    }
+  }};
+  // a read stops at the limit, the rest is reported again without new data
+  std::size_t received = 0;
+  std::size_t largest = 0;
+  while (received < SIZE) {
+    if (contains(reactor->wait_for_traffic(), connection)) {
+      auto size = reactor->receive_data(connection).data.size();
+      largest = std::max(largest, size);
+      received += size;
+    }
+  }
+  sender.join();
+  REQUIRE(received == SIZE);
+  REQUIRE(largest < MAX_READ_BYTES + 1024);
+
+  reactor->close_connection(connection);
+  close(client);
+  close(server);
+  unlink(PATH);
+}
+
+TEST_CASE("Limit output of clients which don't read", "[Network]") {
+  auto backend = GENERATE(from_range(backends()));
+  EgressLimit limit{};
+  limit.max_pending_bytes = MAX_PENDING_BYTES;
+
+  SECTION("Pause reading until the output drains") {
+    limit.policy = SlowClientPolicy::PauseReading;
+    auto reactor = create_reactor(backend, limit);
+    auto server = reactor->init_server_socket(0);
+    auto [client, connection] = connect_client(*reactor, server);
+
+    Payload reply{std::string(REPLY_SIZE, 'x')};
+    for (auto i = 0; i < REPLIES; ++i) {
+      reactor->send_data(connection, {reply});
+    }
+    REQUIRE(send(client, "HELP\n", 5, 0) == 5);
+    auto ready = reactor->wait_for_traffic();
+    REQUIRE(reactor->egress_stats().paused == 1);
+    REQUIRE_FALSE(contains(ready, connection));
+
+    // reads until the client is shut down
+    std::thread reader{[client = client] {
+      std::string buffer(64 * 1024, '\0');
+      while (recv(client, buffer.data(), buffer.size(), 0) > 0) {
+      }
+    }};
+    while (!contains(ready, connection)) {
+      ready = reactor->wait_for_traffic();
+    }
+    shutdown(client, SHUT_RDWR);
+    reader.join();
+    REQUIRE(reactor->receive_data(connection).data == "HELP\n");
+    REQUIRE(reactor->egress_stats().disconnected == 0);
+
+    reactor->close_connection(connection);
+    close(client);
+    close(server);
+  }
+
+  SECTION("Disconnect") {
+    limit.policy = SlowClientPolicy::Disconnect;
+    auto reactor = create_reactor(backend, limit);
+    auto server = reactor->init_server_socket(0);
+    auto [client, connection] = connect_client(*reactor, server);
+
+    Payload reply{std::string(REPLY_SIZE, 'x')};
+    for (auto i = 0; i < REPLIES; ++i) {
+      reactor->send_data(connection, {reply});
+    }
+    auto hung_up = false;
+    while (!hung_up) {
+      if (contains(reactor->wait_for_traffic(), connection)) {
+        hung_up = reactor->receive_data(connection).hung_up;
+      }
+    }
+    REQUIRE(reactor->egress_stats().disconnected == 1);
+    REQUIRE(reactor->egress_stats().paused == 0);
+
+    reactor->close_connection(connection);
+    close(client);
+    close(server);
+  }
+}
@@ -0,0 +1,123 @@
+//
+// Created by mswiercz on 27.11.2021.
+//
+#include "output_queue.h"
+#include <array>
+#include <catch2/catch.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace auction_house;
+using namespace auction_house::network;
+
+static std::string gathered(const OutputQueue &output,
+                            const std::size_t max_iovecs = MAX_IOVECS) {
+  std::array<iovec, MAX_IOVECS> iovecs{};
+  auto count = output.gather(iovecs.data(), max_iovecs);
+  std::string result;
+  for (std::size_t i = 0; i < count; ++i) {
+    result.append(static_cast<const char *>(iovecs[i].iov_base),
+                  iovecs[i].iov_len);
+  }
+  return result;
+}
+
+TEST_CASE("Queue replies for a connection", "[OutputQueue]") {
+  OutputQueue output;
+  REQUIRE(output.empty());
+  output.push("RESP>> first");
+  output.push("");
+  output.push("RESP>> second");
+  REQUIRE(output.size() == 25);
+
+  SECTION("Gather all pieces") {
+    REQUIRE(gathered(output) == "RESP>> firstRESP>> second");
+  }
+
+  SECTION("Gather is limited by the number of iovecs") {
+    REQUIRE(gathered(output, 1) == "RESP>> first");
+  }
+
+  SECTION("Partial write") {
+    output.consume(7);
+    REQUIRE(output.size() == 18);
+    REQUIRE(gathered(output) == "firstRESP>> second");
+    output.consume(12);
+    REQUIRE(gathered(output) == "second");
+    output.consume(6);
+    REQUIRE(output.empty());
+    REQUIRE(output.size() == 0);
+  }
+
+  SECTION("Write everything at once") {
+    output.consume(25);
+    REQUIRE(output.empty());
+    output.push("RESP>> third");
+    REQUIRE(gathered(output) == "RESP>> third");
+  }
+}
+
+TEST_CASE("Frame replies without copying them", "[OutputQueue]") {
+  OutputQueue output;
+  Payload payload{"Your funds: 10"};
+  output.push_response({payload});
+  output.push_response({payload});
+
+  std::array<iovec, MAX_IOVECS> iovecs{};
+  REQUIRE(output.gather(iovecs.data(), iovecs.size()) == 6);
+  REQUIRE(iovecs[1].iov_base == payload.view().data());
+  REQUIRE(iovecs[4].iov_base == payload.view().data());
+  REQUIRE(gathered(output) ==
+          "RESP>> Your funds: 10\nCMD>>RESP>> Your funds: 10\nCMD>>");
+
+  SECTION("Empty reply") {
+    output.consume(output.size());
+    output.push_response({});
+    REQUIRE(gathered(output) == "RESP>> \nCMD>>");
+  }
+
+  SECTION("Binary reply") {
+    output.consume(output.size());
+    output.push_response({payload, ResultCode::TooLowPrice, Protocol::Binary});
+    REQUIRE(output.gather(iovecs.data(), iovecs.size()) == 2);
+    REQUIRE(iovecs[1].iov_base == payload.view().data());
+    REQUIRE(gathered(output) ==
+            std::string{"\x0f\0\0\0\x09", 5} + "Your funds: 10");
+  }
+}
+
+TEST_CASE("Hand replies over to a reactor", "[Outbox]") {
+  Outbox outbox;
+
+  SECTION("Only the first reply wakes the reactor up") {
+    REQUIRE(outbox.push(1, {"first"}));
+    REQUIRE_FALSE(outbox.push(2, {"second"}));
+    auto replies = outbox.take();
+    REQUIRE(replies.size() == 2);
+    REQUIRE(replies[0].first == 1);
+    REQUIRE(replies[0].second.data == "first");
+    REQUIRE(replies[1].first == 2);
+    REQUIRE(replies[1].second.data == "second");
+    REQUIRE(outbox.take().empty());
+    REQUIRE(outbox.push(1, {"third"}));
+  }
+
+  SECTION("Replies from many threads") {
+    constexpr auto THREADS = 4;
+    constexpr auto REPLIES = 1000;
+    std::vector<std::thread> threads;
+    for (auto t = 0; t < THREADS; ++t) {
+      threads.emplace_back([&outbox, t] {
+        for (auto i = 0; i < REPLIES; ++i) {
+          outbox.push(t, {std::to_string(i)});
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+    auto replies = outbox.take();
+    REQUIRE(replies.size() == THREADS * REPLIES);
+  }
+}
@@ -0,0 +1,197 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#include "rate_limiter.h"
+#include "database.h"
+#include "session_processor.h"
+#include "tasks.h"
+#include "tasks_executor.h"
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+using namespace auction_house;
+using namespace auction_house::engine;
+using namespace std::chrono_literals;
+
+TEST_CASE("Refill a token bucket", "[RateLimiter]") {
+  auto start = TokenBucket::Clock::now();
+  TokenBucket bucket;
+  RateLimit limit{10, 5};
+
+  SECTION("The bucket is full at the start") {
+    REQUIRE(bucket.available(limit, start) == 5);
+    bucket.take(5);
+    REQUIRE(bucket.available(limit, start) == 0);
+  }
+
+  SECTION("Tokens come back at the rate up to the burst") {
+    bucket.available(limit, start);
+    bucket.take(5);
+    REQUIRE(bucket.available(limit, start + 250ms) == 2);
+    REQUIRE(bucket.available(limit, start + 10s) == 5);
+  }
+
+  SECTION("Lowering the burst empties the bucket down to it") {
+    bucket.available(limit, start);
+    REQUIRE(bucket.available({10, 2}, start + 1ms) == 2);
+  }
+
+  SECTION("Time going backwards doesn't add tokens") {
+    bucket.available(limit, start + 1s);
+    bucket.take(5);
+    REQUIRE(bucket.available(limit, start) == 0);
+    REQUIRE(bucket.available(limit, start + 1s + 100ms) == 1);
+  }
+}
+
+TEST_CASE("Admit commands within the limits", "[RateLimiter]") {
+  auto now = TokenBucket::Clock::now();
+  RateLimiter limiter;
+  TokenBucket session;
+  TokenBucket other_session;
+  RateLimits limits{RateLimit{1, 3}, RateLimit{1, 4}};
+
+  SECTION("No limits") {
+    REQUIRE(limiter.admit({}, session, "user", 1000, now) == 1000);
+  }
+
+  SECTION("The session limit applies to every session on its own") {
+    REQUIRE(limiter.admit(limits, session, {}, 5, now) == 3);
+    REQUIRE(limiter.admit(limits, session, {}, 1, now) == 0);
+    REQUIRE(limiter.admit(limits, other_session, {}, 2, now) == 2);
+    REQUIRE(limiter.admit(limits, session, {}, 2, now + 1s) == 1);
+  }
+
+  SECTION("The user limit is shared by the sessions of a user") {
+    REQUIRE(limiter.admit(limits, session, "user", 3, now) == 3);
+    REQUIRE(limiter.admit(limits, other_session, "user", 3, now) == 1);
+    REQUIRE(limiter.admit(limits, other_session, "other", 3, now) == 2);
+  }
+
+  SECTION("Rejected commands don't take tokens") {
+    limits.session = RateLimit{1, 10};
+    REQUIRE(limiter.admit(limits, session, "user", 6, now) == 4);
+    // the session bucket has 6 tokens left, the user one is empty
+    REQUIRE(limiter.admit(limits, session, {}, 10, now) == 6);
+  }
+
+  SECTION("New limits refill the user buckets") {
+    REQUIRE(limiter.admit(limits, session, "user", 4, now) == 3);
+    limiter.set_limits({{}, RateLimit{1, 2}});
+    auto current = limiter.limits();
+    REQUIRE_FALSE(current->session.has_value());
+    REQUIRE(limiter.admit(*current, other_session, "user", 4, now) == 2);
+  }
+}
+
+TEST_CASE("Parse rate limits", "[RateLimiter]") {
+  auto limits = parse_rate_limits("# commands per second and the burst\n"
+                                  "session 20 100\n"
+                                  "\n"
+                                  "  user 0.5 # the burst is one command\n"
+                                  "policy reply\n");
+  REQUIRE(limits.has_value());
+  REQUIRE(limits->session->rate == 20);
+  REQUIRE(limits->session->burst == 100);
+  REQUIRE(limits->user->rate == 0.5);
+  REQUIRE(limits->user->burst == 1);
+  REQUIRE(limits->policy == OverLimitPolicy::Reply);
+
+  auto empty = parse_rate_limits("");
+  REQUIRE(empty.has_value());
+  REQUIRE_FALSE(empty->session.has_value());
+  REQUIRE_FALSE(empty->user.has_value());
+  REQUIRE(empty->policy == OverLimitPolicy::Drop);
+
+  REQUIRE(parse_rate_limits("session 10 20")->session->burst == 20);
+  REQUIRE_FALSE(parse_rate_limits("session").has_value());
+  REQUIRE_FALSE(parse_rate_limits("session 10x").has_value());
+  REQUIRE_FALSE(parse_rate_limits("session 0").has_value());
+  REQUIRE_FALSE(parse_rate_limits("session -1 5").has_value());
+  REQUIRE_FALSE(parse_rate_limits("session 10 0.5").has_value());
+  REQUIRE_FALSE(parse_rate_limits("session 10 20 30").has_value());
+  REQUIRE_FALSE(parse_rate_limits("user nan").has_value());
+  REQUIRE_FALSE(parse_rate_limits("user 10 inf").has_value());
+  REQUIRE_FALSE(parse_rate_limits("policy ignore").has_value());
+  REQUIRE_FALSE(parse_rate_limits("connection 10").has_value());
+}
+
+TEST_CASE("Reply to rejected commands", "[RateLimiter]") {
+  auto task = create_reply_task(
+      {7, "Too many commands, slow down!", ResultCode::RateLimited});
+  auto event = task.get();
+  REQUIRE(event.session_id == std::optional<SessionId>{7});
+  REQUIRE(event.data == Payload{"Too many commands, slow down!"});
+  REQUIRE(event.result == ResultCode::RateLimited);
+}
+
+// Runs the tasks queued so far on the only worker, returns their replies
+static std::vector<EgressEvent> run_queued(TasksExecutor &tasks) {
+  tasks.enqueue_exclusive([] { return EgressEvent{}; });
+  std::vector<EgressEvent> replies;
+  for (auto event = tasks.pop(0).get(); event.session_id.has_value();
+       event = tasks.pop(0).get()) {
+    replies.push_back(std::move(event));
+  }
+  return replies;
+}
+
+TEST_CASE("Reject the commands of a session over the limit",
+          "[RateLimiter]") {
+  Accounts accounts;
+  AuctionList auctions;
+  SessionManager sessions;
+  Database database{accounts, auctions, sessions};
+  TasksExecutor tasks;
+  SessionProcessor processor{database, tasks, {}};
+  processor.set_rate_limits({RateLimit{1, 2}, {}, OverLimitPolicy::Reply});
+  Connection connection;
+  connection.session_id = 1;
+  sessions.start_session(connection.session_id, 1);
+
+  SECTION("A flood gets a single reply") {
+    std::vector<std::string> flood(1000, "SHOW FUNDS");
+    processor.enqueue_commands(connection, flood);
+    auto replies = run_queued(tasks);
+    REQUIRE(replies.size() == 3);
+    REQUIRE(replies[0].result == ResultCode::NotLoggedIn);
+    REQUIRE(replies[1].result == ResultCode::NotLoggedIn);
+    REQUIRE(replies[2].result == ResultCode::RateLimited);
+    REQUIRE(replies[2].data == Payload{"Too many commands, slow down!"});
+  }
+
+  SECTION("A batch whose EXEC is rejected is discarded") {
+    std::vector<std::string> commands{"MULTI", "SHOW FUNDS", "EXEC"};
+    processor.enqueue_commands(connection, commands);
+    REQUIRE_FALSE(connection.batch.has_value());
+    REQUIRE_FALSE(connection.rejected_batch);
+
+    // the next commands aren't batched
+    connection.commands = TokenBucket{};
+    commands = {"SHOW FUNDS"};
+    processor.enqueue_commands(connection, commands);
+    auto replies = run_queued(tasks);
+    REQUIRE(replies.size() == 2);
+    REQUIRE(replies[0].result == ResultCode::RateLimited);
+    REQUIRE(replies[1].result == ResultCode::NotLoggedIn);
+  }
+
+  SECTION("A batch whose MULTI is rejected is rejected up to its EXEC") {
+    std::vector<std::string> commands{"SHOW FUNDS", "SHOW FUNDS", "MULTI",
+                                      "SHOW FUNDS"};
+    processor.enqueue_commands(connection, commands);
+    REQUIRE(connection.rejected_batch);
+
+    // the commands within the limit are rejected until the batch ends
+    connection.commands = TokenBucket{};
+    commands = {"EXEC", "SHOW SALES"};
+    processor.enqueue_commands(connection, commands);
+    REQUIRE_FALSE(connection.rejected_batch);
+    auto replies = run_queued(tasks);
+    REQUIRE(replies.size() == 5);
+    REQUIRE(replies[2].result == ResultCode::RateLimited);
+    REQUIRE(replies[3].result == ResultCode::RateLimited);
+    REQUIRE(replies[4].result == ResultCode::NotLoggedIn);
+  }
+}
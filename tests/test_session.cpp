@@ -2,7 +2,11 @@
 // Created by mswiercz on 23.11.2021.
 //
 #include "session.h"
+#include <array>
 #include <catch2/catch.hpp>
+#include <set>
+#include <thread>
+#include <vector>
 
 using namespace auction_house::engine;
 
@@ -68,4 +72,39 @@ TEST_CASE("Check session operators", "[Session]") {
     REQUIRE(manager.end_session(1));
     REQUIRE(!manager.get_connection_id(1).has_value());
   }
-}
\ No newline at end of file
+
+  SECTION("Restore sessions handed over by another process") {
+    REQUIRE(manager.restore_session(7, 3, std::string{"username"}));
+    REQUIRE(manager.restore_session(5, 4, {}));
+    REQUIRE(!manager.restore_session(7, 5, {}));
+    REQUIRE(!manager.restore_session(8, 5, std::string{"username"}));
+    REQUIRE(manager.get_session_id("username").value() == 7);
+    REQUIRE(manager.get_connection_id(5).value() == 4);
+    REQUIRE(manager.generate_session_id() == 8);
+  }
+}
+
+TEST_CASE("Generate session ids from many threads", "[Session]") {
+  SessionManager manager;
+  constexpr auto THREADS = 4;
+  constexpr auto IDS_PER_THREAD = 1000;
+  std::array<std::vector<SessionId>, THREADS> generated;
+
+  std::vector<std::thread> threads;
+  for (auto i = 0; i < THREADS; ++i) {
+    threads.emplace_back([&manager, &ids = generated[i]]() {
+      for (auto j = 0; j < IDS_PER_THREAD; ++j) {
+        ids.push_back(manager.generate_session_id());
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  std::set<SessionId> unique_ids;
+  for (auto &ids : generated) {
+    unique_ids.insert(ids.begin(), ids.end());
+  }
+  REQUIRE(unique_ids.size() == THREADS * IDS_PER_THREAD);
+}
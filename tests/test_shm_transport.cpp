@@ -0,0 +1,203 @@
+//
+// Created by mswiercz on 29.11.2021.
+//
+#include "binary_protocol.h"
+#include "network.h"
+#include "shm_transport.h"
+#include <algorithm>
+#include <array>
+#include <catch2/catch.hpp>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace auction_house;
+using namespace auction_house::engine;
+using namespace auction_house::network;
+
+constexpr auto PATH = "/tmp/auction_house_test_shm.sock";
+
+// Connects to the handshake socket without taking the channel over
+static int connect_raw() {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, PATH);
+  auto client = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  REQUIRE(connect(client, reinterpret_cast<sockaddr *>(&address),
+                  sizeof(address)) == 0);
+  return client;
+}
+
+// Receives the descriptors of the channel, closes the eventfds
+static int receive_memfd(const int client) {
+  std::array<int, 3> fds{};
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))]{};
+  char magic;
+  iovec iov{&magic, sizeof(magic)};
+  msghdr message{};
+  message.msg_iov = &iov;
+  message.msg_iovlen = 1;
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  REQUIRE(recvmsg(client, &message, MSG_CMSG_CLOEXEC) == 1);
+  std::memcpy(fds.data(), CMSG_DATA(CMSG_FIRSTHDR(&message)), sizeof(fds));
+  close(fds[1]);
+  close(fds[2]);
+  return fds[0];
+}
+
+static bool contains(const std::vector<ConnectionId> &ready,
+                     const ConnectionId connection) {
+  return std::find(ready.begin(), ready.end(), connection) != ready.end();
+}
+
+TEST_CASE("Serve clients through shared memory", "[ShmTransport]") {
+  auto reactor = create_reactor(Backend::SharedMemory);
+  auto server = reactor->init_unix_server_socket(PATH);
+
+  // the client blocks until the reactor hands over the channel
+  std::unique_ptr<ShmClient> client;
+  std::thread connecting{
+      [&client] { client = std::make_unique<ShmClient>(PATH); }};
+  std::vector<ConnectionId> connections;
+  while (connections.empty()) {
+    if (contains(reactor->wait_for_traffic(), server)) {
+      connections = reactor->handle_new_connections(server);
+    }
+  }
+  connecting.join();
+  REQUIRE(connections.size() == 1);
+  auto connection = connections.front();
+
+  SECTION("Requests and replies") {
+    auto login = FrameWriter{Opcode::Login}.write_string("user").frame();
+    auto logout = FrameWriter{Opcode::Logout}.frame();
+    client->send(login);
+    client->send(logout);
+    std::string received;
+    while (received.size() < login.size() + logout.size()) {
+      if (contains(reactor->wait_for_traffic(), connection)) {
+        auto data = reactor->receive_data(connection);
+        REQUIRE_FALSE(data.hung_up);
+        received += data.data;
+      }
+    }
+    REQUIRE(received == login + logout);
+
+    reactor->send_data(connection,
+                       {"Welcome user!", ResultCode::Ok, Protocol::Binary});
+    reactor->send_data(connection, {"Logged out!", ResultCode::NotLoggedIn,
+                                    Protocol::Binary});
+    // the reactor moves the replies to the ring while waiting
+    std::thread serving{[&reactor] {
+      reactor->wait_for_traffic(std::chrono::milliseconds{10});
+    }};
+    REQUIRE(client->receive() ==
+            std::make_pair(ResultCode::Ok, std::string{"Welcome user!"}));
+    REQUIRE(client->receive() == std::make_pair(ResultCode::NotLoggedIn,
+                                                std::string{"Logged out!"}));
+    serving.join();
+  }
+
+  SECTION("Replies larger than the ring") {
+    Payload reply{std::string(3 * (1 << 20), 'x')};
+    reactor->send_data(connection, {reply, ResultCode::Ok, Protocol::Binary});
+    std::thread serving{[&reactor, connection] {
+      // the client's reads wake the reactor up, it fills the ring again
+      while (!contains(reactor->wait_for_traffic(std::chrono::milliseconds{10}),
+                       connection)) {
+      }
+    }};
+    auto [result, text] = client->receive();
+    REQUIRE(result == ResultCode::Ok);
+    REQUIRE(text == reply.str());
+    client.reset(); // hangs up, ends the serving thread
+    serving.join();
+    REQUIRE(reactor->receive_data(connection).hung_up);
+  }
+
+  SECTION("Hang up") {
+    client.reset();
+    auto hung_up = false;
+    while (!hung_up) {
+      if (contains(reactor->wait_for_traffic(), connection)) {
+        hung_up = reactor->receive_data(connection).hung_up;
+      }
+    }
+  }
+
+  reactor->close_connection(connection);
+  close(server);
+  unlink(PATH);
+}
+
+TEST_CASE("Hang up clients which corrupt the segment", "[ShmTransport]") {
+  auto reactor = create_reactor(Backend::SharedMemory);
+  auto server = reactor->init_unix_server_socket(PATH);
+  auto client = connect_raw();
+  std::vector<ConnectionId> connections;
+  while (connections.empty()) {
+    if (contains(reactor->wait_for_traffic(), server)) {
+      connections = reactor->handle_new_connections(server);
+    }
+  }
+  REQUIRE(connections.size() == 1);
+  auto connection = connections.front();
+  auto memfd = receive_memfd(client);
+  struct stat memfd_stat {};
+  REQUIRE(fstat(memfd, &memfd_stat) == 0);
+  auto *memory = mmap(nullptr, memfd_stat.st_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, memfd, 0);
+  REQUIRE(memory != MAP_FAILED);
+  auto *layout = static_cast<ShmLayout *>(memory);
+  std::uint64_t capacity = layout->capacity;
+  // the server doesn't read the capacity back
+  layout->capacity = 1u << 31;
+
+  // the server has to detect it, the connection is hung up
+  auto require_hung_up = [&reactor, connection] {
+    while (!contains(reactor->wait_for_traffic(std::chrono::milliseconds{10}),
+                     connection)) {
+    }
+    auto data = reactor->receive_data(connection);
+    REQUIRE(data.hung_up);
+    REQUIRE(data.data.empty());
+  };
+
+  SECTION("The segment can't be resized") {
+    REQUIRE(ftruncate(memfd, 0) == -1);
+    REQUIRE(errno == EPERM);
+    REQUIRE(ftruncate(memfd, memfd_stat.st_size * 2) == -1);
+  }
+
+  SECTION("Requests past the ring") {
+    layout->requests.tail = capacity + 1;
+    require_hung_up();
+  }
+
+  SECTION("Requests far beyond the ring") {
+    layout->requests.tail = std::uint64_t{1} << 62;
+    require_hung_up();
+  }
+
+  SECTION("Replies read before they are written") {
+    layout->replies.head = 1000;
+    Payload reply{std::string(capacity * 2, 'x')};
+    reactor->send_data(connection, {reply, ResultCode::Ok, Protocol::Binary});
+    require_hung_up();
+    REQUIRE(layout->replies.tail == 0);
+  }
+
+  munmap(memory, memfd_stat.st_size);
+  close(memfd);
+  close(client);
+  reactor->close_connection(connection);
+  close(server);
+  unlink(PATH);
+}
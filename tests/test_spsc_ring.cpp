@@ -0,0 +1,100 @@
+//
+// Created by mswiercz on 29.11.2021.
+//
+#include "spsc_ring.h"
+#include <catch2/catch.hpp>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace auction_house::network;
+
+TEST_CASE("Pass bytes through a ring", "[SpscRing]") {
+  RingHeader header;
+  std::vector<char> data(16);
+  SpscRing ring{header, data.data(), data.size()};
+  char buffer[32];
+
+  SECTION("Write and read") {
+    REQUIRE(ring.write("hello") == 5);
+    REQUIRE(ring.readable() == 5);
+    REQUIRE(ring.writable() == 11);
+    REQUIRE(ring.read(buffer, 3) == 3);
+    REQUIRE(std::string(buffer, 3) == "hel");
+    REQUIRE(ring.read(buffer, sizeof(buffer)) == 2);
+    REQUIRE(std::string(buffer, 2) == "lo");
+    REQUIRE(ring.read(buffer, sizeof(buffer)) == 0);
+  }
+
+  SECTION("Write only what fits") {
+    REQUIRE(ring.write("0123456789abcdefXYZ") == 16);
+    REQUIRE(ring.write("X") == 0);
+    REQUIRE(ring.read(buffer, 4) == 4);
+    REQUIRE(ring.write("XYZ") == 3);
+    REQUIRE(ring.read(buffer, sizeof(buffer)) == 15);
+    REQUIRE(std::string(buffer, 15) == "456789abcdefXYZ");
+  }
+
+  SECTION("Data wraps around the end") {
+    REQUIRE(ring.write("0123456789") == 10);
+    REQUIRE(ring.read(buffer, 10) == 10);
+    REQUIRE(ring.write("abcdefghij") == 10);
+    REQUIRE(ring.read(buffer, sizeof(buffer)) == 10);
+    REQUIRE(std::string(buffer, 10) == "abcdefghij");
+  }
+
+  SECTION("Waiting is announced only when there is nothing to do") {
+    REQUIRE(ring.prepare_consumer_wait());
+    REQUIRE(ring.consumer_waiting());
+    ring.finish_consumer_wait();
+    REQUIRE_FALSE(ring.consumer_waiting());
+
+    ring.write("x");
+    REQUIRE_FALSE(ring.prepare_consumer_wait());
+    REQUIRE_FALSE(ring.consumer_waiting());
+    REQUIRE_FALSE(ring.prepare_producer_wait());
+
+    ring.write("0123456789abcde");
+    REQUIRE(ring.prepare_producer_wait());
+    REQUIRE(ring.producer_waiting());
+    ring.finish_producer_wait();
+    REQUIRE_FALSE(ring.producer_waiting());
+  }
+}
+
+TEST_CASE("Stream through a ring between threads", "[SpscRing]") {
+  constexpr std::size_t SIZE = 1 << 16;
+  RingHeader header;
+  std::vector<char> data(64);
+  SpscRing ring{header, data.data(), data.size()};
+
+  std::thread producer{[&ring, SIZE] {
+    std::string chunk;
+    for (std::size_t sent = 0; sent < SIZE;) {
+      chunk.clear();
+      for (std::size_t i = sent; i < std::min(sent + 37, SIZE); ++i) {
+        chunk.push_back(static_cast<char>(i % 251));
+      }
+      auto written = ring.write(chunk);
+      if (written == 0) {
+        std::this_thread::yield(); // the consumer may share the core
+      }
+      sent += written;
+    }
+  }};
+  std::size_t received = 0;
+  auto in_order = true;
+  char buffer[50];
+  while (received < SIZE) {
+    auto size = ring.read(buffer, sizeof(buffer));
+    if (size == 0) {
+      std::this_thread::yield();
+    }
+    for (std::size_t i = 0; i < size; ++i, ++received) {
+      in_order = in_order && buffer[i] == static_cast<char>(received % 251);
+    }
+  }
+  producer.join();
+  REQUIRE(in_order);
+  REQUIRE(ring.readable() == 0);
+}
@@ -0,0 +1,72 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#include "task.h"
+#include <array>
+#include <catch2/catch.hpp>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+using namespace auction_house;
+using namespace auction_house::engine;
+
+TEST_CASE("Run deferred tasks", "[Task]") {
+  auto runs = 0;
+
+  SECTION("A task runs its function once it's got") {
+    Task task{[&runs]() {
+      ++runs;
+      return EgressEvent{1, "data"};
+    }};
+    REQUIRE(task.valid());
+    REQUIRE_FALSE(task.is_ready());
+    REQUIRE(runs == 0);
+    auto event = task.get();
+    REQUIRE(runs == 1);
+    REQUIRE(event.session_id == std::optional<SessionId>{1});
+    REQUIRE(event.data == "data");
+    REQUIRE_FALSE(task.valid());
+  }
+
+  SECTION("A ready task passes its reply on") {
+    auto task = Task::ready({2, "ready", ResultCode::WrongCommand});
+    REQUIRE(task.is_ready());
+    auto event = task.get();
+    REQUIRE(event.data == "ready");
+    REQUIRE(event.result == ResultCode::WrongCommand);
+  }
+
+  SECTION("Move-only functions, small and big ones, are moved with the task") {
+    auto owned = std::make_shared<int>(0);
+    std::array<char, Task::INLINE_SIZE * 2> big{'b'};
+    Task small_task{[owned, data = std::make_unique<std::string>("small")]() {
+      return EgressEvent{3, *data};
+    }};
+    Task big_task{[owned, big]() {
+      return EgressEvent{4, std::string(1, big.front())};
+    }};
+    REQUIRE(owned.use_count() == 3);
+
+    Task moved{std::move(small_task)};
+    REQUIRE_FALSE(small_task.valid());
+    REQUIRE(moved.get().data == "small");
+    REQUIRE(owned.use_count() == 2);
+
+    moved = std::move(big_task);
+    REQUIRE_FALSE(big_task.valid());
+    REQUIRE(owned.use_count() == 2);
+    moved = Task{};
+    REQUIRE(owned.use_count() == 1);
+  }
+
+  SECTION("An exception of the function is thrown by get") {
+    auto owned = std::make_shared<int>(0);
+    Task task{[owned]() -> EgressEvent {
+      throw std::runtime_error{"failed"};
+    }};
+    REQUIRE_THROWS_AS(task.get(), std::runtime_error);
+    REQUIRE_FALSE(task.valid());
+    REQUIRE(owned.use_count() == 1);
+  }
+}
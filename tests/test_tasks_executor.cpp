@@ -0,0 +1,185 @@
+//
+// Created by mswiercz on 30.11.2021.
+//
+#include "tasks_executor.h"
+#include "database.h"
+#include "tasks.h"
+#include <algorithm>
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <chrono>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace auction_house::engine;
+
+// Runs the workers of the executor until the stop flag is set
+static std::vector<std::thread> run_workers(TasksExecutor &tasks,
+                                            std::atomic<bool> &stop) {
+  std::vector<std::thread> workers;
+  for (std::size_t worker = 0; worker < tasks.workers(); ++worker) {
+    workers.emplace_back([&tasks, &stop, worker] {
+      while (!stop) {
+        tasks.pop(worker).get();
+      }
+    });
+  }
+  return workers;
+}
+
+// The flag is set by an exclusive task, so every task queued before has run
+static void stop_workers(TasksExecutor &tasks, std::atomic<bool> &stop,
+                         std::vector<std::thread> &workers) {
+  tasks.enqueue_exclusive([&stop] {
+    stop = true;
+    return EgressEvent{};
+  });
+  for (auto &worker : workers) {
+    worker.join();
+  }
+}
+
+TEST_CASE("Execute tasks on many workers", "[TasksExecutor]") {
+  TasksExecutor tasks{4};
+  REQUIRE(tasks.workers() == 4);
+  REQUIRE(TasksExecutor{0}.workers() == 1);
+  std::atomic<bool> stop = false;
+
+  SECTION("Tasks of a session run in order") {
+    constexpr SessionId SESSIONS = 8;
+    constexpr int COMMANDS = 500;
+    std::mutex mutex;
+    std::vector<std::vector<int>> executed(SESSIONS);
+    auto workers = run_workers(tasks, stop);
+    for (int i = 0; i < COMMANDS; ++i) {
+      for (SessionId session = 0; session < SESSIONS; ++session) {
+        tasks.enqueue(
+            [&, session, i] {
+              std::lock_guard _l{mutex};
+              executed[session].push_back(i);
+              return EgressEvent{session, {}};
+            },
+            session);
+      }
+    }
+    stop_workers(tasks, stop, workers);
+    for (auto &session : executed) {
+      REQUIRE(session.size() == COMMANDS);
+      REQUIRE(std::is_sorted(session.begin(), session.end()));
+    }
+  }
+
+  SECTION("Tasks of different sessions run in parallel") {
+    // neither task can finish before the other one has started
+    std::promise<void> first_started;
+    std::promise<void> second_started;
+    auto workers = run_workers(tasks, stop);
+    tasks.enqueue(
+        [&, started = second_started.get_future()] {
+          first_started.set_value();
+          started.wait();
+          return EgressEvent{1, {}};
+        },
+        1);
+    tasks.enqueue(
+        [&, started = first_started.get_future()] {
+          second_started.set_value();
+          started.wait();
+          return EgressEvent{2, {}};
+        },
+        2);
+    stop_workers(tasks, stop, workers);
+  }
+
+  SECTION("An exclusive task runs alone, between the tasks around it") {
+    std::atomic<int> running = 0;
+    std::atomic<int> finished = 0;
+    auto overlapped = false;
+    int finished_before = 0;
+    auto command = [&running, &finished](const SessionId session) {
+      return [&running, &finished, session] {
+        ++running;
+        std::this_thread::sleep_for(std::chrono::microseconds{50});
+        --running;
+        ++finished;
+        return EgressEvent{session, {}};
+      };
+    };
+    for (SessionId session = 0; session < 16; ++session) {
+      tasks.enqueue(command(session), session);
+    }
+    tasks.enqueue_exclusive([&] {
+      overlapped = running != 0;
+      finished_before = finished;
+      return EgressEvent{};
+    });
+    for (SessionId session = 0; session < 16; ++session) {
+      tasks.enqueue(command(session), session);
+    }
+    auto workers = run_workers(tasks, stop);
+    stop_workers(tasks, stop, workers);
+    REQUIRE_FALSE(overlapped);
+    REQUIRE(finished_before == 16);
+    REQUIRE(finished == 32);
+  }
+}
+
+TEST_CASE("Settle the expired auctions with a single task",
+          "[TasksExecutor]") {
+  SessionManager sessions;
+  AuctionList auctions;
+  Accounts accounts;
+  Database database{accounts, auctions, sessions};
+  TasksExecutor tasks{2};
+  sessions.start_session(1, 1);
+  sessions.start_session(2, 2);
+  REQUIRE(sessions.login(1, "first"));
+  REQUIRE(sessions.login(2, "second"));
+  REQUIRE(accounts.deposit_funds("buyer", 100));
+  ExpiredAuctions expired{{"first", "buyer", 30, "vase", Clock::now()},
+                          {"second", {}, 10, "lamp", Clock::now()},
+                          {"offline", "buyer", 50, "desk", Clock::now()}};
+  tasks.enqueue_exclusive(
+      create_settlement_task(std::move(expired), database, tasks));
+
+  // the notifications of the sellers who are logged in are queued to their
+  // sessions
+  std::atomic<bool> stop = false;
+  std::mutex mutex;
+  std::vector<EgressEvent> notifications;
+  std::vector<std::thread> workers;
+  for (std::size_t worker = 0; worker < tasks.workers(); ++worker) {
+    workers.emplace_back([&, worker] {
+      while (!stop) {
+        auto event = tasks.pop(worker).get();
+        if (event.session_id.has_value()) {
+          std::lock_guard _l{mutex};
+          notifications.push_back(std::move(event));
+        }
+      }
+    });
+  }
+  auto notified = [&mutex, &notifications] {
+    std::lock_guard _l{mutex};
+    return notifications.size() == 2;
+  };
+  while (!notified()) {
+    std::this_thread::yield();
+  }
+  stop_workers(tasks, stop, workers);
+  std::sort(notifications.begin(), notifications.end(),
+            [](const EgressEvent &lhs, const EgressEvent &rhs) {
+              return lhs.session_id < rhs.session_id;
+            });
+  REQUIRE(notifications[0].session_id == std::optional<SessionId>{1});
+  REQUIRE(notifications[0].data ==
+          "Your item: vase, has been sold for 30 by buyer!");
+  REQUIRE(notifications[1].session_id == std::optional<SessionId>{2});
+  REQUIRE(notifications[1].data == "Your item: lamp, hasn't been sold!");
+  REQUIRE(accounts.get_funds("buyer") == 20);
+  REQUIRE(accounts.get_funds("first") == 30);
+  REQUIRE(accounts.get_funds("offline") == 50);
+  REQUIRE(accounts.get_items("second") == "lamp");
+}
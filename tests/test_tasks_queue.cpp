@@ -2,8 +2,10 @@
 // Created by mswiercz on 22.11.2021.
 //
 #include "tasks_queue.h"
+#include <algorithm>
 #include <catch2/catch.hpp>
-#include <future>
+#include <string>
+#include <thread>
 #include <vector>
 
 using namespace auction_house::engine;
@@ -19,17 +21,15 @@ TEST_CASE("Threads talks to each other over queue", "[TasksQueue]") {
   SECTION("One writer and one reader") {
     std::thread reader{[&queue, &results]() {
       for (auto i = 0; i < 4; ++i) {
-        auto f = queue.pop();
-        f.wait();
-        results.push_back(f.get());
+        results.push_back(queue.pop().get());
       }
     }};
 
     std::thread writer{[&queue]() {
-      queue.enqueue(std::async([]() { return EgressEvent{1, "data_0"}; }));
-      queue.enqueue(std::async([]() { return EgressEvent{2, "data_1"}; }));
-      queue.enqueue(std::async([]() { return EgressEvent{3, "data_2"}; }));
-      queue.enqueue(std::async([]() { return EgressEvent{4, "data_3"}; }));
+      queue.enqueue(Task{[]() { return EgressEvent{1, "data_0"}; }});
+      queue.enqueue(Task{[]() { return EgressEvent{2, "data_1"}; }});
+      queue.enqueue(Task{[]() { return EgressEvent{3, "data_2"}; }});
+      queue.enqueue(Task{[]() { return EgressEvent{4, "data_3"}; }});
     }};
 
     reader.join();
@@ -46,24 +46,22 @@ TEST_CASE("Threads talks to each other over queue", "[TasksQueue]") {
   SECTION("Two writers and one reader") {
     std::thread reader{[&queue, &results]() {
       for (auto i = 0; i < 8; ++i) {
-        auto f = queue.pop();
-        f.wait();
-        results.push_back(f.get());
+        results.push_back(queue.pop().get());
       }
     }};
 
     std::thread writer_1{[&queue]() {
-      queue.enqueue(std::async([]() { return EgressEvent{11, "data_0"}; }));
-      queue.enqueue(std::async([]() { return EgressEvent{12, "data_1"}; }));
-      queue.enqueue(std::async([]() { return EgressEvent{13, "data_2"}; }));
-      queue.enqueue(std::async([]() { return EgressEvent{14, "data_3"}; }));
+      queue.enqueue(Task{[]() { return EgressEvent{11, "data_0"}; }});
+      queue.enqueue(Task{[]() { return EgressEvent{12, "data_1"}; }});
+      queue.enqueue(Task{[]() { return EgressEvent{13, "data_2"}; }});
+      queue.enqueue(Task{[]() { return EgressEvent{14, "data_3"}; }});
     }};
 
     std::thread writer_2{[&queue]() {
-      queue.enqueue(std::async([]() { return EgressEvent{21, "data_0"}; }));
-      queue.enqueue(std::async([]() { return EgressEvent{22, "data_1"}; }));
-      queue.enqueue(std::async([]() { return EgressEvent{23, "data_2"}; }));
-      queue.enqueue(std::async([]() { return EgressEvent{24, "data_3"}; }));
+      queue.enqueue(Task{[]() { return EgressEvent{21, "data_0"}; }});
+      queue.enqueue(Task{[]() { return EgressEvent{22, "data_1"}; }});
+      queue.enqueue(Task{[]() { return EgressEvent{23, "data_2"}; }});
+      queue.enqueue(Task{[]() { return EgressEvent{24, "data_3"}; }});
     }};
 
     reader.join();
@@ -78,4 +76,65 @@ TEST_CASE("Threads talks to each other over queue", "[TasksQueue]") {
     REQUIRE(std::is_permutation(results.cbegin(), results.cend(),
                                 expected.cbegin(), compare_events));
   }
-}
\ No newline at end of file
+}
+
+static Task make_task(const SessionId session_id, const std::string &data) {
+  return [session_id, data]() { return EgressEvent{session_id, data}; };
+}
+
+TEST_CASE("Serve sessions fairly", "[TasksQueue]") {
+  TasksQueue queue;
+  std::vector<EgressEvent> results;
+  auto pop = [&queue, &results](const std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+      results.push_back(queue.pop().get());
+    }
+  };
+
+  SECTION("A burst of one session doesn't delay the others") {
+    for (auto i = 0; i < 100; ++i) {
+      queue.enqueue(make_task(1, "data_" + std::to_string(i)), 1);
+    }
+    queue.enqueue(make_task(2, "data_0"), 2);
+    queue.enqueue(make_task(3, "data_0"), 3);
+    queue.enqueue(make_task(2, "data_1"), 2);
+    pop(6);
+    std::vector expected{EgressEvent{1, "data_0"}, EgressEvent{2, "data_0"},
+                         EgressEvent{3, "data_0"}, EgressEvent{1, "data_1"},
+                         EgressEvent{2, "data_1"}, EgressEvent{1, "data_2"}};
+    REQUIRE(std::equal(results.cbegin(), results.cend(), expected.cbegin(),
+                       expected.cend(), compare_events));
+
+    // the rest of the burst keeps its order
+    pop(97);
+    for (auto i = 3; i < 100; ++i) {
+      REQUIRE(results[i + 3].data == "data_" + std::to_string(i));
+    }
+  }
+
+  SECTION("Tasks without a session take turns too") {
+    queue.enqueue(make_task(1, "data_0"), 1);
+    queue.enqueue(make_task(1, "data_1"), 1);
+    queue.enqueue(make_task(0, "auction"));
+    pop(3);
+    REQUIRE(results[1].data == "auction");
+  }
+
+  SECTION("A barrier waits for the tasks queued before it") {
+    queue.enqueue(make_task(1, "data_0"), 1);
+    queue.enqueue(make_task(1, "data_1"), 1);
+    queue.enqueue(make_task(2, "data_0"), 2);
+    queue.enqueue_barrier(make_task(0, "barrier"));
+    queue.enqueue(make_task(3, "data_0"), 3);
+    pop(5);
+    REQUIRE(results[3].data == "barrier");
+    REQUIRE(results[4].session_id == std::optional<SessionId>{3});
+  }
+
+  SECTION("A barrier on an empty queue is popped at once") {
+    queue.enqueue_barrier(make_task(0, "barrier"));
+    queue.enqueue(make_task(1, "data_0"), 1);
+    pop(2);
+    REQUIRE(results[0].data == "barrier");
+  }
+}
@@ -0,0 +1,79 @@
+//
+// Created by mswiercz on 28.11.2021.
+//
+#include "timing_wheel.h"
+#include <algorithm>
+#include <catch2/catch.hpp>
+#include <vector>
+
+using namespace auction_house;
+using namespace auction_house::engine;
+using namespace std::chrono_literals;
+
+static std::vector<ConnectionId> sorted(std::vector<ConnectionId> connections) {
+  std::sort(connections.begin(), connections.end());
+  return connections;
+}
+
+TEST_CASE("Expire connection timers", "[TimingWheel]") {
+  const auto start = TimingWheel::Clock::time_point{};
+  TimingWheel wheel{1s, 8, start};
+  wheel.schedule(1, 3s, start);
+  wheel.schedule(2, 5s, start);
+  REQUIRE(wheel.size() == 2);
+
+  SECTION("Timers expire no earlier than the timeout") {
+    REQUIRE(wheel.advance(start + 2999ms).empty());
+    REQUIRE(wheel.advance(start + 3s) == std::vector<ConnectionId>{1});
+    REQUIRE(wheel.advance(start + 4s).empty());
+    REQUIRE(wheel.advance(start + 5500ms) == std::vector<ConnectionId>{2});
+    REQUIRE(wheel.empty());
+  }
+
+  SECTION("Restarting a timer postpones it") {
+    wheel.schedule(1, 3s, start + 2s);
+    REQUIRE(wheel.advance(start + 4s).empty());
+    REQUIRE(sorted(wheel.advance(start + 5s)) ==
+            std::vector<ConnectionId>{1, 2});
+  }
+
+  SECTION("Cancelled timers don't expire") {
+    wheel.cancel(1);
+    wheel.cancel(3);
+    REQUIRE(wheel.advance(start + 10s) == std::vector<ConnectionId>{2});
+  }
+
+  SECTION("Timers longer than a turn of the wheel") {
+    wheel.schedule(3, 20s, start);
+    wheel.schedule(4, 9s, start);
+    REQUIRE(sorted(wheel.advance(start + 9s)) ==
+            std::vector<ConnectionId>{1, 2, 4});
+    REQUIRE(wheel.advance(start + 19s).empty());
+    REQUIRE(wheel.advance(start + 20s) == std::vector<ConnectionId>{3});
+  }
+
+  SECTION("Advancing by several turns at once") {
+    wheel.schedule(3, 30s, start);
+    REQUIRE(sorted(wheel.advance(start + 100s)) ==
+            std::vector<ConnectionId>{1, 2, 3});
+  }
+}
+
+TEST_CASE("Refresh many timers", "[TimingWheel]") {
+  const auto start = TimingWheel::Clock::time_point{};
+  TimingWheel wheel{100ms, 16, start};
+  constexpr auto CONNECTIONS = 1000;
+  for (auto i = 0; i < CONNECTIONS; ++i) {
+    wheel.schedule(i, 1s, start);
+  }
+  // only the odd connections keep sending data
+  for (auto now = start + 100ms; now < start + 3s; now += 100ms) {
+    for (auto i = 1; i < CONNECTIONS; i += 2) {
+      wheel.schedule(i, 1s, now);
+    }
+    for (auto connection : wheel.advance(now)) {
+      REQUIRE(connection % 2 == 0);
+    }
+  }
+  REQUIRE(wheel.size() == CONNECTIONS / 2);
+}